@@ -0,0 +1,1408 @@
+//
+// Created by alexaxnder on 19.10.26.
+//
+
+#ifndef DATA_STRUCTURES_ART_H
+#define DATA_STRUCTURES_ART_H
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <initializer_list>
+#include <iterator>
+#include <string>
+#include <type_traits>
+#include <utility>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+
+/*
+ *      Binary comparable key encodings
+ *
+ *      Encoded keys must compare bytewise like the keys compare with
+ *      operator<, and no encoded key may be a prefix of another one.
+ *      Integers are stored big-endian with the sign bit flipped,
+ *      strings escape zero bytes as 00 FF and end with 00 00.
+ */
+template <class Key, class Enable = void>
+struct ArtKeyTraits;
+
+template <class Key>
+struct ArtKeyTraits<Key, typename std::enable_if<std::is_integral<Key>::value>::type> {
+    static void Encode(const Key& key, std::string* bytes) {
+        typedef typename std::make_unsigned<Key>::type Unsigned;
+        Unsigned bits = static_cast<Unsigned>(key);
+        if (std::is_signed<Key>::value) {
+            bits ^= Unsigned(1) << (sizeof(Key) * 8 - 1);
+        }
+
+        bytes->resize(sizeof(Key));
+        for (size_t i = sizeof(Key); i-- > 0;) {
+            (*bytes)[i] = static_cast<char>(bits & 0xFF);
+            bits = static_cast<Unsigned>(bits >> 8);
+        }
+    }
+};
+
+template <>
+struct ArtKeyTraits<std::string> {
+    static void Encode(const std::string& key, std::string* bytes) {
+        bytes->clear();
+        bytes->reserve(key.size() + 2);
+        for (char byte : key) {
+            bytes->push_back(byte);
+            if (byte == '\0') {
+                bytes->push_back('\xFF');
+            }
+        }
+
+        bytes->append(2, '\0');
+    }
+};
+
+
+/*
+ *      Adaptive radix tree
+ *
+ *      Inner nodes branch on one byte of the encoded key and grow through
+ *      4, 16, 48 and 256 children as they fill, shrinking back with some
+ *      hysteresis. A chain of single child nodes is compressed into the
+ *      prefix of the node below it, and a leaf is stored as soon as its
+ *      key is the only one in the subtree (lazy expansion). Leaves keep
+ *      whole keys, so find skips prefixes and checks the leaf only.
+ *
+ *      Iterator steps search the successor from the root, O(key length).
+ *      V. Leis, A. Kemper, T. Neumann, "The adaptive radix tree:
+ *      ARTful indexing for main-memory databases", ICDE 2013.
+ */
+template <class Key, class KeyTraits = ArtKeyTraits<Key>>
+class ArtSet {
+    struct Node;
+    struct Leaf;
+    struct Inner;
+    struct Node4;
+    struct Node16;
+    struct Node48;
+    struct Node256;
+
+public:
+    class iterator:
+            public std::iterator<std::bidirectional_iterator_tag, const Key> {
+        friend class ArtSet;
+
+    public:
+        iterator(): leaf_{nullptr}, set_{nullptr} {};
+        iterator(Leaf* leaf, const ArtSet* set);
+
+        iterator& operator++();
+        iterator operator++(int);
+
+        iterator& operator--();
+        iterator operator--(int);
+
+        const Key& operator*();
+        const Key* operator->();
+
+        bool operator==(const iterator& rhs) const;
+        bool operator!=(const iterator& rhs) const;
+
+    private:
+        Leaf* leaf_;
+        const ArtSet* set_;
+    };
+
+    iterator begin() const;
+    iterator end() const;
+
+    ArtSet();
+
+    template <class InputIterator>
+    ArtSet(InputIterator first, InputIterator last);
+
+    ArtSet(std::initializer_list<Key> list);
+    ArtSet(const ArtSet& rhs);
+    ArtSet(ArtSet&& rhs) noexcept;
+
+    ArtSet& operator=(const ArtSet& rhs);
+    ArtSet& operator=(ArtSet&& rhs) noexcept;
+
+    ~ArtSet();
+
+    std::pair<iterator, bool> insert(const Key& key);
+    void erase(const Key& key);
+    iterator find(const Key& key) const;
+    iterator lower_bound(const Key& key) const;
+
+    size_t size() const;
+    bool empty() const;
+    void clear();
+    void swap(ArtSet& rhs) noexcept;
+
+private:
+    //  Node48 and Node256 shrink only when much emptier than the next
+    //  smaller node, so alternating insert and erase do not thrash
+    static constexpr size_t kNode16Shrink = 3;
+    static constexpr size_t kNode48Shrink = 12;
+    static constexpr size_t kNode256Shrink = 37;
+
+    enum class NodeType: uint8_t {
+        kLeaf, kNode4, kNode16, kNode48, kNode256
+    };
+
+    struct Node {
+        NodeType type;
+
+        explicit Node(NodeType type);
+    };
+
+    struct Leaf: Node {
+        Key key;
+
+        explicit Leaf(const Key& key);
+    };
+
+    //  prefix is the compressed path between the edge into the node
+    //  and its branching byte
+    struct Inner: Node {
+        uint16_t count;
+        std::string prefix;
+
+        Inner(NodeType type, std::string prefix);
+    };
+
+    //  Keys of Node4 and Node16 are sorted
+    struct Node4: Inner {
+        uint8_t keys[4];
+        Node* children[4];
+
+        explicit Node4(std::string prefix);
+    };
+
+    struct Node16: Inner {
+        uint8_t keys[16];
+        Node* children[16];
+
+        explicit Node16(std::string prefix);
+    };
+
+    //  slots[byte] is the child position plus one, zero if absent
+    struct Node48: Inner {
+        uint8_t slots[256];
+        Node* children[48];
+
+        explicit Node48(std::string prefix);
+    };
+
+    struct Node256: Inner {
+        Node* children[256];
+
+        explicit Node256(std::string prefix);
+    };
+
+    static Node** FindChild(Inner* node, uint8_t byte);
+    static Node* NextChild(const Inner* node, int byte);
+    static Node* PrevChild(const Inner* node, int byte);
+    static void AddChild(Node*& ref, uint8_t byte, Node* child);
+    static void RemoveChild(Node*& ref, uint8_t byte);
+    static Inner* Grow(Inner* node);
+    static Node* Shrink(Inner* node);
+
+    static Leaf* Minimum(Node* node);
+    static Leaf* Maximum(Node* node);
+    static int ComparePrefix(const Inner* node, const std::string& bytes, size_t depth);
+
+    Leaf* FindLeaf(const Key& key) const;
+    Leaf* LowerBoundLeaf(Node* node, const std::string& bytes, size_t depth,
+                         const Key& key, bool strict) const;
+    Leaf* PredecessorLeaf(Node* node, const std::string& bytes, size_t depth,
+                          const Key& key) const;
+    Leaf* Successor(Leaf* leaf) const;
+    Leaf* Predecessor(Leaf* leaf) const;
+
+    bool InsertLeaf(Node*& ref, const std::string& bytes, size_t depth,
+                    const Key& key, Leaf** leaf);
+    bool EraseLeaf(Node*& ref, const std::string& bytes, size_t depth, const Key& key);
+
+    template <class Visitor>
+    static void ForEachChild(Inner* node, Visitor visit);
+    static void DestroyNode(Node* node);
+    static void DeleteSubtree(Node* node);
+    static Node* CloneSubtree(const Node* node);
+
+    Node* root_;
+    size_t size_;
+};
+
+
+/*
+ *
+ *      ArtSet implementation
+ *
+ */
+
+template <class Key, class KeyTraits>
+ArtSet<Key, KeyTraits>
+::ArtSet():
+        root_{nullptr},
+        size_{0}
+{}
+
+template <class Key, class KeyTraits>
+template <class InputIterator>
+ArtSet<Key, KeyTraits>
+::ArtSet(
+        InputIterator first,
+        InputIterator last
+):
+        ArtSet()
+{
+    for (; first != last; ++first) {
+        insert(*first);
+    }
+}
+
+template <class Key, class KeyTraits>
+ArtSet<Key, KeyTraits>
+::ArtSet(
+        std::initializer_list<Key> list
+):
+        ArtSet(list.begin(), list.end())
+{}
+
+template <class Key, class KeyTraits>
+ArtSet<Key, KeyTraits>
+::ArtSet(
+        const ArtSet& rhs
+):
+        root_{rhs.root_ ? CloneSubtree(rhs.root_) : nullptr},
+        size_{rhs.size_}
+{}
+
+template <class Key, class KeyTraits>
+ArtSet<Key, KeyTraits>
+::ArtSet(
+        ArtSet&& rhs
+) noexcept:
+        root_{rhs.root_},
+        size_{rhs.size_}
+{
+    rhs.root_ = nullptr;
+    rhs.size_ = 0;
+}
+
+template <class Key, class KeyTraits>
+ArtSet<Key, KeyTraits>&
+ArtSet<Key, KeyTraits>
+::operator=(
+        const ArtSet& rhs
+) {
+    if (this != &rhs) {
+        ArtSet copy(rhs);
+        swap(copy);
+    }
+
+    return *this;
+}
+
+template <class Key, class KeyTraits>
+ArtSet<Key, KeyTraits>&
+ArtSet<Key, KeyTraits>
+::operator=(
+        ArtSet&& rhs
+) noexcept {
+    swap(rhs);
+    return *this;
+}
+
+template <class Key, class KeyTraits>
+ArtSet<Key, KeyTraits>
+::~ArtSet() {
+    clear();
+}
+
+template <class Key, class KeyTraits>
+std::pair<typename ArtSet<Key, KeyTraits>::iterator, bool>
+ArtSet<Key, KeyTraits>
+::insert(
+        const Key& key
+) {
+    std::string bytes;
+    KeyTraits::Encode(key, &bytes);
+
+    Leaf* leaf;
+    bool inserted = InsertLeaf(root_, bytes, 0, key, &leaf);
+    if (inserted) {
+        ++size_;
+    }
+
+    return {iterator(leaf, this), inserted};
+}
+
+template <class Key, class KeyTraits>
+void
+ArtSet<Key, KeyTraits>
+::erase(
+        const Key& key
+) {
+    std::string bytes;
+    KeyTraits::Encode(key, &bytes);
+
+    if (EraseLeaf(root_, bytes, 0, key)) {
+        --size_;
+    }
+}
+
+template <class Key, class KeyTraits>
+typename ArtSet<Key, KeyTraits>::iterator
+ArtSet<Key, KeyTraits>
+::find(
+        const Key& key
+) const {
+    return iterator(FindLeaf(key), this);
+}
+
+template <class Key, class KeyTraits>
+typename ArtSet<Key, KeyTraits>::iterator
+ArtSet<Key, KeyTraits>
+::lower_bound(
+        const Key& key
+) const {
+    std::string bytes;
+    KeyTraits::Encode(key, &bytes);
+    return iterator(LowerBoundLeaf(root_, bytes, 0, key, false), this);
+}
+
+template <class Key, class KeyTraits>
+size_t
+ArtSet<Key, KeyTraits>
+::size() const {
+    return size_;
+}
+
+template <class Key, class KeyTraits>
+bool
+ArtSet<Key, KeyTraits>
+::empty() const {
+    return size_ == 0;
+}
+
+template <class Key, class KeyTraits>
+void
+ArtSet<Key, KeyTraits>
+::clear() {
+    if (root_) {
+        DeleteSubtree(root_);
+    }
+
+    root_ = nullptr;
+    size_ = 0;
+}
+
+template <class Key, class KeyTraits>
+void
+ArtSet<Key, KeyTraits>
+::swap(
+        ArtSet& rhs
+) noexcept {
+    std::swap(root_, rhs.root_);
+    std::swap(size_, rhs.size_);
+}
+
+template <class Key, class KeyTraits>
+typename ArtSet<Key, KeyTraits>::Node**
+ArtSet<Key, KeyTraits>
+::FindChild(
+        Inner* node,
+        uint8_t byte
+) {
+    switch (node->type) {
+        case NodeType::kNode4: {
+            Node4* node4 = static_cast<Node4*>(node);
+            for (size_t i = 0; i < node4->count; ++i) {
+                if (node4->keys[i] == byte) {
+                    return &node4->children[i];
+                }
+            }
+
+            return nullptr;
+        }
+
+        case NodeType::kNode16: {
+            Node16* node16 = static_cast<Node16*>(node);
+#if defined(__SSE2__)
+            __m128i keys = _mm_loadu_si128(reinterpret_cast<const __m128i*>(node16->keys));
+            __m128i equal = _mm_cmpeq_epi8(keys, _mm_set1_epi8(static_cast<char>(byte)));
+            unsigned mask = static_cast<unsigned>(_mm_movemask_epi8(equal)) &
+                            ((1u << node16->count) - 1);
+            if (mask) {
+                return &node16->children[__builtin_ctz(mask)];
+            }
+#else
+            for (size_t i = 0; i < node16->count; ++i) {
+                if (node16->keys[i] == byte) {
+                    return &node16->children[i];
+                }
+            }
+#endif
+            return nullptr;
+        }
+
+        case NodeType::kNode48: {
+            Node48* node48 = static_cast<Node48*>(node);
+            if (!node48->slots[byte]) {
+                return nullptr;
+            }
+
+            return &node48->children[node48->slots[byte] - 1];
+        }
+
+        default: {
+            Node256* node256 = static_cast<Node256*>(node);
+            if (!node256->children[byte]) {
+                return nullptr;
+            }
+
+            return &node256->children[byte];
+        }
+    }
+}
+
+//  First child on an edge above byte, byte may be -1
+template <class Key, class KeyTraits>
+typename ArtSet<Key, KeyTraits>::Node*
+ArtSet<Key, KeyTraits>
+::NextChild(
+        const Inner* node,
+        int byte
+) {
+    switch (node->type) {
+        case NodeType::kNode4: {
+            const Node4* node4 = static_cast<const Node4*>(node);
+            for (size_t i = 0; i < node4->count; ++i) {
+                if (node4->keys[i] > byte) {
+                    return node4->children[i];
+                }
+            }
+
+            return nullptr;
+        }
+
+        case NodeType::kNode16: {
+            const Node16* node16 = static_cast<const Node16*>(node);
+            for (size_t i = 0; i < node16->count; ++i) {
+                if (node16->keys[i] > byte) {
+                    return node16->children[i];
+                }
+            }
+
+            return nullptr;
+        }
+
+        case NodeType::kNode48: {
+            const Node48* node48 = static_cast<const Node48*>(node);
+            for (int next = byte + 1; next < 256; ++next) {
+                if (node48->slots[next]) {
+                    return node48->children[node48->slots[next] - 1];
+                }
+            }
+
+            return nullptr;
+        }
+
+        default: {
+            const Node256* node256 = static_cast<const Node256*>(node);
+            for (int next = byte + 1; next < 256; ++next) {
+                if (node256->children[next]) {
+                    return node256->children[next];
+                }
+            }
+
+            return nullptr;
+        }
+    }
+}
+
+//  Last child on an edge below byte, byte may be 256
+template <class Key, class KeyTraits>
+typename ArtSet<Key, KeyTraits>::Node*
+ArtSet<Key, KeyTraits>
+::PrevChild(
+        const Inner* node,
+        int byte
+) {
+    switch (node->type) {
+        case NodeType::kNode4: {
+            const Node4* node4 = static_cast<const Node4*>(node);
+            for (size_t i = node4->count; i-- > 0;) {
+                if (node4->keys[i] < byte) {
+                    return node4->children[i];
+                }
+            }
+
+            return nullptr;
+        }
+
+        case NodeType::kNode16: {
+            const Node16* node16 = static_cast<const Node16*>(node);
+            for (size_t i = node16->count; i-- > 0;) {
+                if (node16->keys[i] < byte) {
+                    return node16->children[i];
+                }
+            }
+
+            return nullptr;
+        }
+
+        case NodeType::kNode48: {
+            const Node48* node48 = static_cast<const Node48*>(node);
+            for (int prev = byte - 1; prev >= 0; --prev) {
+                if (node48->slots[prev]) {
+                    return node48->children[node48->slots[prev] - 1];
+                }
+            }
+
+            return nullptr;
+        }
+
+        default: {
+            const Node256* node256 = static_cast<const Node256*>(node);
+            for (int prev = byte - 1; prev >= 0; --prev) {
+                if (node256->children[prev]) {
+                    return node256->children[prev];
+                }
+            }
+
+            return nullptr;
+        }
+    }
+}
+
+//  ref is replaced by a bigger node when the node is full
+template <class Key, class KeyTraits>
+void
+ArtSet<Key, KeyTraits>
+::AddChild(
+        Node*& ref,
+        uint8_t byte,
+        Node* child
+) {
+    Inner* node = static_cast<Inner*>(ref);
+    switch (node->type) {
+        case NodeType::kNode4:
+        case NodeType::kNode16: {
+            bool small = node->type == NodeType::kNode4;
+            if (node->count == (small ? 4 : 16)) {
+                ref = Grow(node);
+                AddChild(ref, byte, child);
+                return;
+            }
+
+            uint8_t* keys = small ? static_cast<Node4*>(node)->keys
+                                  : static_cast<Node16*>(node)->keys;
+            Node** children = small ? static_cast<Node4*>(node)->children
+                                    : static_cast<Node16*>(node)->children;
+            size_t pos = node->count;
+            for (; pos > 0 && keys[pos - 1] > byte; --pos) {
+                keys[pos] = keys[pos - 1];
+                children[pos] = children[pos - 1];
+            }
+
+            keys[pos] = byte;
+            children[pos] = child;
+            break;
+        }
+
+        case NodeType::kNode48: {
+            if (node->count == 48) {
+                ref = Grow(node);
+                AddChild(ref, byte, child);
+                return;
+            }
+
+            Node48* node48 = static_cast<Node48*>(node);
+            size_t pos = 0;
+            while (node48->children[pos]) {
+                ++pos;
+            }
+
+            node48->children[pos] = child;
+            node48->slots[byte] = static_cast<uint8_t>(pos + 1);
+            break;
+        }
+
+        default:
+            static_cast<Node256*>(node)->children[byte] = child;
+            break;
+    }
+
+    ++node->count;
+}
+
+//  ref is replaced by a smaller node, or by its last child, when it empties
+template <class Key, class KeyTraits>
+void
+ArtSet<Key, KeyTraits>
+::RemoveChild(
+        Node*& ref,
+        uint8_t byte
+) {
+    Inner* node = static_cast<Inner*>(ref);
+    size_t shrink_at = 0;
+    switch (node->type) {
+        case NodeType::kNode4:
+        case NodeType::kNode16: {
+            bool small = node->type == NodeType::kNode4;
+            uint8_t* keys = small ? static_cast<Node4*>(node)->keys
+                                  : static_cast<Node16*>(node)->keys;
+            Node** children = small ? static_cast<Node4*>(node)->children
+                                    : static_cast<Node16*>(node)->children;
+            size_t pos = 0;
+            while (keys[pos] != byte) {
+                ++pos;
+            }
+
+            for (; pos + 1 < node->count; ++pos) {
+                keys[pos] = keys[pos + 1];
+                children[pos] = children[pos + 1];
+            }
+
+            shrink_at = small ? 1 : kNode16Shrink;
+            break;
+        }
+
+        case NodeType::kNode48: {
+            Node48* node48 = static_cast<Node48*>(node);
+            node48->children[node48->slots[byte] - 1] = nullptr;
+            node48->slots[byte] = 0;
+            shrink_at = kNode48Shrink;
+            break;
+        }
+
+        default:
+            static_cast<Node256*>(node)->children[byte] = nullptr;
+            shrink_at = kNode256Shrink;
+            break;
+    }
+
+    if (--node->count == shrink_at) {
+        ref = Shrink(node);
+    }
+}
+
+template <class Key, class KeyTraits>
+typename ArtSet<Key, KeyTraits>::Inner*
+ArtSet<Key, KeyTraits>
+::Grow(
+        Inner* node
+) {
+    Inner* grown;
+    switch (node->type) {
+        case NodeType::kNode4: {
+            Node4* node4 = static_cast<Node4*>(node);
+            Node16* node16 = new Node16(std::move(node4->prefix));
+            std::copy(node4->keys, node4->keys + 4, node16->keys);
+            std::copy(node4->children, node4->children + 4, node16->children);
+            grown = node16;
+            break;
+        }
+
+        case NodeType::kNode16: {
+            Node16* node16 = static_cast<Node16*>(node);
+            Node48* node48 = new Node48(std::move(node16->prefix));
+            for (size_t i = 0; i < 16; ++i) {
+                node48->slots[node16->keys[i]] = static_cast<uint8_t>(i + 1);
+                node48->children[i] = node16->children[i];
+            }
+
+            grown = node48;
+            break;
+        }
+
+        default: {
+            Node48* node48 = static_cast<Node48*>(node);
+            Node256* node256 = new Node256(std::move(node48->prefix));
+            for (size_t byte = 0; byte < 256; ++byte) {
+                if (node48->slots[byte]) {
+                    node256->children[byte] = node48->children[node48->slots[byte] - 1];
+                }
+            }
+
+            grown = node256;
+            break;
+        }
+    }
+
+    grown->count = node->count;
+    DestroyNode(node);
+    return grown;
+}
+
+//  Node4 left with one child is merged into it: a leaf takes its place,
+//  an inner child takes the prefix, the edge byte and its own prefix
+template <class Key, class KeyTraits>
+typename ArtSet<Key, KeyTraits>::Node*
+ArtSet<Key, KeyTraits>
+::Shrink(
+        Inner* node
+) {
+    Inner* shrunk;
+    switch (node->type) {
+        case NodeType::kNode4: {
+            Node4* node4 = static_cast<Node4*>(node);
+            Node* child = node4->children[0];
+            if (child->type != NodeType::kLeaf) {
+                Inner* inner = static_cast<Inner*>(child);
+                node4->prefix.push_back(static_cast<char>(node4->keys[0]));
+                node4->prefix.append(inner->prefix);
+                inner->prefix.swap(node4->prefix);
+            }
+
+            DestroyNode(node);
+            return child;
+        }
+
+        case NodeType::kNode16: {
+            Node16* node16 = static_cast<Node16*>(node);
+            Node4* node4 = new Node4(std::move(node16->prefix));
+            std::copy(node16->keys, node16->keys + node16->count, node4->keys);
+            std::copy(node16->children, node16->children + node16->count, node4->children);
+            shrunk = node4;
+            break;
+        }
+
+        case NodeType::kNode48: {
+            Node48* node48 = static_cast<Node48*>(node);
+            Node16* node16 = new Node16(std::move(node48->prefix));
+            size_t pos = 0;
+            for (size_t byte = 0; byte < 256; ++byte) {
+                if (node48->slots[byte]) {
+                    node16->keys[pos] = static_cast<uint8_t>(byte);
+                    node16->children[pos++] = node48->children[node48->slots[byte] - 1];
+                }
+            }
+
+            shrunk = node16;
+            break;
+        }
+
+        default: {
+            Node256* node256 = static_cast<Node256*>(node);
+            Node48* node48 = new Node48(std::move(node256->prefix));
+            size_t pos = 0;
+            for (size_t byte = 0; byte < 256; ++byte) {
+                if (node256->children[byte]) {
+                    node48->children[pos] = node256->children[byte];
+                    node48->slots[byte] = static_cast<uint8_t>(++pos);
+                }
+            }
+
+            shrunk = node48;
+            break;
+        }
+    }
+
+    shrunk->count = node->count;
+    DestroyNode(node);
+    return shrunk;
+}
+
+template <class Key, class KeyTraits>
+typename ArtSet<Key, KeyTraits>::Leaf*
+ArtSet<Key, KeyTraits>
+::Minimum(
+        Node* node
+) {
+    while (node->type != NodeType::kLeaf) {
+        node = NextChild(static_cast<Inner*>(node), -1);
+    }
+
+    return static_cast<Leaf*>(node);
+}
+
+template <class Key, class KeyTraits>
+typename ArtSet<Key, KeyTraits>::Leaf*
+ArtSet<Key, KeyTraits>
+::Maximum(
+        Node* node
+) {
+    while (node->type != NodeType::kLeaf) {
+        node = PrevChild(static_cast<Inner*>(node), 256);
+    }
+
+    return static_cast<Leaf*>(node);
+}
+
+//  Compares node prefix with bytes from depth on. Bytes ending inside
+//  the prefix are less than every key of the node.
+template <class Key, class KeyTraits>
+int
+ArtSet<Key, KeyTraits>
+::ComparePrefix(
+        const Inner* node,
+        const std::string& bytes,
+        size_t depth
+) {
+    size_t common = std::min(node->prefix.size(), bytes.size() - depth);
+    int order = std::memcmp(node->prefix.data(), bytes.data() + depth, common);
+    if (order != 0) {
+        return order;
+    }
+
+    return common < node->prefix.size() ? 1 : 0;
+}
+
+//  Prefixes are skipped unchecked, the leaf reached is compared instead
+template <class Key, class KeyTraits>
+typename ArtSet<Key, KeyTraits>::Leaf*
+ArtSet<Key, KeyTraits>
+::FindLeaf(
+        const Key& key
+) const {
+    std::string bytes;
+    KeyTraits::Encode(key, &bytes);
+
+    Node* node = root_;
+    size_t depth = 0;
+    while (node && node->type != NodeType::kLeaf) {
+        Inner* inner = static_cast<Inner*>(node);
+        depth += inner->prefix.size();
+        if (depth >= bytes.size()) {
+            return nullptr;
+        }
+
+        Node** child = FindChild(inner, static_cast<uint8_t>(bytes[depth++]));
+        node = child ? *child : nullptr;
+    }
+
+    if (!node || !(static_cast<Leaf*>(node)->key == key)) {
+        return nullptr;
+    }
+
+    return static_cast<Leaf*>(node);
+}
+
+//  First leaf not less than key, or greater than key if strict
+template <class Key, class KeyTraits>
+typename ArtSet<Key, KeyTraits>::Leaf*
+ArtSet<Key, KeyTraits>
+::LowerBoundLeaf(
+        Node* node,
+        const std::string& bytes,
+        size_t depth,
+        const Key& key,
+        bool strict
+) const {
+    if (!node) {
+        return nullptr;
+    }
+
+    if (node->type == NodeType::kLeaf) {
+        Leaf* leaf = static_cast<Leaf*>(node);
+        bool fits = strict ? key < leaf->key : !(leaf->key < key);
+        return fits ? leaf : nullptr;
+    }
+
+    Inner* inner = static_cast<Inner*>(node);
+    int order = ComparePrefix(inner, bytes, depth);
+    if (order != 0) {
+        return order > 0 ? Minimum(node) : nullptr;
+    }
+
+    depth += inner->prefix.size();
+    if (depth == bytes.size()) {
+        return Minimum(node);
+    }
+
+    uint8_t byte = static_cast<uint8_t>(bytes[depth]);
+    Node** child = FindChild(inner, byte);
+    if (child) {
+        Leaf* leaf = LowerBoundLeaf(*child, bytes, depth + 1, key, strict);
+        if (leaf) {
+            return leaf;
+        }
+    }
+
+    Node* next = NextChild(inner, byte);
+    return next ? Minimum(next) : nullptr;
+}
+
+//  Last leaf less than key
+template <class Key, class KeyTraits>
+typename ArtSet<Key, KeyTraits>::Leaf*
+ArtSet<Key, KeyTraits>
+::PredecessorLeaf(
+        Node* node,
+        const std::string& bytes,
+        size_t depth,
+        const Key& key
+) const {
+    if (!node) {
+        return nullptr;
+    }
+
+    if (node->type == NodeType::kLeaf) {
+        Leaf* leaf = static_cast<Leaf*>(node);
+        return leaf->key < key ? leaf : nullptr;
+    }
+
+    Inner* inner = static_cast<Inner*>(node);
+    int order = ComparePrefix(inner, bytes, depth);
+    if (order != 0) {
+        return order < 0 ? Maximum(node) : nullptr;
+    }
+
+    depth += inner->prefix.size();
+    if (depth == bytes.size()) {
+        return nullptr;
+    }
+
+    uint8_t byte = static_cast<uint8_t>(bytes[depth]);
+    Node** child = FindChild(inner, byte);
+    if (child) {
+        Leaf* leaf = PredecessorLeaf(*child, bytes, depth + 1, key);
+        if (leaf) {
+            return leaf;
+        }
+    }
+
+    Node* prev = PrevChild(inner, byte);
+    return prev ? Maximum(prev) : nullptr;
+}
+
+template <class Key, class KeyTraits>
+typename ArtSet<Key, KeyTraits>::Leaf*
+ArtSet<Key, KeyTraits>
+::Successor(
+        Leaf* leaf
+) const {
+    std::string bytes;
+    KeyTraits::Encode(leaf->key, &bytes);
+    return LowerBoundLeaf(root_, bytes, 0, leaf->key, true);
+}
+
+template <class Key, class KeyTraits>
+typename ArtSet<Key, KeyTraits>::Leaf*
+ArtSet<Key, KeyTraits>
+::Predecessor(
+        Leaf* leaf
+) const {
+    std::string bytes;
+    KeyTraits::Encode(leaf->key, &bytes);
+    return PredecessorLeaf(root_, bytes, 0, leaf->key);
+}
+
+/*
+ *      Encoded keys are prefix free, so two different keys differ at
+ *      some byte before either of them ends, and bytes never end inside
+ *      a prefix on the path of the key.
+ */
+template <class Key, class KeyTraits>
+bool
+ArtSet<Key, KeyTraits>
+::InsertLeaf(
+        Node*& ref,
+        const std::string& bytes,
+        size_t depth,
+        const Key& key,
+        Leaf** leaf
+) {
+    if (!ref) {
+        ref = *leaf = new Leaf(key);
+        return true;
+    }
+
+    //  Lazy expansion: a leaf is split only when another key reaches it
+    if (ref->type == NodeType::kLeaf) {
+        Leaf* old_leaf = static_cast<Leaf*>(ref);
+        if (old_leaf->key == key) {
+            *leaf = old_leaf;
+            return false;
+        }
+
+        std::string old_bytes;
+        KeyTraits::Encode(old_leaf->key, &old_bytes);
+        size_t mismatch = depth;
+        while (old_bytes[mismatch] == bytes[mismatch]) {
+            ++mismatch;
+        }
+
+        Node* node = new Node4(bytes.substr(depth, mismatch - depth));
+        *leaf = new Leaf(key);
+        AddChild(node, static_cast<uint8_t>(old_bytes[mismatch]), old_leaf);
+        AddChild(node, static_cast<uint8_t>(bytes[mismatch]), *leaf);
+        ref = node;
+        return true;
+    }
+
+    Inner* inner = static_cast<Inner*>(ref);
+    size_t matched = 0;
+    while (matched < inner->prefix.size() && inner->prefix[matched] == bytes[depth + matched]) {
+        ++matched;
+    }
+
+    //  Key leaves the compressed path, split the prefix at the mismatch
+    if (matched < inner->prefix.size()) {
+        Node* node = new Node4(inner->prefix.substr(0, matched));
+        uint8_t old_byte = static_cast<uint8_t>(inner->prefix[matched]);
+        inner->prefix.erase(0, matched + 1);
+        *leaf = new Leaf(key);
+        AddChild(node, old_byte, inner);
+        AddChild(node, static_cast<uint8_t>(bytes[depth + matched]), *leaf);
+        ref = node;
+        return true;
+    }
+
+    depth += inner->prefix.size();
+    uint8_t byte = static_cast<uint8_t>(bytes[depth]);
+    Node** child = FindChild(inner, byte);
+    if (child) {
+        return InsertLeaf(*child, bytes, depth + 1, key, leaf);
+    }
+
+    *leaf = new Leaf(key);
+    AddChild(ref, byte, *leaf);
+    return true;
+}
+
+template <class Key, class KeyTraits>
+bool
+ArtSet<Key, KeyTraits>
+::EraseLeaf(
+        Node*& ref,
+        const std::string& bytes,
+        size_t depth,
+        const Key& key
+) {
+    if (!ref) {
+        return false;
+    }
+
+    if (ref->type == NodeType::kLeaf) {
+        if (!(static_cast<Leaf*>(ref)->key == key)) {
+            return false;
+        }
+
+        DestroyNode(ref);
+        ref = nullptr;
+        return true;
+    }
+
+    Inner* inner = static_cast<Inner*>(ref);
+    if (ComparePrefix(inner, bytes, depth) != 0) {
+        return false;
+    }
+
+    depth += inner->prefix.size();
+    if (depth == bytes.size()) {
+        return false;
+    }
+
+    uint8_t byte = static_cast<uint8_t>(bytes[depth]);
+    Node** child = FindChild(inner, byte);
+    if (!child) {
+        return false;
+    }
+
+    if ((*child)->type != NodeType::kLeaf) {
+        return EraseLeaf(*child, bytes, depth + 1, key);
+    }
+
+    if (!(static_cast<Leaf*>(*child)->key == key)) {
+        return false;
+    }
+
+    DestroyNode(*child);
+    RemoveChild(ref, byte);
+    return true;
+}
+
+template <class Key, class KeyTraits>
+void
+ArtSet<Key, KeyTraits>
+::DestroyNode(
+        Node* node
+) {
+    switch (node->type) {
+        case NodeType::kLeaf:
+            delete static_cast<Leaf*>(node);
+            break;
+
+        case NodeType::kNode4:
+            delete static_cast<Node4*>(node);
+            break;
+
+        case NodeType::kNode16:
+            delete static_cast<Node16*>(node);
+            break;
+
+        case NodeType::kNode48:
+            delete static_cast<Node48*>(node);
+            break;
+
+        case NodeType::kNode256:
+            delete static_cast<Node256*>(node);
+            break;
+    }
+}
+
+template <class Key, class KeyTraits>
+template <class Visitor>
+void
+ArtSet<Key, KeyTraits>
+::ForEachChild(
+        Inner* node,
+        Visitor visit
+) {
+    switch (node->type) {
+        case NodeType::kNode4:
+            std::for_each(static_cast<Node4*>(node)->children,
+                          static_cast<Node4*>(node)->children + node->count, visit);
+            break;
+
+        case NodeType::kNode16:
+            std::for_each(static_cast<Node16*>(node)->children,
+                          static_cast<Node16*>(node)->children + node->count, visit);
+            break;
+
+        case NodeType::kNode48:
+            for (Node*& child : static_cast<Node48*>(node)->children) {
+                if (child) {
+                    visit(child);
+                }
+            }
+            break;
+
+        default:
+            for (Node*& child : static_cast<Node256*>(node)->children) {
+                if (child) {
+                    visit(child);
+                }
+            }
+            break;
+    }
+}
+
+template <class Key, class KeyTraits>
+void
+ArtSet<Key, KeyTraits>
+::DeleteSubtree(
+        Node* node
+) {
+    if (node->type != NodeType::kLeaf) {
+        ForEachChild(static_cast<Inner*>(node), [](Node*& child) {
+            DeleteSubtree(child);
+        });
+    }
+
+    DestroyNode(node);
+}
+
+//  Copies the node with its child pointers, then replaces them by copies
+template <class Key, class KeyTraits>
+typename ArtSet<Key, KeyTraits>::Node*
+ArtSet<Key, KeyTraits>
+::CloneSubtree(
+        const Node* node
+) {
+    Inner* copy;
+    switch (node->type) {
+        case NodeType::kLeaf:
+            return new Leaf(*static_cast<const Leaf*>(node));
+
+        case NodeType::kNode4:
+            copy = new Node4(*static_cast<const Node4*>(node));
+            break;
+
+        case NodeType::kNode16:
+            copy = new Node16(*static_cast<const Node16*>(node));
+            break;
+
+        case NodeType::kNode48:
+            copy = new Node48(*static_cast<const Node48*>(node));
+            break;
+
+        default:
+            copy = new Node256(*static_cast<const Node256*>(node));
+            break;
+    }
+
+    ForEachChild(copy, [](Node*& child) {
+        child = CloneSubtree(child);
+    });
+    return copy;
+}
+
+/*
+ *
+ *      Iterator implementation
+ *
+ */
+
+template <class Key, class KeyTraits>
+typename ArtSet<Key, KeyTraits>::iterator
+ArtSet<Key, KeyTraits>
+::begin() const {
+    return iterator(root_ ? Minimum(root_) : nullptr, this);
+}
+
+template <class Key, class KeyTraits>
+typename ArtSet<Key, KeyTraits>::iterator
+ArtSet<Key, KeyTraits>
+::end() const {
+    return iterator(nullptr, this);
+}
+
+template <class Key, class KeyTraits>
+ArtSet<Key, KeyTraits>::iterator
+::iterator(
+        Leaf* leaf,
+        const ArtSet* set
+):
+        leaf_{leaf},
+        set_{set}
+{}
+
+template <class Key, class KeyTraits>
+typename ArtSet<Key, KeyTraits>::iterator&
+ArtSet<Key, KeyTraits>::iterator
+::operator++() {
+    leaf_ = set_->Successor(leaf_);
+    return *this;
+}
+
+template <class Key, class KeyTraits>
+typename ArtSet<Key, KeyTraits>::iterator
+ArtSet<Key, KeyTraits>::iterator
+::operator++(int dummy) {
+    iterator cpy(*this);
+    this->operator++();
+    return cpy;
+}
+
+template <class Key, class KeyTraits>
+typename ArtSet<Key, KeyTraits>::iterator&
+ArtSet<Key, KeyTraits>::iterator
+::operator--() {
+    leaf_ = leaf_ ? set_->Predecessor(leaf_) : Maximum(set_->root_);
+    return *this;
+}
+
+template <class Key, class KeyTraits>
+typename ArtSet<Key, KeyTraits>::iterator
+ArtSet<Key, KeyTraits>::iterator
+::operator--(int dummy) {
+    iterator cpy(*this);
+    this->operator--();
+    return cpy;
+}
+
+template <class Key, class KeyTraits>
+const Key&
+ArtSet<Key, KeyTraits>::iterator
+::operator*() {
+    return leaf_->key;
+}
+
+template <class Key, class KeyTraits>
+const Key*
+ArtSet<Key, KeyTraits>::iterator
+::operator->() {
+    return &(leaf_->key);
+}
+
+template <class Key, class KeyTraits>
+bool
+ArtSet<Key, KeyTraits>::iterator
+::operator==(
+        const iterator& rhs
+) const {
+    return leaf_ == rhs.leaf_;
+}
+
+template <class Key, class KeyTraits>
+bool
+ArtSet<Key, KeyTraits>::iterator
+::operator!=(
+        const iterator& rhs
+) const {
+    return !(*this == rhs);
+}
+
+/*
+ *
+ *      Node implementation
+ *
+ */
+
+template <class Key, class KeyTraits>
+ArtSet<Key, KeyTraits>::Node
+::Node(
+        NodeType type
+):
+        type{type}
+{}
+
+template <class Key, class KeyTraits>
+ArtSet<Key, KeyTraits>::Leaf
+::Leaf(
+        const Key& key
+):
+        Node(NodeType::kLeaf),
+        key(key)
+{}
+
+template <class Key, class KeyTraits>
+ArtSet<Key, KeyTraits>::Inner
+::Inner(
+        NodeType type,
+        std::string prefix
+):
+        Node(type),
+        count{0},
+        prefix(std::move(prefix))
+{}
+
+template <class Key, class KeyTraits>
+ArtSet<Key, KeyTraits>::Node4
+::Node4(
+        std::string prefix
+):
+        Inner(NodeType::kNode4, std::move(prefix)),
+        keys{},
+        children{}
+{}
+
+template <class Key, class KeyTraits>
+ArtSet<Key, KeyTraits>::Node16
+::Node16(
+        std::string prefix
+):
+        Inner(NodeType::kNode16, std::move(prefix)),
+        keys{},
+        children{}
+{}
+
+template <class Key, class KeyTraits>
+ArtSet<Key, KeyTraits>::Node48
+::Node48(
+        std::string prefix
+):
+        Inner(NodeType::kNode48, std::move(prefix)),
+        slots{},
+        children{}
+{}
+
+template <class Key, class KeyTraits>
+ArtSet<Key, KeyTraits>::Node256
+::Node256(
+        std::string prefix
+):
+        Inner(NodeType::kNode256, std::move(prefix)),
+        children{}
+{}
+
+#endif //DATA_STRUCTURES_ART_H
@@ -0,0 +1,125 @@
+//
+// Created by alexaxnder on 19.10.26.
+//
+
+//  ArtSet against Set and HashMap on 64-bit and URL-like keys
+//
+//      g++ -std=c++11 -O2 art_bench.cpp -o art_bench
+//      ./art_bench [keys]
+//
+//  Keys are inserted in random order, then every key is found in
+//  another random order, then lower_bound is asked for as many random
+//  keys (HashMap has no order, so it has no lower_bound column).
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "../art.h"
+#include "../hash_map.h"
+#include "../rbtree.h"
+
+
+template <class Function>
+double Milliseconds(Function function) {
+    auto start = std::chrono::steady_clock::now();
+    function();
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+
+template <class Key>
+void Run(const char* name, std::vector<Key> keys, const std::vector<Key>& queries) {
+    ArtSet<Key> art;
+    Set<Key> set;
+    HashMap<Key, bool> hash_map;
+
+    double art_insert = Milliseconds([&]() {
+        for (const Key& key : keys) {
+            art.insert(key);
+        }
+    });
+    double set_insert = Milliseconds([&]() {
+        for (const Key& key : keys) {
+            set.insert(key);
+        }
+    });
+    double hash_insert = Milliseconds([&]() {
+        for (const Key& key : keys) {
+            hash_map[key] = true;
+        }
+    });
+
+    std::shuffle(keys.begin(), keys.end(), std::mt19937(1));
+    size_t found = 0;
+    double art_find = Milliseconds([&]() {
+        for (const Key& key : keys) {
+            found += art.find(key) != art.end();
+        }
+    });
+    double set_find = Milliseconds([&]() {
+        for (const Key& key : keys) {
+            found += set.find(key) != set.end();
+        }
+    });
+    double hash_find = Milliseconds([&]() {
+        for (const Key& key : keys) {
+            found += hash_map.find(key) != hash_map.end();
+        }
+    });
+
+    size_t bounded = 0;
+    double art_bound = Milliseconds([&]() {
+        for (const Key& key : queries) {
+            bounded += art.lower_bound(key) != art.end();
+        }
+    });
+    double set_bound = Milliseconds([&]() {
+        for (const Key& key : queries) {
+            bounded += set.lower_bound(key) != set.end();
+        }
+    });
+
+    printf("%s, %zu keys (found %zu of %zu, bounded %zu of %zu)\n",
+           name, art.size(), found, 3 * keys.size(), bounded, 2 * queries.size());
+    printf("    %-8s %10s %10s %12s\n", "", "insert ms", "find ms", "lower_b ms");
+    printf("    %-8s %10.0f %10.0f %12.0f\n", "ArtSet", art_insert, art_find, art_bound);
+    printf("    %-8s %10.0f %10.0f %12.0f\n", "Set", set_insert, set_find, set_bound);
+    printf("    %-8s %10.0f %10.0f %12s\n", "HashMap", hash_insert, hash_find, "-");
+}
+
+
+//  Few hosts and paths with numeric ids, so keys share long prefixes
+std::string UrlKey(std::mt19937_64& gen) {
+    return "https://shop" + std::to_string(gen() % 16) + ".example.com/catalog/" +
+           std::to_string(gen() % 1000) + "/item/" + std::to_string(gen() % 1000000);
+}
+
+
+int main(int argc, char** argv) {
+    size_t keys_number = argc > 1 ? strtoul(argv[1], nullptr, 10) : 1000000;
+    std::mt19937_64 gen(7);
+
+    std::vector<uint64_t> ints(keys_number);
+    std::vector<uint64_t> int_queries(keys_number);
+    for (size_t i = 0; i < keys_number; ++i) {
+        ints[i] = gen();
+        int_queries[i] = gen();
+    }
+    Run("uint64_t", ints, int_queries);
+
+    std::vector<std::string> urls(keys_number);
+    std::vector<std::string> url_queries(keys_number);
+    for (size_t i = 0; i < keys_number; ++i) {
+        urls[i] = UrlKey(gen);
+        url_queries[i] = UrlKey(gen);
+    }
+    Run("URL", urls, url_queries);
+
+    return 0;
+}
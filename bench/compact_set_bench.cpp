@@ -0,0 +1,123 @@
+//
+// Created by alexaxnder on 19.10.26.
+//
+
+//  CompactSet against Set on uint32_t keys: insert, find, iteration
+//
+//      g++ -std=c++11 -O2 compact_set_bench.cpp -o compact_set_bench
+//      ./compact_set_bench [keys ...]
+//
+//  Default sizes are 1M and 10M keys. 100M keys need about 6 GB for
+//  the Set and 2 GB for the CompactSet. Keys are inserted in random
+//  order and found in another one. Memory is the bytes asked from
+//  operator new, so it counts vector slack but not malloc overhead.
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+#include <random>
+#include <vector>
+
+#include "../rbtree.h"
+
+
+size_t allocated_bytes = 0;
+
+//  Size is kept in front of every block so delete can subtract it
+void* operator new(size_t size) {
+    size_t* block = static_cast<size_t*>(malloc(size + sizeof(max_align_t)));
+    if (!block) {
+        throw std::bad_alloc();
+    }
+
+    *block = size;
+    allocated_bytes += size;
+    return reinterpret_cast<char*>(block) + sizeof(max_align_t);
+}
+
+void operator delete(void* ptr) noexcept {
+    if (!ptr) {
+        return;
+    }
+
+    size_t* block = reinterpret_cast<size_t*>(static_cast<char*>(ptr) - sizeof(max_align_t));
+    allocated_bytes -= *block;
+    free(block);
+}
+
+void operator delete(void* ptr, size_t) noexcept {
+    operator delete(ptr);
+}
+
+
+template <class Function>
+double Milliseconds(Function function) {
+    auto start = std::chrono::steady_clock::now();
+    function();
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+
+template <class Container>
+void Run(const char* name, const std::vector<uint32_t>& keys, const std::vector<uint32_t>& queries) {
+    size_t base_bytes = allocated_bytes;
+    Container container;
+    double insert = Milliseconds([&]() {
+        for (uint32_t key : keys) {
+            container.insert(key);
+        }
+    });
+    size_t bytes = allocated_bytes - base_bytes;
+
+    size_t found = 0;
+    double find = Milliseconds([&]() {
+        for (uint32_t key : queries) {
+            found += container.find(key) != container.end();
+        }
+    });
+
+    uint64_t sum = 0;
+    double iterate = Milliseconds([&]() {
+        for (uint32_t key : container) {
+            sum += key;
+        }
+    });
+
+    printf("    %-11s %10.0f %10.0f %10.0f %10.1f %8.1f   (found %zu, sum %llu)\n",
+           name, insert, find, iterate, bytes / 1048576.0,
+           static_cast<double>(bytes) / container.size(),
+           found, static_cast<unsigned long long>(sum));
+}
+
+
+int main(int argc, char** argv) {
+    std::vector<size_t> sizes;
+    for (int i = 1; i < argc; ++i) {
+        sizes.push_back(strtoul(argv[i], nullptr, 10));
+    }
+    if (sizes.empty()) {
+        sizes = {1000000, 10000000};
+    }
+
+    for (size_t keys_number : sizes) {
+        std::mt19937 gen(keys_number);
+        std::vector<uint32_t> keys(keys_number);
+        for (uint32_t& key : keys) {
+            key = gen();
+        }
+
+        std::vector<uint32_t> queries = keys;
+        std::shuffle(queries.begin(), queries.end(), gen);
+
+        printf("%zu keys\n", keys_number);
+        printf("    %-11s %10s %10s %10s %10s %8s\n",
+               "", "insert ms", "find ms", "iter ms", "MB", "B/key");
+        Run<Set<uint32_t>>("Set", keys, queries);
+        Run<CompactSet<uint32_t>>("CompactSet", keys, queries);
+    }
+
+    return 0;
+}
@@ -0,0 +1,148 @@
+//
+// Created by alexaxnder on 19.10.26.
+//
+
+//  EliasFanoSet against Set<uint64_t>: space and query time
+//
+//      g++ -std=c++11 -O2 elias_fano_bench.cpp -o elias_fano_bench
+//      ./elias_fano_bench [values] [universe bits]
+//
+//  Set memory is what its allocator was asked for, malloc overhead
+//  comes on top. Queries are random values of the same universe, finds
+//  of present values in random order, and a full iteration. The set is
+//  also saved to a temporary file and mapped back.
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <string>
+#include <vector>
+#include <unistd.h>
+
+#include "../elias_fano_set.h"
+#include "../rbtree.h"
+
+
+size_t allocated_bytes = 0;
+
+//  std::allocator that counts the bytes it hands out
+template <class T>
+struct CountingAllocator: std::allocator<T> {
+    template <class U>
+    struct rebind {
+        typedef CountingAllocator<U> other;
+    };
+
+    CountingAllocator() = default;
+
+    template <class U>
+    CountingAllocator(const CountingAllocator<U>&) {}
+
+    T* allocate(size_t n) {
+        allocated_bytes += n * sizeof(T);
+        return std::allocator<T>::allocate(n);
+    }
+
+    void deallocate(T* ptr, size_t n) {
+        allocated_bytes -= n * sizeof(T);
+        std::allocator<T>::deallocate(ptr, n);
+    }
+};
+
+
+template <class Function>
+double Milliseconds(Function function) {
+    auto start = std::chrono::steady_clock::now();
+    function();
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+
+template <class Container>
+void Queries(const char* name, const Container& container,
+             const std::vector<uint64_t>& present, const std::vector<uint64_t>& random) {
+    uint64_t checksum = 0;
+    double find = Milliseconds([&]() {
+        for (uint64_t value : present) {
+            checksum += container.find(value) != container.end();
+        }
+    });
+    double bound = Milliseconds([&]() {
+        for (uint64_t value : random) {
+            auto it = container.lower_bound(value);
+            checksum += it != container.end() ? *it : 0;
+        }
+    });
+    double iterate = Milliseconds([&]() {
+        for (uint64_t value : container) {
+            checksum += value;
+        }
+    });
+
+    printf("    %-14s %10.0f %12.0f %10.0f   (checksum %llu)\n",
+           name, find, bound, iterate, static_cast<unsigned long long>(checksum));
+}
+
+
+int main(int argc, char** argv) {
+    size_t values_number = argc > 1 ? strtoul(argv[1], nullptr, 10) : 2000000;
+    size_t universe_bits = argc > 2 ? strtoul(argv[2], nullptr, 10) : 40;
+    std::mt19937_64 gen(1);
+
+    std::vector<uint64_t> values(values_number);
+    for (uint64_t& value : values) {
+        value = gen() >> (64 - universe_bits);
+    }
+    std::sort(values.begin(), values.end());
+    values.erase(std::unique(values.begin(), values.end()), values.end());
+
+    Set<uint64_t, CountingAllocator<uint64_t>> set;
+    set = Set<uint64_t, CountingAllocator<uint64_t>>::from_sorted(values.begin(), values.end());
+    size_t set_bytes = allocated_bytes;
+
+    EliasFanoSet elias_fano;
+    double build = Milliseconds([&]() {
+        elias_fano = EliasFanoSet(set.begin(), set.end());
+    });
+
+    std::vector<uint64_t> present = values;
+    std::shuffle(present.begin(), present.end(), std::mt19937(2));
+    std::vector<uint64_t> random(values.size());
+    for (uint64_t& value : random) {
+        value = gen() >> (64 - universe_bits);
+    }
+
+    double n = static_cast<double>(values.size());
+    double bound_bits = 2 + std::log2(std::ldexp(1.0, static_cast<int>(universe_bits)) / n);
+    printf("%zu values of %zu bits, built in %.0f ms\n", values.size(), universe_bits, build);
+    printf("    EliasFanoSet %12zu bytes, %6.2f bits per value (2 + log2(U/n) = %.2f)\n",
+           elias_fano.bytes(), 8 * elias_fano.bytes() / n, bound_bits);
+    printf("    Set          %12zu bytes, %6.2f bits per value\n", set_bytes, 8 * set_bytes / n);
+
+    printf("    %-14s %10s %12s %10s\n", "", "find ms", "lower_b ms", "iter ms");
+    Queries("Set", set, present, random);
+    Queries("EliasFanoSet", elias_fano, present, random);
+
+    char path[] = "/tmp/elias_fano_bench_XXXXXX";
+    int fd = mkstemp(path);
+    if (fd < 0) {
+        perror("Can't create temporary file");
+        return EXIT_FAILURE;
+    }
+    close(fd);
+
+    elias_fano.save(path);
+    EliasFanoSet loaded;
+    double load = Milliseconds([&]() {
+        loaded = EliasFanoSet::load(path);
+    });
+    printf("    mapped back in %.2f ms\n", load);
+    Queries("mapped", loaded, present, random);
+    unlink(path);
+
+    return 0;
+}
@@ -0,0 +1,108 @@
+//
+// Created by alexaxnder on 19.10.26.
+//
+
+//  ExternalHeap throughput on a workload several times its memory budget
+//
+//      g++ -std=c++11 -O2 -pthread external_heap_bench.cpp -o external_heap_bench
+//      ./external_heap_bench [data / budget] [budget MB] [block KB]
+//
+//  Defaults are 10x a 32 MB budget with 1 MB blocks. Random uint64_t
+//  items are inserted and then all extracted, extraction order is
+//  checked. Runs go to std::tmpfile() files, usually under /tmp. Bytes
+//  written are taken from /proc/self/io where it exists.
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <sys/resource.h>
+
+#include "../external_heap.h"
+
+
+//  Bytes passed to write calls so far, 0 if the system does not tell
+unsigned long long WrittenBytes() {
+    std::ifstream io("/proc/self/io");
+    std::string name;
+    unsigned long long value;
+    while (io >> name >> value) {
+        if (name == "wchar:") {
+            return value;
+        }
+    }
+
+    return 0;
+}
+
+
+long MaxRssKb() {
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_maxrss;
+}
+
+
+template <class Function>
+double Seconds(Function function) {
+    auto start = std::chrono::steady_clock::now();
+    function();
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+
+bool Run(size_t multiple, size_t budget, size_t block) {
+    size_t items = multiple * budget / sizeof(uint64_t);
+
+    ExternalHeap<uint64_t> heap(budget, block);
+    std::mt19937_64 gen(1);
+    unsigned long long written_before = WrittenBytes();
+
+    double insert = Seconds([&]() {
+        for (size_t i = 0; i < items; ++i) {
+            heap.Insert(gen());
+        }
+    });
+    size_t runs = heap.RunsNumber();
+
+    bool sorted = true;
+    double extract = Seconds([&]() {
+        uint64_t prev = 0;
+        for (size_t i = 0; i < items; ++i) {
+            uint64_t item = heap.ExtractHead();
+            sorted = sorted && prev <= item;
+            prev = item;
+        }
+    });
+
+    double data_mb = items * sizeof(uint64_t) / 1048576.0;
+    unsigned long long written = WrittenBytes() - written_before;
+    printf("%zu items, %.0f MB = %zux the %zu MB budget, %zu KB blocks, %zu runs after insert\n",
+           items, data_mb, multiple, budget >> 20, block >> 10, runs);
+    printf("    insert  %6.2f s  %6.2f M items/s  %7.1f MB/s\n",
+           insert, items / insert / 1e6, data_mb / insert);
+    printf("    extract %6.2f s  %6.2f M items/s  %7.1f MB/s\n",
+           extract, items / extract / 1e6, data_mb / extract);
+    printf("    written %.1fx the data, max RSS %ld MB, order %s\n",
+           written / 1048576.0 / data_mb, MaxRssKb() >> 10, sorted ? "ok" : "BROKEN");
+
+    return sorted;
+}
+
+
+int main(int argc, char** argv) {
+    size_t multiple = argc > 1 ? strtoul(argv[1], nullptr, 10) : 10;
+    size_t budget = (argc > 2 ? strtoul(argv[2], nullptr, 10) : 32) << 20;
+    size_t block = (argc > 3 ? strtoul(argv[3], nullptr, 10) : 1024) << 10;
+
+    try {
+        return Run(multiple, budget, block) ? 0 : 1;
+    } catch (const std::exception& e) {
+        fprintf(stderr, "%s\n", e.what());
+        return 1;
+    }
+}
@@ -0,0 +1,115 @@
+//
+// Created by alexaxnder on 19.10.26.
+//
+
+//  FrozenSet against Set and std::lower_bound on a sorted vector
+//
+//      g++ -std=c++11 -O2 frozen_set_bench.cpp -o frozen_set_bench
+//      ./frozen_set_bench [queries] [max keys]
+//
+//  For sizes from 2^10 keys up to max keys, lower_bound of random
+//  uint32_t keys in nanoseconds per query, one by one and through
+//  lower_bound_batch, then a full sorted iteration in milliseconds.
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <iterator>
+#include <random>
+#include <vector>
+
+#include "../rbtree.h"
+
+
+template <class Function>
+double Milliseconds(Function function) {
+    auto start = std::chrono::steady_clock::now();
+    function();
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+
+void Run(size_t keys_number, const std::vector<uint32_t>& queries, std::mt19937& gen) {
+    Set<uint32_t> set;
+    while (set.size() < keys_number) {
+        set.insert(gen());
+    }
+
+    FrozenSet<uint32_t, std::less<uint32_t>, RBIdentity<uint32_t>> frozen = set.freeze();
+    std::vector<uint32_t> sorted(set.begin(), set.end());
+
+    uint64_t checksum = 0;
+    double set_bound = Milliseconds([&]() {
+        for (uint32_t key : queries) {
+            auto it = set.lower_bound(key);
+            checksum += it != set.end() ? *it : 0;
+        }
+    });
+    double vector_bound = Milliseconds([&]() {
+        for (uint32_t key : queries) {
+            auto it = std::lower_bound(sorted.begin(), sorted.end(), key);
+            checksum += it != sorted.end() ? *it : 0;
+        }
+    });
+    double frozen_bound = Milliseconds([&]() {
+        for (uint32_t key : queries) {
+            auto it = frozen.lower_bound(key);
+            checksum += it != frozen.end() ? *it : 0;
+        }
+    });
+
+    std::vector<decltype(frozen.end())> found;
+    found.reserve(queries.size());
+    double batch_bound = Milliseconds([&]() {
+        frozen.lower_bound_batch(queries.begin(), queries.end(), std::back_inserter(found));
+        for (auto it : found) {
+            checksum += it != frozen.end() ? *it : 0;
+        }
+    });
+
+    double set_iterate = Milliseconds([&]() {
+        for (uint32_t key : set) {
+            checksum += key;
+        }
+    });
+    double vector_iterate = Milliseconds([&]() {
+        for (uint32_t key : sorted) {
+            checksum += key;
+        }
+    });
+    double frozen_iterate = Milliseconds([&]() {
+        for (uint32_t key : frozen) {
+            checksum += key;
+        }
+    });
+
+    double per_query = 1e6 / queries.size();
+    printf("%10zu %8.1f %8.1f %8.1f %8.1f   %8.1f %8.1f %8.1f   (checksum %llu)\n",
+           keys_number, set_bound * per_query, vector_bound * per_query,
+           frozen_bound * per_query, batch_bound * per_query,
+           set_iterate, vector_iterate, frozen_iterate,
+           static_cast<unsigned long long>(checksum));
+}
+
+
+int main(int argc, char** argv) {
+    size_t queries_number = argc > 1 ? strtoul(argv[1], nullptr, 10) : 4000000;
+    size_t max_keys = argc > 2 ? strtoul(argv[2], nullptr, 10) : 1 << 23;
+    std::mt19937 gen(1);
+
+    std::vector<uint32_t> queries(queries_number);
+    for (uint32_t& key : queries) {
+        key = gen();
+    }
+
+    printf("%10s %35s   %26s\n", "", "lower_bound ns/query", "iteration ms");
+    printf("%10s %8s %8s %8s %8s   %8s %8s %8s\n",
+           "keys", "Set", "vector", "Frozen", "batch", "Set", "vector", "Frozen");
+    for (size_t keys_number = 1 << 10; keys_number <= max_keys; keys_number *= 8) {
+        Run(keys_number, queries, gen);
+    }
+
+    return 0;
+}
@@ -0,0 +1,655 @@
+//
+// Created by alexaxnder on 19.10.26.
+//
+
+#ifndef DATA_STRUCTURES_BITMAP_SET_H
+#define DATA_STRUCTURES_BITMAP_SET_H
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <initializer_list>
+#include <iterator>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+
+//  Bit scans of a nonzero word, tzcnt / lzcnt / popcnt where available
+inline size_t BitmapLowestBit(uint64_t word) {
+#if defined(__GNUC__)
+    return static_cast<size_t>(__builtin_ctzll(word));
+#else
+    size_t bit = 0;
+    while (!(word & 1)) {
+        word >>= 1;
+        ++bit;
+    }
+
+    return bit;
+#endif
+}
+
+inline size_t BitmapHighestBit(uint64_t word) {
+#if defined(__GNUC__)
+    return 63 - static_cast<size_t>(__builtin_clzll(word));
+#else
+    size_t bit = 63;
+    while (!(word >> bit)) {
+        --bit;
+    }
+
+    return bit;
+#endif
+}
+
+inline size_t BitmapPopCount(uint64_t word) {
+#if defined(__GNUC__)
+    return static_cast<size_t>(__builtin_popcountll(word));
+#else
+    size_t count = 0;
+    for (; word; word &= word - 1) {
+        ++count;
+    }
+
+    return count;
+#endif
+}
+
+
+/*
+ *      Hierarchical bitmap set of integers below a universe bound
+ *
+ *      Level 0 has one bit per value, bit i of a word on level l + 1
+ *      tells whether word i of level l is nonzero. The top level is a
+ *      single word, so with 64-way fan-out 2^32 values need 6 levels
+ *      and every query is a few word scans per level. Memory is about
+ *      universe / 8 bytes whatever the number of values.
+ *
+ *      Inserting a value past the universe doubles it.
+ *      Bulk operations run over plain word arrays, which compilers
+ *      vectorize, then rebuild the summaries.
+ */
+template <class ValueType = uint32_t>
+class BitmapSet {
+    static_assert(std::is_unsigned<ValueType>::value, "BitmapSet keeps unsigned integers");
+
+public:
+    class iterator:
+            public std::iterator<std::bidirectional_iterator_tag, const ValueType> {
+    public:
+        iterator(): value_{0}, end_{true}, set_{nullptr} {};
+        iterator(ValueType value, bool end, const BitmapSet* set);
+
+        iterator& operator++();
+        iterator operator++(int);
+
+        iterator& operator--();
+        iterator operator--(int);
+
+        const ValueType& operator*();
+        const ValueType* operator->();
+
+        bool operator==(const iterator& rhs) const;
+        bool operator!=(const iterator& rhs) const;
+
+    private:
+        ValueType value_;
+        bool end_;
+        const BitmapSet* set_;
+    };
+
+    iterator begin() const;
+    iterator end() const;
+
+    explicit BitmapSet(uint64_t universe = 0);
+
+    template <class InputIterator>
+    BitmapSet(InputIterator first, InputIterator last);
+
+    BitmapSet(std::initializer_list<ValueType> list);
+
+    std::pair<iterator, bool> insert(ValueType value);
+    void erase(ValueType value);
+    iterator find(ValueType value) const;
+    iterator lower_bound(ValueType value) const;
+    bool contains(ValueType value) const;
+
+    size_t size() const;
+    bool empty() const;
+    void clear();
+    void swap(BitmapSet& rhs) noexcept;
+
+    //  Values below universe() take no reallocation
+    uint64_t universe() const;
+
+    //  O(universe / 64) word operations, rhs is left intact
+    void unite(const BitmapSet& rhs);
+    void intersect(const BitmapSet& rhs);
+    void subtract(const BitmapSet& rhs);
+    size_t intersection_size(const BitmapSet& rhs) const;
+
+    //  Calls visit for every value in [lo, hi) in order,
+    //  empty regions are skipped through the summaries
+    template <class Visitor>
+    void for_each_in_range(uint64_t lo, uint64_t hi, Visitor visit) const;
+
+private:
+    static constexpr size_t kWordBits = 64;
+    static constexpr size_t kWordShift = 6;
+
+    void Grow(uint64_t universe);
+    void BuildSummaries();
+    size_t CountLeaves() const;
+
+    bool NextValue(uint64_t from, uint64_t* value) const;
+    bool PrevValue(uint64_t from, uint64_t* value) const;
+
+    //  levels_[0] are the value bits, levels_.back() is one word
+    std::vector<std::vector<uint64_t>> levels_;
+    size_t size_;
+};
+
+
+/*
+ *
+ *      BitmapSet implementation
+ *
+ */
+
+template <class ValueType>
+BitmapSet<ValueType>
+::BitmapSet(
+        uint64_t universe
+):
+        size_{0}
+{
+    Grow(std::max(universe, uint64_t(kWordBits)));
+}
+
+template <class ValueType>
+template <class InputIterator>
+BitmapSet<ValueType>
+::BitmapSet(
+        InputIterator first,
+        InputIterator last
+):
+        BitmapSet()
+{
+    for (; first != last; ++first) {
+        insert(*first);
+    }
+}
+
+template <class ValueType>
+BitmapSet<ValueType>
+::BitmapSet(
+        std::initializer_list<ValueType> list
+):
+        BitmapSet(list.begin(), list.end())
+{}
+
+template <class ValueType>
+std::pair<typename BitmapSet<ValueType>::iterator, bool>
+BitmapSet<ValueType>
+::insert(
+        ValueType value
+) {
+    if (value >= universe()) {
+        Grow(std::max<uint64_t>(uint64_t(value) + 1, universe() * 2));
+    }
+
+    uint64_t pos = value;
+    for (size_t level = 0; level < levels_.size(); ++level) {
+        uint64_t& word = levels_[level][pos >> kWordShift];
+        uint64_t bit = uint64_t(1) << (pos & (kWordBits - 1));
+        if (word & bit) {
+            return {iterator(value, false, this), false};
+        }
+
+        bool was_empty = word == 0;
+        word |= bit;
+        if (!was_empty) {
+            break;
+        }
+
+        pos >>= kWordShift;
+    }
+
+    ++size_;
+    return {iterator(value, false, this), true};
+}
+
+template <class ValueType>
+void
+BitmapSet<ValueType>
+::erase(
+        ValueType value
+) {
+    if (!contains(value)) {
+        return;
+    }
+
+    uint64_t pos = value;
+    for (size_t level = 0; level < levels_.size(); ++level) {
+        uint64_t& word = levels_[level][pos >> kWordShift];
+        word &= ~(uint64_t(1) << (pos & (kWordBits - 1)));
+        if (word != 0) {
+            break;
+        }
+
+        pos >>= kWordShift;
+    }
+
+    --size_;
+}
+
+template <class ValueType>
+typename BitmapSet<ValueType>::iterator
+BitmapSet<ValueType>
+::find(
+        ValueType value
+) const {
+    if (!contains(value)) {
+        return end();
+    }
+
+    return iterator(value, false, this);
+}
+
+template <class ValueType>
+typename BitmapSet<ValueType>::iterator
+BitmapSet<ValueType>
+::lower_bound(
+        ValueType value
+) const {
+    uint64_t found;
+    if (!NextValue(value, &found)) {
+        return end();
+    }
+
+    return iterator(static_cast<ValueType>(found), false, this);
+}
+
+template <class ValueType>
+bool
+BitmapSet<ValueType>
+::contains(
+        ValueType value
+) const {
+    if (value >= universe()) {
+        return false;
+    }
+
+    return (levels_[0][value >> kWordShift] >> (value & (kWordBits - 1))) & 1;
+}
+
+template <class ValueType>
+size_t
+BitmapSet<ValueType>
+::size() const {
+    return size_;
+}
+
+template <class ValueType>
+bool
+BitmapSet<ValueType>
+::empty() const {
+    return size_ == 0;
+}
+
+template <class ValueType>
+void
+BitmapSet<ValueType>
+::clear() {
+    for (std::vector<uint64_t>& words : levels_) {
+        std::fill(words.begin(), words.end(), 0);
+    }
+
+    size_ = 0;
+}
+
+template <class ValueType>
+void
+BitmapSet<ValueType>
+::swap(
+        BitmapSet& rhs
+) noexcept {
+    levels_.swap(rhs.levels_);
+    std::swap(size_, rhs.size_);
+}
+
+template <class ValueType>
+uint64_t
+BitmapSet<ValueType>
+::universe() const {
+    return uint64_t(levels_[0].size()) << kWordShift;
+}
+
+template <class ValueType>
+void
+BitmapSet<ValueType>
+::unite(
+        const BitmapSet& rhs
+) {
+    if (rhs.universe() > universe()) {
+        Grow(rhs.universe());
+    }
+
+    uint64_t* words = levels_[0].data();
+    const uint64_t* rhs_words = rhs.levels_[0].data();
+    for (size_t i = 0, count = rhs.levels_[0].size(); i < count; ++i) {
+        words[i] |= rhs_words[i];
+    }
+
+    BuildSummaries();
+    size_ = CountLeaves();
+}
+
+template <class ValueType>
+void
+BitmapSet<ValueType>
+::intersect(
+        const BitmapSet& rhs
+) {
+    uint64_t* words = levels_[0].data();
+    const uint64_t* rhs_words = rhs.levels_[0].data();
+    size_t common = std::min(levels_[0].size(), rhs.levels_[0].size());
+    for (size_t i = 0; i < common; ++i) {
+        words[i] &= rhs_words[i];
+    }
+
+    std::fill(levels_[0].begin() + common, levels_[0].end(), 0);
+
+    BuildSummaries();
+    size_ = CountLeaves();
+}
+
+template <class ValueType>
+void
+BitmapSet<ValueType>
+::subtract(
+        const BitmapSet& rhs
+) {
+    uint64_t* words = levels_[0].data();
+    const uint64_t* rhs_words = rhs.levels_[0].data();
+    size_t common = std::min(levels_[0].size(), rhs.levels_[0].size());
+    for (size_t i = 0; i < common; ++i) {
+        words[i] &= ~rhs_words[i];
+    }
+
+    BuildSummaries();
+    size_ = CountLeaves();
+}
+
+template <class ValueType>
+size_t
+BitmapSet<ValueType>
+::intersection_size(
+        const BitmapSet& rhs
+) const {
+    const uint64_t* words = levels_[0].data();
+    const uint64_t* rhs_words = rhs.levels_[0].data();
+    size_t common = std::min(levels_[0].size(), rhs.levels_[0].size());
+    size_t count = 0;
+    for (size_t i = 0; i < common; ++i) {
+        count += BitmapPopCount(words[i] & rhs_words[i]);
+    }
+
+    return count;
+}
+
+template <class ValueType>
+template <class Visitor>
+void
+BitmapSet<ValueType>
+::for_each_in_range(
+        uint64_t lo,
+        uint64_t hi,
+        Visitor visit
+) const {
+    hi = std::min(hi, universe());
+    uint64_t value;
+    while (lo < hi && NextValue(lo, &value) && value < hi) {
+        size_t word_idx = value >> kWordShift;
+        uint64_t word = levels_[0][word_idx] & (~uint64_t(0) << (value & (kWordBits - 1)));
+        uint64_t base = uint64_t(word_idx) << kWordShift;
+        for (; word; word &= word - 1) {
+            uint64_t cur = base + BitmapLowestBit(word);
+            if (cur >= hi) {
+                return;
+            }
+
+            visit(static_cast<ValueType>(cur));
+        }
+
+        lo = base + kWordBits;
+    }
+}
+
+//  Level sizes are rounded up to whole words, the top one is one word
+template <class ValueType>
+void
+BitmapSet<ValueType>
+::Grow(
+        uint64_t universe
+) {
+    std::vector<uint64_t> leaves;
+    if (!levels_.empty()) {
+        leaves.swap(levels_[0]);
+    }
+
+    leaves.resize((universe + kWordBits - 1) >> kWordShift, 0);
+    levels_.clear();
+    levels_.push_back(std::move(leaves));
+    while (levels_.back().size() > 1) {
+        levels_.emplace_back((levels_.back().size() + kWordBits - 1) >> kWordShift, 0);
+    }
+
+    BuildSummaries();
+}
+
+template <class ValueType>
+void
+BitmapSet<ValueType>
+::BuildSummaries() {
+    for (size_t level = 1; level < levels_.size(); ++level) {
+        const std::vector<uint64_t>& below = levels_[level - 1];
+        std::vector<uint64_t>& words = levels_[level];
+        std::fill(words.begin(), words.end(), 0);
+        for (size_t i = 0; i < below.size(); ++i) {
+            words[i >> kWordShift] |= uint64_t(below[i] != 0) << (i & (kWordBits - 1));
+        }
+    }
+}
+
+template <class ValueType>
+size_t
+BitmapSet<ValueType>
+::CountLeaves() const {
+    size_t count = 0;
+    for (uint64_t word : levels_[0]) {
+        count += BitmapPopCount(word);
+    }
+
+    return count;
+}
+
+/*
+ *      Least value not less than from: climb while the rest of the word
+ *      is empty, looking right of the current word one level up, then
+ *      descend through the lowest set bits.
+ */
+template <class ValueType>
+bool
+BitmapSet<ValueType>
+::NextValue(
+        uint64_t from,
+        uint64_t* value
+) const {
+    uint64_t pos = from;
+    size_t level = 0;
+    for (;;) {
+        const std::vector<uint64_t>& words = levels_[level];
+        if ((pos >> kWordShift) >= words.size()) {
+            return false;
+        }
+
+        uint64_t word = words[pos >> kWordShift] & (~uint64_t(0) << (pos & (kWordBits - 1)));
+        if (word) {
+            pos = (pos & ~uint64_t(kWordBits - 1)) + BitmapLowestBit(word);
+            break;
+        }
+
+        if (++level == levels_.size()) {
+            return false;
+        }
+
+        pos = (pos >> kWordShift) + 1;
+    }
+
+    while (level-- > 0) {
+        pos = (pos << kWordShift) + BitmapLowestBit(levels_[level][pos]);
+    }
+
+    *value = pos;
+    return true;
+}
+
+//  Greatest value not greater than from
+template <class ValueType>
+bool
+BitmapSet<ValueType>
+::PrevValue(
+        uint64_t from,
+        uint64_t* value
+) const {
+    uint64_t pos = std::min(from, universe() - 1);
+    size_t level = 0;
+    for (;;) {
+        uint64_t word = levels_[level][pos >> kWordShift] &
+                        (~uint64_t(0) >> (kWordBits - 1 - (pos & (kWordBits - 1))));
+        if (word) {
+            pos = (pos & ~uint64_t(kWordBits - 1)) + BitmapHighestBit(word);
+            break;
+        }
+
+        if ((pos >> kWordShift) == 0 || ++level == levels_.size()) {
+            return false;
+        }
+
+        pos = (pos >> kWordShift) - 1;
+    }
+
+    while (level-- > 0) {
+        pos = (pos << kWordShift) + BitmapHighestBit(levels_[level][pos]);
+    }
+
+    *value = pos;
+    return true;
+}
+
+/*
+ *
+ *      Iterator implementation
+ *
+ */
+
+template <class ValueType>
+typename BitmapSet<ValueType>::iterator
+BitmapSet<ValueType>
+::begin() const {
+    return lower_bound(0);
+}
+
+template <class ValueType>
+typename BitmapSet<ValueType>::iterator
+BitmapSet<ValueType>
+::end() const {
+    return iterator(0, true, this);
+}
+
+template <class ValueType>
+BitmapSet<ValueType>::iterator
+::iterator(
+        ValueType value,
+        bool end,
+        const BitmapSet* set
+):
+        value_{value},
+        end_{end},
+        set_{set}
+{}
+
+template <class ValueType>
+typename BitmapSet<ValueType>::iterator&
+BitmapSet<ValueType>::iterator
+::operator++() {
+    uint64_t next;
+    end_ = !set_->NextValue(uint64_t(value_) + 1, &next);
+    value_ = end_ ? 0 : static_cast<ValueType>(next);
+    return *this;
+}
+
+template <class ValueType>
+typename BitmapSet<ValueType>::iterator
+BitmapSet<ValueType>::iterator
+::operator++(int dummy) {
+    iterator cpy(*this);
+    this->operator++();
+    return cpy;
+}
+
+template <class ValueType>
+typename BitmapSet<ValueType>::iterator&
+BitmapSet<ValueType>::iterator
+::operator--() {
+    uint64_t prev;
+    set_->PrevValue(end_ ? set_->universe() - 1 : uint64_t(value_) - 1, &prev);
+    value_ = static_cast<ValueType>(prev);
+    end_ = false;
+    return *this;
+}
+
+template <class ValueType>
+typename BitmapSet<ValueType>::iterator
+BitmapSet<ValueType>::iterator
+::operator--(int dummy) {
+    iterator cpy(*this);
+    this->operator--();
+    return cpy;
+}
+
+template <class ValueType>
+const ValueType&
+BitmapSet<ValueType>::iterator
+::operator*() {
+    return value_;
+}
+
+template <class ValueType>
+const ValueType*
+BitmapSet<ValueType>::iterator
+::operator->() {
+    return &value_;
+}
+
+template <class ValueType>
+bool
+BitmapSet<ValueType>::iterator
+::operator==(
+        const iterator& rhs
+) const {
+    return end_ == rhs.end_ && (end_ || value_ == rhs.value_);
+}
+
+template <class ValueType>
+bool
+BitmapSet<ValueType>::iterator
+::operator!=(
+        const iterator& rhs
+) const {
+    return !(*this == rhs);
+}
+
+#endif //DATA_STRUCTURES_BITMAP_SET_H
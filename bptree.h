@@ -0,0 +1,928 @@
+//
+// Created by alexaxnder on 19.10.26.
+//
+
+#ifndef DATA_STRUCTURES_BPTREE_H
+#define DATA_STRUCTURES_BPTREE_H
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <functional>
+#include <initializer_list>
+#include <iterator>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+
+//  Target node size, a few cache lines
+constexpr size_t bptree_node_bytes = 256;
+
+
+//  Result of a proxy iterator's operator->
+template <class Reference>
+class BPlusArrow {
+public:
+    explicit BPlusArrow(Reference ref): ref_(ref) {}
+
+    Reference* operator->() {
+        return &ref_;
+    }
+
+private:
+    Reference ref_;
+};
+
+
+//  Key extractors also tell how the iterator shows a stored value
+
+//  Set values are keys and must not be changed through iterator
+template <class ValueType>
+struct BPlusIdentity {
+    typedef const ValueType& Reference;
+    typedef const ValueType* Pointer;
+
+    const ValueType& operator()(const ValueType& value) const {
+        return value;
+    }
+
+    static Reference Ref(ValueType& value) {
+        return value;
+    }
+
+    static Pointer Ptr(ValueType& value) {
+        return &value;
+    }
+};
+
+//  Leaves move pairs around, so they can't hold a const key. Iterator
+//  shows a pair as references to a const key and a mutable value
+template <class PairType>
+struct BPlusSelectFirst {
+    typedef std::pair<const typename PairType::first_type&,
+                      typename PairType::second_type&> Reference;
+    typedef BPlusArrow<Reference> Pointer;
+
+    const typename PairType::first_type& operator()(const PairType& value) const {
+        return value.first;
+    }
+
+    static Reference Ref(PairType& value) {
+        return Reference(value.first, value.second);
+    }
+
+    static Pointer Ptr(PairType& value) {
+        return Pointer(Ref(value));
+    }
+};
+
+
+/*
+ *      B+ tree
+ *
+ *      Values live in leaves only, leaves are linked in both directions.
+ *      Inner node separator keys[i] splits children[i] (keys < separator)
+ *      and children[i + 1] (keys >= separator).
+ *      Keys inside a node are found with a branchless binary search.
+ *
+ *      KeyType and ValueType must be default constructible and assignable.
+ *      Map iterator dereferences to std::pair<const Key&, Mapped&> by value,
+ *      so it is bound with auto&& or const auto& rather than auto&.
+ */
+template <class KeyType, class ValueType, class KeyOfValue,
+          class Compare = std::less<KeyType>>
+class BPlusTree {
+    struct Node;
+    struct Inner;
+    struct Leaf;
+
+    typedef typename KeyOfValue::Reference Reference;
+    typedef typename KeyOfValue::Pointer Pointer;
+
+public:
+    class iterator:
+            public std::iterator<std::bidirectional_iterator_tag, ValueType,
+                                 ptrdiff_t, Pointer, Reference> {
+    public:
+        iterator(): leaf_{nullptr}, idx_{0}, tree_{nullptr} {};
+        iterator(Leaf* leaf, size_t idx, const BPlusTree* tree);
+
+        iterator& operator++();
+        iterator operator++(int);
+
+        iterator& operator--();
+        iterator operator--(int);
+
+        Reference operator*();
+        Pointer operator->();
+
+        bool operator==(const iterator& rhs) const;
+        bool operator!=(const iterator& rhs) const;
+
+    private:
+        Leaf* leaf_;
+        size_t idx_;
+        const BPlusTree* tree_;
+    };
+
+    iterator begin() const;
+    iterator end() const;
+
+    BPlusTree();
+
+    template <class BidirectionalIterator>
+    BPlusTree(BidirectionalIterator first, BidirectionalIterator last);
+
+    BPlusTree(std::initializer_list<ValueType> list);
+    BPlusTree(const BPlusTree& rhs);
+
+    BPlusTree& operator=(const BPlusTree& rhs);
+
+    ~BPlusTree();
+    std::pair<iterator, bool> insert(const ValueType& value);
+    void erase(const KeyType& key);
+    iterator find(const KeyType& key) const;
+    iterator lower_bound(const KeyType& key) const;
+
+    size_t size() const;
+    bool empty() const;
+    void clear();
+
+private:
+    static constexpr size_t kLeafSlots =
+            bptree_node_bytes / sizeof(ValueType) > 4 ?
+            bptree_node_bytes / sizeof(ValueType) : 4;
+    static constexpr size_t kInnerSlots =
+            bptree_node_bytes / (sizeof(KeyType) + sizeof(Node*)) > 4 ?
+            bptree_node_bytes / (sizeof(KeyType) + sizeof(Node*)) : 4;
+
+    struct Node {
+        bool is_leaf;
+        uint16_t count;
+
+        explicit Node(bool is_leaf);
+    };
+
+    //  One extra slot lets a node overflow before it is split
+    struct Inner: Node {
+        KeyType keys[kInnerSlots + 1];
+        Node* children[kInnerSlots + 2];
+
+        Inner();
+    };
+
+    struct Leaf: Node {
+        ValueType values[kLeafSlots + 1];
+        Leaf* prev;
+        Leaf* next;
+
+        Leaf();
+    };
+
+    //  Inner node on the path and the index of the child taken
+    typedef std::pair<Inner*, size_t> PathStep;
+
+    template <class Getter>
+    size_t NodeLowerBound(size_t count, const KeyType& key, Getter get) const;
+    size_t InnerUpperBound(const Inner* node, const KeyType& key) const;
+    size_t LeafLowerBound(const Leaf* leaf, const KeyType& key) const;
+
+    Leaf* FindLeaf(const KeyType& key, std::vector<PathStep>* path) const;
+    Leaf* FirstLeaf() const;
+    Leaf* LastLeaf() const;
+
+    void InsertIntoParent(std::vector<PathStep>& path, Node* left,
+                          const KeyType& separator, Node* right);
+
+    void RebalanceLeaf(std::vector<PathStep>& path, Leaf* leaf);
+    void RebalanceInner(std::vector<PathStep>& path, Inner* node);
+    void RemoveChild(Inner* parent, size_t child_idx);
+
+    void DeleteSubtree(Node* node);
+
+    Node* root_;
+    size_t size_;
+    Compare comp_;
+};
+
+
+template <class ValueType, class Compare = std::less<ValueType>>
+class BPlusSet: public BPlusTree<ValueType, ValueType, BPlusIdentity<ValueType>, Compare> {
+    typedef BPlusTree<ValueType, ValueType, BPlusIdentity<ValueType>, Compare> Tree;
+
+public:
+    using Tree::Tree;
+};
+
+
+template <class KeyType, class MappedType, class Compare = std::less<KeyType>>
+class BPlusMap: public BPlusTree<KeyType, std::pair<KeyType, MappedType>,
+                                 BPlusSelectFirst<std::pair<KeyType, MappedType>>, Compare> {
+    typedef BPlusTree<KeyType, std::pair<KeyType, MappedType>,
+                      BPlusSelectFirst<std::pair<KeyType, MappedType>>, Compare> Tree;
+
+public:
+    using Tree::Tree;
+
+    MappedType& operator[](const KeyType& key);
+    const MappedType& at(const KeyType& key) const;
+};
+
+
+/*
+ *
+ *      BPlusTree implementation
+ *
+ */
+
+template <class KeyType, class ValueType, class KeyOfValue, class Compare>
+BPlusTree<KeyType, ValueType, KeyOfValue, Compare>
+::BPlusTree():
+        root_{new Leaf()},
+        size_{0}
+{}
+
+template <class KeyType, class ValueType, class KeyOfValue, class Compare>
+template <class BidirectionalIterator>
+BPlusTree<KeyType, ValueType, KeyOfValue, Compare>
+::BPlusTree(
+        BidirectionalIterator first,
+        BidirectionalIterator last
+):
+        BPlusTree()
+{
+    while (first != last) {
+        insert(*first);
+        ++first;
+    }
+}
+
+template <class KeyType, class ValueType, class KeyOfValue, class Compare>
+BPlusTree<KeyType, ValueType, KeyOfValue, Compare>
+::BPlusTree(
+        std::initializer_list<ValueType> list
+):
+        BPlusTree(list.begin(), list.end())
+{}
+
+template <class KeyType, class ValueType, class KeyOfValue, class Compare>
+BPlusTree<KeyType, ValueType, KeyOfValue, Compare>
+::BPlusTree(
+        const BPlusTree& rhs
+):
+        root_{new Leaf()},
+        size_{0},
+        comp_{rhs.comp_}
+{
+    for (auto it = rhs.begin(); it != rhs.end(); ++it) {
+        insert(*it);
+    }
+}
+
+template <class KeyType, class ValueType, class KeyOfValue, class Compare>
+BPlusTree<KeyType, ValueType, KeyOfValue, Compare>&
+BPlusTree<KeyType, ValueType, KeyOfValue, Compare>
+::operator=(
+        const BPlusTree& rhs
+) {
+    if (&rhs == this) {
+        return *this;
+    }
+
+    clear();
+    comp_ = rhs.comp_;
+    for (auto it = rhs.begin(); it != rhs.end(); ++it) {
+        insert(*it);
+    }
+
+    return *this;
+}
+
+template <class KeyType, class ValueType, class KeyOfValue, class Compare>
+BPlusTree<KeyType, ValueType, KeyOfValue, Compare>
+::~BPlusTree() {
+    DeleteSubtree(root_);
+}
+
+template <class KeyType, class ValueType, class KeyOfValue, class Compare>
+std::pair<typename BPlusTree<KeyType, ValueType, KeyOfValue, Compare>::iterator, bool>
+BPlusTree<KeyType, ValueType, KeyOfValue, Compare>
+::insert(
+        const ValueType& value
+) {
+    const KeyType& key = KeyOfValue()(value);
+    std::vector<PathStep> path;
+    Leaf* leaf = FindLeaf(key, &path);
+
+    size_t idx = LeafLowerBound(leaf, key);
+    if (idx < leaf->count && !comp_(key, KeyOfValue()(leaf->values[idx]))) {
+        return {iterator(leaf, idx, this), false};
+    }
+
+    for (size_t i = leaf->count; i > idx; --i) {
+        leaf->values[i] = std::move(leaf->values[i - 1]);
+    }
+
+    leaf->values[idx] = value;
+    ++leaf->count;
+    ++size_;
+
+    if (leaf->count <= kLeafSlots) {
+        return {iterator(leaf, idx, this), true};
+    }
+
+    //  Split overflowed leaf in halves
+    Leaf* right = new Leaf();
+    size_t left_count = leaf->count / 2;
+    right->count = leaf->count - left_count;
+    std::move(leaf->values + left_count, leaf->values + leaf->count, right->values);
+    leaf->count = left_count;
+
+    right->next = leaf->next;
+    right->prev = leaf;
+    if (leaf->next) {
+        leaf->next->prev = right;
+    }
+    leaf->next = right;
+
+    InsertIntoParent(path, leaf, KeyOfValue()(right->values[0]), right);
+
+    if (idx < left_count) {
+        return {iterator(leaf, idx, this), true};
+    }
+
+    return {iterator(right, idx - left_count, this), true};
+}
+
+template <class KeyType, class ValueType, class KeyOfValue, class Compare>
+void
+BPlusTree<KeyType, ValueType, KeyOfValue, Compare>
+::erase(
+        const KeyType& key
+) {
+    std::vector<PathStep> path;
+    Leaf* leaf = FindLeaf(key, &path);
+
+    size_t idx = LeafLowerBound(leaf, key);
+    if (idx == leaf->count || comp_(key, KeyOfValue()(leaf->values[idx]))) {
+        return;
+    }
+
+    std::move(leaf->values + idx + 1, leaf->values + leaf->count, leaf->values + idx);
+    --leaf->count;
+    --size_;
+
+    RebalanceLeaf(path, leaf);
+}
+
+template <class KeyType, class ValueType, class KeyOfValue, class Compare>
+typename BPlusTree<KeyType, ValueType, KeyOfValue, Compare>::iterator
+BPlusTree<KeyType, ValueType, KeyOfValue, Compare>
+::find(
+        const KeyType& key
+) const {
+    Leaf* leaf = FindLeaf(key, nullptr);
+    size_t idx = LeafLowerBound(leaf, key);
+    if (idx == leaf->count || comp_(key, KeyOfValue()(leaf->values[idx]))) {
+        return end();
+    }
+
+    return iterator(leaf, idx, this);
+}
+
+template <class KeyType, class ValueType, class KeyOfValue, class Compare>
+typename BPlusTree<KeyType, ValueType, KeyOfValue, Compare>::iterator
+BPlusTree<KeyType, ValueType, KeyOfValue, Compare>
+::lower_bound(
+        const KeyType& key
+) const {
+    Leaf* leaf = FindLeaf(key, nullptr);
+    size_t idx = LeafLowerBound(leaf, key);
+    if (idx < leaf->count) {
+        return iterator(leaf, idx, this);
+    }
+
+    //  All keys of the leaf are less, answer is the first of the next one
+    if (leaf->next) {
+        return iterator(leaf->next, 0, this);
+    }
+
+    return end();
+}
+
+template <class KeyType, class ValueType, class KeyOfValue, class Compare>
+size_t
+BPlusTree<KeyType, ValueType, KeyOfValue, Compare>
+::size() const {
+    return size_;
+}
+
+template <class KeyType, class ValueType, class KeyOfValue, class Compare>
+bool
+BPlusTree<KeyType, ValueType, KeyOfValue, Compare>
+::empty() const {
+    return size_ == 0;
+}
+
+template <class KeyType, class ValueType, class KeyOfValue, class Compare>
+void
+BPlusTree<KeyType, ValueType, KeyOfValue, Compare>
+::clear() {
+    DeleteSubtree(root_);
+    root_ = new Leaf();
+    size_ = 0;
+}
+
+//  Branchless lower bound over count keys, get(i) returns i-th key
+template <class KeyType, class ValueType, class KeyOfValue, class Compare>
+template <class Getter>
+size_t
+BPlusTree<KeyType, ValueType, KeyOfValue, Compare>
+::NodeLowerBound(
+        size_t count,
+        const KeyType& key,
+        Getter get
+) const {
+    if (count == 0) {
+        return 0;
+    }
+
+    size_t base = 0;
+    while (count > 1) {
+        size_t half = count / 2;
+        base = comp_(get(base + half), key) ? base + half : base;
+        count -= half;
+    }
+
+    return base + comp_(get(base), key);
+}
+
+//  Number of separators not greater than key, i.e. the child to descend
+template <class KeyType, class ValueType, class KeyOfValue, class Compare>
+size_t
+BPlusTree<KeyType, ValueType, KeyOfValue, Compare>
+::InnerUpperBound(
+        const Inner* node,
+        const KeyType& key
+) const {
+    size_t count = node->count;
+    if (count == 0) {
+        return 0;
+    }
+
+    size_t base = 0;
+    while (count > 1) {
+        size_t half = count / 2;
+        base = comp_(key, node->keys[base + half]) ? base : base + half;
+        count -= half;
+    }
+
+    return base + !comp_(key, node->keys[base]);
+}
+
+template <class KeyType, class ValueType, class KeyOfValue, class Compare>
+size_t
+BPlusTree<KeyType, ValueType, KeyOfValue, Compare>
+::LeafLowerBound(
+        const Leaf* leaf,
+        const KeyType& key
+) const {
+    return NodeLowerBound(leaf->count, key, [leaf](size_t idx) -> const KeyType& {
+        return KeyOfValue()(leaf->values[idx]);
+    });
+}
+
+template <class KeyType, class ValueType, class KeyOfValue, class Compare>
+typename BPlusTree<KeyType, ValueType, KeyOfValue, Compare>::Leaf*
+BPlusTree<KeyType, ValueType, KeyOfValue, Compare>
+::FindLeaf(
+        const KeyType& key,
+        std::vector<PathStep>* path
+) const {
+    Node* cur = root_;
+    while (!cur->is_leaf) {
+        Inner* inner = static_cast<Inner*>(cur);
+        size_t child_idx = InnerUpperBound(inner, key);
+        if (path) {
+            path->emplace_back(inner, child_idx);
+        }
+
+        cur = inner->children[child_idx];
+    }
+
+    return static_cast<Leaf*>(cur);
+}
+
+template <class KeyType, class ValueType, class KeyOfValue, class Compare>
+typename BPlusTree<KeyType, ValueType, KeyOfValue, Compare>::Leaf*
+BPlusTree<KeyType, ValueType, KeyOfValue, Compare>
+::FirstLeaf() const {
+    Node* cur = root_;
+    while (!cur->is_leaf) {
+        cur = static_cast<Inner*>(cur)->children[0];
+    }
+
+    return static_cast<Leaf*>(cur);
+}
+
+template <class KeyType, class ValueType, class KeyOfValue, class Compare>
+typename BPlusTree<KeyType, ValueType, KeyOfValue, Compare>::Leaf*
+BPlusTree<KeyType, ValueType, KeyOfValue, Compare>
+::LastLeaf() const {
+    Node* cur = root_;
+    while (!cur->is_leaf) {
+        Inner* inner = static_cast<Inner*>(cur);
+        cur = inner->children[inner->count];
+    }
+
+    return static_cast<Leaf*>(cur);
+}
+
+template <class KeyType, class ValueType, class KeyOfValue, class Compare>
+void
+BPlusTree<KeyType, ValueType, KeyOfValue, Compare>
+::InsertIntoParent(
+        std::vector<PathStep>& path,
+        Node* left,
+        const KeyType& separator,
+        Node* right
+) {
+    if (path.empty()) {
+        Inner* root = new Inner();
+        root->count = 1;
+        root->keys[0] = separator;
+        root->children[0] = left;
+        root->children[1] = right;
+        root_ = root;
+        return;
+    }
+
+    Inner* parent = path.back().first;
+    size_t idx = path.back().second;
+    path.pop_back();
+
+    for (size_t i = parent->count; i > idx; --i) {
+        parent->keys[i] = std::move(parent->keys[i - 1]);
+        parent->children[i + 1] = parent->children[i];
+    }
+
+    parent->keys[idx] = separator;
+    parent->children[idx + 1] = right;
+    ++parent->count;
+
+    if (parent->count <= kInnerSlots) {
+        return;
+    }
+
+    //  Middle key goes up, it is not kept in either half
+    Inner* sibling = new Inner();
+    size_t middle = parent->count / 2;
+    sibling->count = parent->count - middle - 1;
+    std::move(parent->keys + middle + 1, parent->keys + parent->count, sibling->keys);
+    std::copy(parent->children + middle + 1, parent->children + parent->count + 1,
+              sibling->children);
+    parent->count = middle;
+
+    InsertIntoParent(path, parent, parent->keys[middle], sibling);
+}
+
+template <class KeyType, class ValueType, class KeyOfValue, class Compare>
+void
+BPlusTree<KeyType, ValueType, KeyOfValue, Compare>
+::RebalanceLeaf(
+        std::vector<PathStep>& path,
+        Leaf* leaf
+) {
+    if (path.empty() || leaf->count >= kLeafSlots / 2) {
+        return;
+    }
+
+    Inner* parent = path.back().first;
+    size_t idx = path.back().second;
+    Leaf* left = idx > 0 ? static_cast<Leaf*>(parent->children[idx - 1]) : nullptr;
+    Leaf* right = idx < parent->count ? static_cast<Leaf*>(parent->children[idx + 1]) : nullptr;
+
+    if (left && left->count > kLeafSlots / 2) {
+        std::move_backward(leaf->values, leaf->values + leaf->count,
+                           leaf->values + leaf->count + 1);
+        leaf->values[0] = std::move(left->values[left->count - 1]);
+        --left->count;
+        ++leaf->count;
+        parent->keys[idx - 1] = KeyOfValue()(leaf->values[0]);
+        return;
+    }
+
+    if (right && right->count > kLeafSlots / 2) {
+        leaf->values[leaf->count] = std::move(right->values[0]);
+        std::move(right->values + 1, right->values + right->count, right->values);
+        --right->count;
+        ++leaf->count;
+        parent->keys[idx] = KeyOfValue()(right->values[0]);
+        return;
+    }
+
+    //  Merge with a sibling, the right node of the pair goes away
+    if (!left) {
+        left = leaf;
+        leaf = right;
+        ++idx;
+    }
+
+    std::move(leaf->values, leaf->values + leaf->count, left->values + left->count);
+    left->count += leaf->count;
+    left->next = leaf->next;
+    if (leaf->next) {
+        leaf->next->prev = left;
+    }
+
+    delete leaf;
+    RemoveChild(parent, idx);
+
+    path.pop_back();
+    RebalanceInner(path, parent);
+}
+
+template <class KeyType, class ValueType, class KeyOfValue, class Compare>
+void
+BPlusTree<KeyType, ValueType, KeyOfValue, Compare>
+::RebalanceInner(
+        std::vector<PathStep>& path,
+        Inner* node
+) {
+    if (path.empty()) {
+        //  Root with a single child is replaced by the child
+        if (node->count == 0) {
+            root_ = node->children[0];
+            delete node;
+        }
+        return;
+    }
+
+    if (node->count >= kInnerSlots / 2) {
+        return;
+    }
+
+    Inner* parent = path.back().first;
+    size_t idx = path.back().second;
+    Inner* left = idx > 0 ? static_cast<Inner*>(parent->children[idx - 1]) : nullptr;
+    Inner* right = idx < parent->count ? static_cast<Inner*>(parent->children[idx + 1]) : nullptr;
+
+    //  Borrowing rotates a key through the parent separator
+    if (left && left->count > kInnerSlots / 2) {
+        std::move_backward(node->keys, node->keys + node->count,
+                           node->keys + node->count + 1);
+        std::copy_backward(node->children, node->children + node->count + 1,
+                           node->children + node->count + 2);
+        node->keys[0] = std::move(parent->keys[idx - 1]);
+        node->children[0] = left->children[left->count];
+        parent->keys[idx - 1] = std::move(left->keys[left->count - 1]);
+        --left->count;
+        ++node->count;
+        return;
+    }
+
+    if (right && right->count > kInnerSlots / 2) {
+        node->keys[node->count] = std::move(parent->keys[idx]);
+        node->children[node->count + 1] = right->children[0];
+        parent->keys[idx] = std::move(right->keys[0]);
+        std::move(right->keys + 1, right->keys + right->count, right->keys);
+        std::copy(right->children + 1, right->children + right->count + 1, right->children);
+        --right->count;
+        ++node->count;
+        return;
+    }
+
+    if (!left) {
+        left = node;
+        node = right;
+        ++idx;
+    }
+
+    left->keys[left->count] = std::move(parent->keys[idx - 1]);
+    std::move(node->keys, node->keys + node->count, left->keys + left->count + 1);
+    std::copy(node->children, node->children + node->count + 1,
+              left->children + left->count + 1);
+    left->count += node->count + 1;
+
+    delete node;
+    RemoveChild(parent, idx);
+
+    path.pop_back();
+    RebalanceInner(path, parent);
+}
+
+//  Removes children[child_idx] and the separator before it
+template <class KeyType, class ValueType, class KeyOfValue, class Compare>
+void
+BPlusTree<KeyType, ValueType, KeyOfValue, Compare>
+::RemoveChild(
+        Inner* parent,
+        size_t child_idx
+) {
+    std::move(parent->keys + child_idx, parent->keys + parent->count,
+              parent->keys + child_idx - 1);
+    std::copy(parent->children + child_idx + 1, parent->children + parent->count + 1,
+              parent->children + child_idx);
+    --parent->count;
+}
+
+template <class KeyType, class ValueType, class KeyOfValue, class Compare>
+void
+BPlusTree<KeyType, ValueType, KeyOfValue, Compare>
+::DeleteSubtree(
+        Node* node
+) {
+    if (node->is_leaf) {
+        delete static_cast<Leaf*>(node);
+        return;
+    }
+
+    Inner* inner = static_cast<Inner*>(node);
+    for (size_t i = 0; i <= inner->count; ++i) {
+        DeleteSubtree(inner->children[i]);
+    }
+
+    delete inner;
+}
+
+/*
+ *
+ *      Iterator implementation
+ *
+ */
+
+template <class KeyType, class ValueType, class KeyOfValue, class Compare>
+typename BPlusTree<KeyType, ValueType, KeyOfValue, Compare>::iterator
+BPlusTree<KeyType, ValueType, KeyOfValue, Compare>
+::begin() const {
+    Leaf* leaf = FirstLeaf();
+    if (leaf->count == 0) {
+        return end();
+    }
+
+    return iterator(leaf, 0, this);
+}
+
+template <class KeyType, class ValueType, class KeyOfValue, class Compare>
+typename BPlusTree<KeyType, ValueType, KeyOfValue, Compare>::iterator
+BPlusTree<KeyType, ValueType, KeyOfValue, Compare>
+::end() const {
+    return iterator(nullptr, 0, this);
+}
+
+template <class KeyType, class ValueType, class KeyOfValue, class Compare>
+BPlusTree<KeyType, ValueType, KeyOfValue, Compare>::iterator
+::iterator(
+        Leaf* leaf,
+        size_t idx,
+        const BPlusTree* tree
+):
+        leaf_{leaf},
+        idx_{idx},
+        tree_{tree}
+{}
+
+template <class KeyType, class ValueType, class KeyOfValue, class Compare>
+typename BPlusTree<KeyType, ValueType, KeyOfValue, Compare>::Reference
+BPlusTree<KeyType, ValueType, KeyOfValue, Compare>::iterator
+::operator*() {
+    return KeyOfValue::Ref(leaf_->values[idx_]);
+}
+
+template <class KeyType, class ValueType, class KeyOfValue, class Compare>
+typename BPlusTree<KeyType, ValueType, KeyOfValue, Compare>::Pointer
+BPlusTree<KeyType, ValueType, KeyOfValue, Compare>::iterator
+::operator->() {
+    return KeyOfValue::Ptr(leaf_->values[idx_]);
+}
+
+template <class KeyType, class ValueType, class KeyOfValue, class Compare>
+typename BPlusTree<KeyType, ValueType, KeyOfValue, Compare>::iterator&
+BPlusTree<KeyType, ValueType, KeyOfValue, Compare>::iterator
+::operator++() {
+    if (++idx_ == leaf_->count) {
+        leaf_ = leaf_->next;
+        idx_ = 0;
+    }
+
+    return *this;
+}
+
+template <class KeyType, class ValueType, class KeyOfValue, class Compare>
+typename BPlusTree<KeyType, ValueType, KeyOfValue, Compare>::iterator
+BPlusTree<KeyType, ValueType, KeyOfValue, Compare>::iterator
+::operator++(int dummy) {
+    iterator cpy(*this);
+    this->operator++();
+    return cpy;
+}
+
+template <class KeyType, class ValueType, class KeyOfValue, class Compare>
+typename BPlusTree<KeyType, ValueType, KeyOfValue, Compare>::iterator&
+BPlusTree<KeyType, ValueType, KeyOfValue, Compare>::iterator
+::operator--() {
+    if (!leaf_) {
+        leaf_ = tree_->LastLeaf();
+        idx_ = leaf_->count - 1;
+
+    } else if (idx_ == 0) {
+        leaf_ = leaf_->prev;
+        idx_ = leaf_->count - 1;
+
+    } else {
+        --idx_;
+    }
+
+    return *this;
+}
+
+template <class KeyType, class ValueType, class KeyOfValue, class Compare>
+typename BPlusTree<KeyType, ValueType, KeyOfValue, Compare>::iterator
+BPlusTree<KeyType, ValueType, KeyOfValue, Compare>::iterator
+::operator--(int dummy) {
+    iterator cpy(*this);
+    this->operator--();
+    return cpy;
+}
+
+template <class KeyType, class ValueType, class KeyOfValue, class Compare>
+bool
+BPlusTree<KeyType, ValueType, KeyOfValue, Compare>::iterator
+::operator==(
+        const iterator& rhs
+) const {
+    return leaf_ == rhs.leaf_ && idx_ == rhs.idx_;
+}
+
+template <class KeyType, class ValueType, class KeyOfValue, class Compare>
+bool
+BPlusTree<KeyType, ValueType, KeyOfValue, Compare>::iterator
+::operator!=(
+        const iterator& rhs
+) const {
+    return !(*this == rhs);
+}
+
+/*
+ *
+ *      Node implementation
+ *
+ */
+
+template <class KeyType, class ValueType, class KeyOfValue, class Compare>
+BPlusTree<KeyType, ValueType, KeyOfValue, Compare>::Node
+::Node(
+        bool is_leaf
+):
+        is_leaf{is_leaf},
+        count{0}
+{}
+
+template <class KeyType, class ValueType, class KeyOfValue, class Compare>
+BPlusTree<KeyType, ValueType, KeyOfValue, Compare>::Inner
+::Inner():
+        Node(false)
+{}
+
+template <class KeyType, class ValueType, class KeyOfValue, class Compare>
+BPlusTree<KeyType, ValueType, KeyOfValue, Compare>::Leaf
+::Leaf():
+        Node(true),
+        prev{nullptr},
+        next{nullptr}
+{}
+
+/*
+ *
+ *      BPlusMap implementation
+ *
+ */
+
+template <class KeyType, class MappedType, class Compare>
+MappedType&
+BPlusMap<KeyType, MappedType, Compare>
+::operator[](
+        const KeyType& key
+) {
+    return this->insert(std::make_pair(key, MappedType())).first->second;
+}
+
+template <class KeyType, class MappedType, class Compare>
+const MappedType&
+BPlusMap<KeyType, MappedType, Compare>
+::at(
+        const KeyType& key
+) const {
+    auto it = this->find(key);
+    if (it == this->end()) {
+        throw std::out_of_range("No such key in BPlusMap");
+    }
+
+    return it->second;
+}
+
+
+#endif //DATA_STRUCTURES_BPTREE_H
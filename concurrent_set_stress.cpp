@@ -0,0 +1,116 @@
+//
+// Created by alexaxnder on 19.10.26.
+//
+
+//  Stress test of ConcurrentSet: one writer churns odd keys while
+//  readers look up even keys that are never erased. Meant to be run
+//  under ThreadSanitizer, which reports any unsynchronized access:
+//
+//      g++ -std=c++11 -O1 -g -fsanitize=thread -pthread concurrent_set_stress.cpp
+//      ./a.out [readers] [milliseconds]
+//
+//  Exits with 1 if a reader got a wrong answer. GCC warns that the
+//  fences on the sequence counter are not instrumented, the release
+//  and acquire links carry the ordering the sanitizer checks.
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <thread>
+#include <vector>
+
+#include "rbtree.h"
+
+
+//  Not word sized, so readers copy it byte by byte
+struct Point {
+    int x;
+    int y;
+
+    bool operator<(const Point& rhs) const {
+        return x < rhs.x || (x == rhs.x && y < rhs.y);
+    }
+};
+
+
+long KeyOf(long key) {
+    return key;
+}
+
+Point PointOf(long key) {
+    return {static_cast<int>(key), -static_cast<int>(key)};
+}
+
+
+template <class ValueType, class MakeValue>
+bool Stress(const char* name, size_t readers_number, long milliseconds, MakeValue make) {
+    const long keys = 1 << 12;
+
+    ConcurrentSet<ValueType> set;
+    for (long key = 0; key < keys; key += 2) {
+        set.insert(make(key));
+    }
+
+    std::atomic<bool> stop{false};
+    std::atomic<bool> failed{false};
+    std::atomic<size_t> reads{0};
+    std::vector<std::thread> readers;
+    for (size_t reader_idx = 0; reader_idx < readers_number; ++reader_idx) {
+        readers.emplace_back([&, reader_idx]() {
+            std::mt19937 gen(reader_idx);
+            size_t done = 0;
+            while (!stop.load(std::memory_order_relaxed)) {
+                long key = gen() % (keys - 2);
+                long even = key & ~1L;
+                ValueType out;
+                if (!set.find(make(even), &out) || make(even) < out || out < make(even)) {
+                    failed = true;
+                }
+
+                //  The bound is key itself or an odd key before the next even one
+                if (!set.lower_bound(make(key), &out) || out < make(key) || make(even + 2) < out) {
+                    failed = true;
+                }
+
+                done += 2;
+            }
+
+            reads += done;
+        });
+    }
+
+    std::mt19937 gen(readers_number);
+    size_t writes = 0;
+    auto start = std::chrono::steady_clock::now();
+    while (std::chrono::steady_clock::now() - start < std::chrono::milliseconds(milliseconds)) {
+        long key = (gen() % (keys / 2)) * 2 + 1;
+        if (gen() & 1) {
+            set.insert(make(key));
+        } else {
+            set.erase(make(key));
+        }
+
+        ++writes;
+    }
+
+    stop = true;
+    for (auto& reader : readers) {
+        reader.join();
+    }
+
+    printf("%-6s readers %zu reads %zu writes %zu size %zu %s\n",
+           name, readers_number, reads.load(), writes, set.size(), failed ? "FAILED" : "ok");
+    return !failed;
+}
+
+
+int main(int argc, char** argv) {
+    size_t readers_number = argc > 1 ? strtoul(argv[1], nullptr, 10) : 2;
+    long milliseconds = argc > 2 ? strtol(argv[2], nullptr, 10) : 1000;
+
+    bool ok = Stress<long>("long", readers_number, milliseconds, KeyOf);
+    ok = Stress<Point>("Point", readers_number, milliseconds, PointOf) && ok;
+    return ok ? 0 : 1;
+}
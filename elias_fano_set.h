@@ -0,0 +1,574 @@
+//
+// Created by alexaxnder on 19.10.26.
+//
+
+#ifndef DATA_STRUCTURES_ELIAS_FANO_SET_H
+#define DATA_STRUCTURES_ELIAS_FANO_SET_H
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <iterator>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "bitmap_set.h"
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+
+//  Every this many ones (zeros) of the upper bits their position is sampled
+constexpr size_t elias_fano_sample_rate = 256;
+
+//  "EFSET001" in the first word of a saved image
+constexpr uint64_t elias_fano_magic = 0x3130305445534645ull;
+
+
+/*
+ *      Elias-Fano encoded immutable set of 64-bit integers
+ *
+ *      Value i is split into low_bits low bits, packed into lower_,
+ *      and a high part h stored as a set bit h + i of upper_, so the
+ *      high parts are a unary coded bucket sequence. This takes about
+ *      2 + log2(max / n) bits per value. Sampled positions of the ones
+ *      and zeros of upper_ give select in O(1) expected word scans:
+ *      select(i) decodes the i-th one, lower_bound jumps to the bucket
+ *      of its key through the zeros and scans it.
+ *
+ *      The whole set is one array of words (header, lower_, upper_ and
+ *      the samples), saved as is in native byte order and mapped back
+ *      without parsing, so a loaded set costs no heap memory.
+ */
+class EliasFanoSet {
+public:
+    class iterator:
+            public std::iterator<std::forward_iterator_tag, const uint64_t> {
+        friend class EliasFanoSet;
+
+    public:
+        iterator(): idx_{0}, pos_{0}, value_{0}, set_{nullptr} {};
+        iterator(size_t idx, size_t pos, const EliasFanoSet* set);
+
+        iterator& operator++();
+        iterator operator++(int);
+
+        const uint64_t& operator*();
+        const uint64_t* operator->();
+
+        bool operator==(const iterator& rhs) const;
+        bool operator!=(const iterator& rhs) const;
+
+    private:
+        //  pos_ is the position of the idx_-th one of upper_
+        size_t idx_;
+        size_t pos_;
+        uint64_t value_;
+        const EliasFanoSet* set_;
+    };
+
+    iterator begin() const;
+    iterator end() const;
+
+    EliasFanoSet();
+
+    //  Values must be strictly increasing, e.g. a Set<uint64_t> range
+    template <class ForwardIterator>
+    EliasFanoSet(ForwardIterator first, ForwardIterator last);
+
+    EliasFanoSet(const EliasFanoSet& rhs);
+    EliasFanoSet(EliasFanoSet&& rhs) noexcept;
+
+    EliasFanoSet& operator=(EliasFanoSet rhs) noexcept;
+
+    ~EliasFanoSet();
+
+    iterator find(uint64_t value) const;
+    iterator lower_bound(uint64_t value) const;
+
+    //  Number of values less than value, and the value of rank k
+    size_t rank(uint64_t value) const;
+    uint64_t select(size_t k) const;
+
+    size_t size() const;
+    bool empty() const;
+    void swap(EliasFanoSet& rhs) noexcept;
+
+    //  Bytes taken by the encoded set and its index
+    size_t bytes() const;
+
+    void save(const std::string& path) const;
+
+    //  Maps a saved set read only, the file must not change meanwhile
+    static EliasFanoSet load(const std::string& path);
+
+private:
+    enum HeaderWord {
+        kMagic, kSize, kMax, kLowBits, kLowerWords, kUpperBits,
+        kOnesSamples, kZerosSamples, kHeaderWords
+    };
+
+    void Allocate(size_t size, uint64_t max);
+    void Attach(const uint64_t* image, size_t image_words);
+    void BuildSamples();
+
+    uint64_t Low(size_t idx) const;
+    void SetLow(size_t idx, uint64_t low);
+    uint64_t Value(size_t idx, size_t pos) const;
+    size_t NextOne(size_t pos) const;
+    size_t SelectOne(size_t k) const;
+    size_t SelectZero(size_t k) const;
+
+    //  Owned image, empty when the image is mapped
+    std::vector<uint64_t> storage_;
+    void* mapping_;
+    size_t mapping_bytes_;
+
+    const uint64_t* image_;
+    size_t image_words_;
+
+    size_t size_;
+    uint64_t max_;
+    size_t low_bits_;
+    size_t upper_bits_;
+    const uint64_t* lower_;
+    const uint64_t* upper_;
+    const uint64_t* ones_samples_;
+    const uint64_t* zeros_samples_;
+};
+
+
+//  Position of the k-th set bit of word
+inline size_t EliasFanoSelectInWord(uint64_t word, size_t k) {
+    for (; k > 0; --k) {
+        word &= word - 1;
+    }
+
+    return BitmapLowestBit(word);
+}
+
+
+/*
+ *
+ *      EliasFanoSet implementation
+ *
+ */
+
+inline EliasFanoSet::EliasFanoSet():
+        mapping_{nullptr},
+        mapping_bytes_{0}
+{
+    Allocate(0, 0);
+    BuildSamples();
+}
+
+template <class ForwardIterator>
+EliasFanoSet::EliasFanoSet(
+        ForwardIterator first,
+        ForwardIterator last
+):
+        mapping_{nullptr},
+        mapping_bytes_{0}
+{
+    size_t size = 0;
+    uint64_t max = 0;
+    for (ForwardIterator it = first; it != last; ++it) {
+        if (size > 0 && *it <= max) {
+            throw std::invalid_argument("EliasFanoSet values must be strictly increasing");
+        }
+
+        max = *it;
+        ++size;
+    }
+
+    Allocate(size, max);
+
+    uint64_t* upper = storage_.data() + (upper_ - image_);
+    for (size_t idx = 0; first != last; ++first, ++idx) {
+        uint64_t value = *first;
+        SetLow(idx, low_bits_ ? value & ((uint64_t(1) << low_bits_) - 1) : 0);
+        size_t pos = static_cast<size_t>(value >> low_bits_) + idx;
+        upper[pos >> 6] |= uint64_t(1) << (pos & 63);
+    }
+
+    BuildSamples();
+}
+
+inline EliasFanoSet::EliasFanoSet(
+        const EliasFanoSet& rhs
+):
+        storage_(rhs.image_, rhs.image_ + rhs.image_words_),
+        mapping_{nullptr},
+        mapping_bytes_{0}
+{
+    Attach(storage_.data(), storage_.size());
+}
+
+inline EliasFanoSet::EliasFanoSet(
+        EliasFanoSet&& rhs
+) noexcept:
+        EliasFanoSet()
+{
+    swap(rhs);
+}
+
+inline EliasFanoSet& EliasFanoSet::operator=(EliasFanoSet rhs) noexcept {
+    swap(rhs);
+    return *this;
+}
+
+inline EliasFanoSet::~EliasFanoSet() {
+#if defined(__unix__) || defined(__APPLE__)
+    if (mapping_) {
+        munmap(mapping_, mapping_bytes_);
+    }
+#endif
+}
+
+inline EliasFanoSet::iterator EliasFanoSet::find(uint64_t value) const {
+    iterator it = lower_bound(value);
+    if (it == end() || *it != value) {
+        return end();
+    }
+
+    return it;
+}
+
+//  Values of bucket h follow the h-th zero of upper_, only the
+//  bucket of value is scanned
+inline EliasFanoSet::iterator EliasFanoSet::lower_bound(uint64_t value) const {
+    if (size_ == 0 || value > max_) {
+        return end();
+    }
+
+    uint64_t bucket = value >> low_bits_;
+    size_t idx = 0;
+    size_t pos = 0;
+    if (bucket > 0) {
+        pos = SelectZero(static_cast<size_t>(bucket - 1)) + 1;
+        idx = pos - static_cast<size_t>(bucket);
+    }
+
+    for (pos = NextOne(pos); Value(idx, pos) < value; pos = NextOne(pos + 1)) {
+        ++idx;
+    }
+
+    return iterator(idx, pos, this);
+}
+
+inline size_t EliasFanoSet::rank(uint64_t value) const {
+    iterator it = lower_bound(value);
+    return it == end() ? size_ : it.idx_;
+}
+
+inline uint64_t EliasFanoSet::select(size_t k) const {
+    if (k >= size_) {
+        throw std::out_of_range("EliasFanoSet select out of range");
+    }
+
+    return Value(k, SelectOne(k));
+}
+
+inline size_t EliasFanoSet::size() const {
+    return size_;
+}
+
+inline bool EliasFanoSet::empty() const {
+    return size_ == 0;
+}
+
+inline void EliasFanoSet::swap(EliasFanoSet& rhs) noexcept {
+    std::swap(storage_, rhs.storage_);
+    std::swap(mapping_, rhs.mapping_);
+    std::swap(mapping_bytes_, rhs.mapping_bytes_);
+    std::swap(image_, rhs.image_);
+    std::swap(image_words_, rhs.image_words_);
+    std::swap(size_, rhs.size_);
+    std::swap(max_, rhs.max_);
+    std::swap(low_bits_, rhs.low_bits_);
+    std::swap(upper_bits_, rhs.upper_bits_);
+    std::swap(lower_, rhs.lower_);
+    std::swap(upper_, rhs.upper_);
+    std::swap(ones_samples_, rhs.ones_samples_);
+    std::swap(zeros_samples_, rhs.zeros_samples_);
+}
+
+inline size_t EliasFanoSet::bytes() const {
+    return image_words_ * sizeof(uint64_t);
+}
+
+inline void EliasFanoSet::save(const std::string& path) const {
+    std::FILE* file = std::fopen(path.c_str(), "wb");
+    if (!file) {
+        throw std::runtime_error("Can't create EliasFanoSet file");
+    }
+
+    size_t written = std::fwrite(image_, sizeof(uint64_t), image_words_, file);
+    if (std::fclose(file) != 0 || written != image_words_) {
+        throw std::runtime_error("Can't write EliasFanoSet file");
+    }
+}
+
+inline EliasFanoSet EliasFanoSet::load(const std::string& path) {
+    EliasFanoSet set;
+#if defined(__unix__) || defined(__APPLE__)
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        throw std::runtime_error("Can't open EliasFanoSet file");
+    }
+
+    struct stat info;
+    void* mapping = MAP_FAILED;
+    if (fstat(fd, &info) == 0 && info.st_size > 0) {
+        mapping = mmap(nullptr, static_cast<size_t>(info.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+    }
+
+    close(fd);
+    if (mapping == MAP_FAILED) {
+        throw std::runtime_error("Can't map EliasFanoSet file");
+    }
+
+    set.storage_.clear();
+    set.mapping_ = mapping;
+    set.mapping_bytes_ = static_cast<size_t>(info.st_size);
+    set.Attach(static_cast<const uint64_t*>(mapping), set.mapping_bytes_ / sizeof(uint64_t));
+#else
+    std::FILE* file = std::fopen(path.c_str(), "rb");
+    if (!file) {
+        throw std::runtime_error("Can't open EliasFanoSet file");
+    }
+
+    std::vector<uint64_t> words;
+    uint64_t word;
+    while (std::fread(&word, sizeof(word), 1, file) == 1) {
+        words.push_back(word);
+    }
+
+    std::fclose(file);
+    set.storage_.swap(words);
+    set.Attach(set.storage_.data(), set.storage_.size());
+#endif
+    return set;
+}
+
+//  low_bits = floor(log2(max / size)) balances the unary upper part
+//  against the plain lower part
+inline void EliasFanoSet::Allocate(size_t size, uint64_t max) {
+    size_t low_bits = 0;
+    if (size > 0) {
+        while (low_bits < 63 && (max / size) >> (low_bits + 1)) {
+            ++low_bits;
+        }
+    }
+
+    size_t upper_bits = size + static_cast<size_t>(max >> low_bits) + 1;
+    size_t lower_words = (size * low_bits + 63) / 64;
+    size_t upper_words = (upper_bits + 63) / 64;
+    size_t ones_samples = (size + elias_fano_sample_rate - 1) / elias_fano_sample_rate;
+    size_t zeros_samples = (upper_bits - size + elias_fano_sample_rate - 1) / elias_fano_sample_rate;
+
+    storage_.assign(kHeaderWords + lower_words + upper_words + ones_samples + zeros_samples, 0);
+    storage_[kMagic] = elias_fano_magic;
+    storage_[kSize] = size;
+    storage_[kMax] = max;
+    storage_[kLowBits] = low_bits;
+    storage_[kLowerWords] = lower_words;
+    storage_[kUpperBits] = upper_bits;
+    storage_[kOnesSamples] = ones_samples;
+    storage_[kZerosSamples] = zeros_samples;
+    Attach(storage_.data(), storage_.size());
+}
+
+inline void EliasFanoSet::Attach(const uint64_t* image, size_t image_words) {
+    if (image_words < kHeaderWords || image[kMagic] != elias_fano_magic) {
+        throw std::runtime_error("Not an EliasFanoSet image");
+    }
+
+    size_t upper_words = static_cast<size_t>((image[kUpperBits] + 63) / 64);
+    if (image_words != kHeaderWords + image[kLowerWords] + upper_words +
+                       image[kOnesSamples] + image[kZerosSamples]) {
+        throw std::runtime_error("Truncated EliasFanoSet image");
+    }
+
+    image_ = image;
+    image_words_ = image_words;
+    size_ = static_cast<size_t>(image[kSize]);
+    max_ = image[kMax];
+    low_bits_ = static_cast<size_t>(image[kLowBits]);
+    upper_bits_ = static_cast<size_t>(image[kUpperBits]);
+    lower_ = image + kHeaderWords;
+    upper_ = lower_ + image[kLowerWords];
+    ones_samples_ = upper_ + upper_words;
+    zeros_samples_ = ones_samples_ + image[kOnesSamples];
+}
+
+inline void EliasFanoSet::BuildSamples() {
+    uint64_t* ones = storage_.data() + (ones_samples_ - image_);
+    uint64_t* zeros = storage_.data() + (zeros_samples_ - image_);
+    size_t ones_seen = 0;
+    size_t zeros_seen = 0;
+    for (size_t pos = 0; pos < upper_bits_; ++pos) {
+        if ((upper_[pos >> 6] >> (pos & 63)) & 1) {
+            if (ones_seen % elias_fano_sample_rate == 0) {
+                ones[ones_seen / elias_fano_sample_rate] = pos;
+            }
+
+            ++ones_seen;
+
+        } else {
+            if (zeros_seen % elias_fano_sample_rate == 0) {
+                zeros[zeros_seen / elias_fano_sample_rate] = pos;
+            }
+
+            ++zeros_seen;
+        }
+    }
+}
+
+inline uint64_t EliasFanoSet::Low(size_t idx) const {
+    if (low_bits_ == 0) {
+        return 0;
+    }
+
+    size_t bit = idx * low_bits_;
+    uint64_t mask = (uint64_t(1) << low_bits_) - 1;
+    uint64_t low = lower_[bit >> 6] >> (bit & 63);
+    if ((bit & 63) + low_bits_ > 64) {
+        low |= lower_[(bit >> 6) + 1] << (64 - (bit & 63));
+    }
+
+    return low & mask;
+}
+
+inline void EliasFanoSet::SetLow(size_t idx, uint64_t low) {
+    if (low_bits_ == 0) {
+        return;
+    }
+
+    uint64_t* lower = storage_.data() + (lower_ - image_);
+    size_t bit = idx * low_bits_;
+    lower[bit >> 6] |= low << (bit & 63);
+    if ((bit & 63) + low_bits_ > 64) {
+        lower[(bit >> 6) + 1] |= low >> (64 - (bit & 63));
+    }
+}
+
+inline uint64_t EliasFanoSet::Value(size_t idx, size_t pos) const {
+    return (uint64_t(pos - idx) << low_bits_) | Low(idx);
+}
+
+//  Position of the first one at or after pos, there always is one
+//  while pos is not past the last value
+inline size_t EliasFanoSet::NextOne(size_t pos) const {
+    size_t word_idx = pos >> 6;
+    uint64_t word = upper_[word_idx] & (~uint64_t(0) << (pos & 63));
+    while (!word) {
+        word = upper_[++word_idx];
+    }
+
+    return (word_idx << 6) + BitmapLowestBit(word);
+}
+
+inline size_t EliasFanoSet::SelectOne(size_t k) const {
+    size_t pos = static_cast<size_t>(ones_samples_[k / elias_fano_sample_rate]);
+    k %= elias_fano_sample_rate;
+
+    size_t word_idx = pos >> 6;
+    uint64_t word = upper_[word_idx] & (~uint64_t(0) << (pos & 63));
+    size_t count = BitmapPopCount(word);
+    while (k >= count) {
+        k -= count;
+        word = upper_[++word_idx];
+        count = BitmapPopCount(word);
+    }
+
+    return (word_idx << 6) + EliasFanoSelectInWord(word, k);
+}
+
+inline size_t EliasFanoSet::SelectZero(size_t k) const {
+    size_t pos = static_cast<size_t>(zeros_samples_[k / elias_fano_sample_rate]);
+    k %= elias_fano_sample_rate;
+
+    size_t word_idx = pos >> 6;
+    uint64_t word = ~upper_[word_idx] & (~uint64_t(0) << (pos & 63));
+    size_t count = BitmapPopCount(word);
+    while (k >= count) {
+        k -= count;
+        word = ~upper_[++word_idx];
+        count = BitmapPopCount(word);
+    }
+
+    return (word_idx << 6) + EliasFanoSelectInWord(word, k);
+}
+
+/*
+ *
+ *      Iterator implementation
+ *
+ */
+
+inline EliasFanoSet::iterator EliasFanoSet::begin() const {
+    if (size_ == 0) {
+        return end();
+    }
+
+    return iterator(0, NextOne(0), this);
+}
+
+inline EliasFanoSet::iterator EliasFanoSet::end() const {
+    return iterator(size_, 0, this);
+}
+
+inline EliasFanoSet::iterator::iterator(
+        size_t idx,
+        size_t pos,
+        const EliasFanoSet* set
+):
+        idx_{idx},
+        pos_{pos},
+        value_{idx < set->size_ ? set->Value(idx, pos) : 0},
+        set_{set}
+{}
+
+inline EliasFanoSet::iterator& EliasFanoSet::iterator::operator++() {
+    if (++idx_ == set_->size_) {
+        pos_ = 0;
+        value_ = 0;
+        return *this;
+    }
+
+    pos_ = set_->NextOne(pos_ + 1);
+    value_ = set_->Value(idx_, pos_);
+    return *this;
+}
+
+inline EliasFanoSet::iterator EliasFanoSet::iterator::operator++(int) {
+    iterator cpy(*this);
+    this->operator++();
+    return cpy;
+}
+
+inline const uint64_t& EliasFanoSet::iterator::operator*() {
+    return value_;
+}
+
+inline const uint64_t* EliasFanoSet::iterator::operator->() {
+    return &value_;
+}
+
+inline bool EliasFanoSet::iterator::operator==(const iterator& rhs) const {
+    return idx_ == rhs.idx_;
+}
+
+inline bool EliasFanoSet::iterator::operator!=(const iterator& rhs) const {
+    return !(*this == rhs);
+}
+
+#endif //DATA_STRUCTURES_ELIAS_FANO_SET_H
@@ -0,0 +1,235 @@
+//
+// Created by alexaxnder on 19.10.26.
+//
+
+#ifndef DATA_STRUCTURES_EPOCH_ALLOCATOR_H
+#define DATA_STRUCTURES_EPOCH_ALLOCATOR_H
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <vector>
+
+
+//  Readers are counted in this many stripes of one cache line each.
+//  Threads take stripes round-robin in the order they first enter, so up
+//  to this many reader threads never write a shared line, more share.
+constexpr size_t epoch_reader_stripes = 16;
+constexpr size_t epoch_stripe_bytes = 64;
+
+
+/*
+ *      Epoch based deferred reclamation for one writer and many readers
+ *
+ *      A reader pins the current epoch for the time it may hold pointers
+ *      into the structure. The writer retires unlinked blocks instead of
+ *      freeing them. Retired blocks wait until the epoch is advanced and
+ *      every reader pinned in the old epoch is gone, then they are freed.
+ *      Epochs advance only when the previous grace period is over, so two
+ *      reader counters (by epoch parity) are enough.
+ *
+ *      Enter and Exit may be called from any thread,
+ *      Retire and Reclaim from the writer thread only.
+ *
+ *      How reader throughput scales with the number of reader threads
+ *      has not been measured, only one core was available so far.
+ */
+class EpochDomain {
+public:
+    EpochDomain() = default;
+    ~EpochDomain();
+
+    EpochDomain(const EpochDomain&) = delete;
+    EpochDomain& operator=(const EpochDomain&) = delete;
+
+    //  Returns the pin to pass to Exit
+    size_t Enter();
+    void Exit(size_t pin);
+
+    void Retire(void* block);
+
+    //  Never waits for readers, frees what is already safe to free
+    void Reclaim();
+
+private:
+    //  Before C++17 operator new may ignore the alignment, a stripe
+    //  still fills a whole line so two stripes never share one
+    struct alignas(epoch_stripe_bytes) Stripe {
+        std::atomic<size_t> readers[2];
+    };
+
+    Stripe stripes_[epoch_reader_stripes] = {};
+    std::atomic<size_t> epoch_{0};
+
+    //  retired_ wait for the next epoch, grace_ for readers of the previous one
+    std::vector<void*> retired_;
+    std::vector<void*> grace_;
+
+    static size_t ThreadStripe();
+    bool Drained(size_t parity) const;
+    void Free(std::vector<void*>& blocks);
+};
+
+
+/*
+ *      Allocator whose deallocation retires blocks to an EpochDomain
+ *
+ *      Default constructed allocator owns a new domain, copies and
+ *      rebinds share it. Values are destroyed at once, so readers may
+ *      only look at trivially destructible values of retired blocks.
+ */
+template <class T>
+class EpochAllocator {
+    template <class U>
+    friend class EpochAllocator;
+
+public:
+    typedef T value_type;
+
+    EpochAllocator();
+
+    template <class U>
+    EpochAllocator(const EpochAllocator<U>& rhs) noexcept;
+
+    T* allocate(size_t n);
+    void deallocate(T* ptr, size_t n) noexcept;
+
+    EpochDomain& domain() const noexcept;
+
+    template <class U>
+    bool operator==(const EpochAllocator<U>& rhs) const noexcept;
+    template <class U>
+    bool operator!=(const EpochAllocator<U>& rhs) const noexcept;
+
+private:
+    std::shared_ptr<EpochDomain> domain_;
+};
+
+
+//  Whether nodes of the allocator are read by lock-free readers,
+//  so containers store the links those readers follow atomically
+template <class Allocator>
+struct HasConcurrentReaders: std::false_type {};
+
+template <class T>
+struct HasConcurrentReaders<EpochAllocator<T>>: std::true_type {};
+
+
+/*
+ *      EpochDomain implementation
+ */
+inline EpochDomain::~EpochDomain() {
+    Free(grace_);
+    Free(retired_);
+}
+
+//  Rechecking the epoch after announcing keeps a late reader from
+//  joining a parity whose grace period the writer is already waiting out
+inline size_t EpochDomain::Enter() {
+    Stripe& stripe = stripes_[ThreadStripe()];
+    for (;;) {
+        size_t epoch = epoch_.load();
+        stripe.readers[epoch & 1].fetch_add(1);
+        if (epoch_.load() == epoch) {
+            return ThreadStripe() * 2 + (epoch & 1);
+        }
+
+        stripe.readers[epoch & 1].fetch_sub(1);
+    }
+}
+
+inline void EpochDomain::Exit(size_t pin) {
+    stripes_[pin / 2].readers[pin % 2].fetch_sub(1);
+}
+
+inline void EpochDomain::Retire(void* block) {
+    retired_.push_back(block);
+}
+
+inline void EpochDomain::Reclaim() {
+    size_t epoch = epoch_.load(std::memory_order_relaxed);
+    if (!grace_.empty()) {
+        if (!Drained((epoch - 1) & 1)) {
+            return;
+        }
+
+        Free(grace_);
+    }
+
+    if (!retired_.empty()) {
+        grace_.swap(retired_);
+        epoch_.store(epoch + 1);
+    }
+}
+
+inline size_t EpochDomain::ThreadStripe() {
+    static std::atomic<size_t> next_stripe{0};
+    static thread_local size_t stripe =
+            next_stripe.fetch_add(1, std::memory_order_relaxed) % epoch_reader_stripes;
+    return stripe;
+}
+
+inline bool EpochDomain::Drained(size_t parity) const {
+    for (const Stripe& stripe : stripes_) {
+        if (stripe.readers[parity].load() != 0) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+inline void EpochDomain::Free(std::vector<void*>& blocks) {
+    for (void* block : blocks) {
+        ::operator delete(block);
+    }
+
+    blocks.clear();
+}
+
+
+/*
+ *      EpochAllocator implementation
+ */
+template <class T>
+EpochAllocator<T>::EpochAllocator()
+        : domain_(std::make_shared<EpochDomain>()) {}
+
+template <class T>
+template <class U>
+EpochAllocator<T>::EpochAllocator(const EpochAllocator<U>& rhs) noexcept
+        : domain_(rhs.domain_) {}
+
+template <class T>
+T* EpochAllocator<T>::allocate(size_t n) {
+    return static_cast<T*>(::operator new(n * sizeof(T)));
+}
+
+//  Retire may only fail to grow its list, then the block is leaked
+template <class T>
+void EpochAllocator<T>::deallocate(T* ptr, size_t) noexcept {
+    try {
+        domain_->Retire(ptr);
+    } catch (const std::bad_alloc&) {}
+}
+
+template <class T>
+EpochDomain& EpochAllocator<T>::domain() const noexcept {
+    return *domain_;
+}
+
+template <class T>
+template <class U>
+bool EpochAllocator<T>::operator==(const EpochAllocator<U>& rhs) const noexcept {
+    return domain_ == rhs.domain_;
+}
+
+template <class T>
+template <class U>
+bool EpochAllocator<T>::operator!=(const EpochAllocator<U>& rhs) const noexcept {
+    return domain_ != rhs.domain_;
+}
+
+#endif //DATA_STRUCTURES_EPOCH_ALLOCATOR_H
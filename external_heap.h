@@ -0,0 +1,400 @@
+//
+// Created by alexaxnder on 19.10.26.
+//
+
+#ifndef DATA_STRUCTURES_EXTERNAL_HEAP_H
+#define DATA_STRUCTURES_EXTERNAL_HEAP_H
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <future>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "heap.h"
+
+
+/*
+ *      External memory priority queue
+ *
+ *      New items go to the in-memory insertion Heap. When it reaches
+ *      its capacity it is drained in sorted order into a temporary run file.
+ *      Runs are read back block by block and merged by a small Heap
+ *      which keeps the current head of every run.
+ *
+ *      Memory budget is split in half: one half for the insertion Heap,
+ *      another for the run blocks (one read block per run plus one write
+ *      block). A run's block is used as two halves: while one is consumed
+ *      the other is read ahead asynchronously. When there is no room for
+ *      one more run block a group of the smallest runs is merged into one
+ *      before spilling, so an item is rewritten a few times per growth of
+ *      the input in size classes, not once per spill.
+ *
+ *      Items are written as raw bytes so they must be trivially copyable.
+ */
+template <class Item, class Compare = std::less<Item>>
+class ExternalHeap {
+    static_assert(std::is_trivially_copyable<Item>::value,
+                  "ExternalHeap items are spilled as raw bytes");
+
+public:
+    explicit ExternalHeap(size_t memory_budget, size_t block_size = 1 << 20);
+    ~ExternalHeap();
+
+    ExternalHeap(const ExternalHeap&) = delete;
+    ExternalHeap& operator=(const ExternalHeap&) = delete;
+
+    void Insert(const Item&);
+
+    Item GetHead();
+    Item ExtractHead();
+    size_t Size();
+    bool Empty();
+    size_t RunsNumber();
+
+private:
+    struct Run {
+        std::FILE* file;
+        std::vector<Item> block;
+        size_t pos;
+        size_t left_in_file;
+        std::future<std::vector<Item>> next_block;
+        size_t next_items;
+    };
+
+    typedef std::pair<Item, size_t> RunHead;
+
+    struct RunHeadCompare {
+        Compare cmp;
+        bool operator()(const RunHead& lhs, const RunHead& rhs) const {
+            return cmp(lhs.first, rhs.first);
+        }
+    };
+
+    typedef Heap<RunHead, RunHeadCompare> MergeHeap;
+
+    Heap<Item, Compare> buffer_;
+    MergeHeap merge_heap_;
+    std::vector<Run> runs_;
+    size_t live_runs_;
+    Compare cmp_;
+
+    size_t buffer_capacity_;
+    size_t block_items_;
+    size_t read_items_;
+    size_t max_runs_;
+    size_t size_;
+
+    bool HeadInBuffer();
+    void Spill();
+    void MergeRuns();
+    void OpenRun(std::FILE* file, size_t items_number);
+    void CloseRun(size_t idx);
+    void ReadBlock(Run& run);
+    void ReadAhead(Run& run);
+    void AdvanceRun(size_t idx, MergeHeap& heap);
+    size_t RunItems(size_t idx);
+
+    std::FILE* NewRunFile();
+    void WriteBlock(std::FILE* file, std::vector<Item>& block);
+    static std::vector<Item> ReadFromFile(std::FILE* file, size_t items_number);
+};
+
+
+/*
+ *      ExternalHeap implementation
+ */
+template <class Item, class Compare>
+ExternalHeap<Item, Compare>::ExternalHeap(size_t memory_budget, size_t block_size)
+        : live_runs_(0), size_(0) {
+    block_items_ = block_size / sizeof(Item);
+    buffer_capacity_ = memory_budget / 2 / sizeof(Item);
+    if (block_items_ == 0 || memory_budget / 2 < 3 * block_size) {
+        throw std::invalid_argument(
+                "ExternalHeap memory budget must hold at least six blocks");
+    }
+
+    //  One block is always kept for writing
+    max_runs_ = memory_budget / 2 / block_size - 1;
+    read_items_ = std::max<size_t>(1, block_items_ / 2);
+    buffer_.Reserve(buffer_capacity_);
+}
+
+template <class Item, class Compare>
+ExternalHeap<Item, Compare>::~ExternalHeap() {
+    for (size_t i = 0; i < runs_.size(); ++i) {
+        CloseRun(i);
+    }
+}
+
+template <class Item, class Compare>
+void ExternalHeap<Item, Compare>::Insert(const Item& item) {
+    if (buffer_.Size() == buffer_capacity_) {
+        Spill();
+    }
+
+    buffer_.Insert(item);
+    ++size_;
+}
+
+template <class Item, class Compare>
+Item ExternalHeap<Item, Compare>::GetHead() {
+    if (HeadInBuffer()) {
+        return buffer_.GetHead();
+    }
+
+    return merge_heap_.GetHead().first;
+}
+
+template <class Item, class Compare>
+Item ExternalHeap<Item, Compare>::ExtractHead() {
+    --size_;
+    if (HeadInBuffer()) {
+        return buffer_.ExtractHead();
+    }
+
+    RunHead head = merge_heap_.ExtractHead();
+    AdvanceRun(head.second, merge_heap_);
+    return head.first;
+}
+
+template <class Item, class Compare>
+size_t ExternalHeap<Item, Compare>::Size() {
+    return size_;
+}
+
+template <class Item, class Compare>
+bool ExternalHeap<Item, Compare>::Empty() {
+    return size_ == 0;
+}
+
+template <class Item, class Compare>
+size_t ExternalHeap<Item, Compare>::RunsNumber() {
+    return live_runs_;
+}
+
+template <class Item, class Compare>
+bool ExternalHeap<Item, Compare>::HeadInBuffer() {
+    if (merge_heap_.Empty()) {
+        return true;
+    }
+
+    return !buffer_.Empty() && !cmp_(merge_heap_.GetHead().first, buffer_.GetHead());
+}
+
+template <class Item, class Compare>
+void ExternalHeap<Item, Compare>::Spill() {
+    if (live_runs_ + 1 > max_runs_) {
+        MergeRuns();
+    }
+
+    std::FILE* file = NewRunFile();
+    size_t items_number = buffer_.Size();
+
+    std::vector<Item> block;
+    block.reserve(block_items_);
+    while (!buffer_.Empty()) {
+        block.push_back(buffer_.ExtractHead());
+        if (block.size() == block_items_) {
+            WriteBlock(file, block);
+        }
+    }
+
+    WriteBlock(file, block);
+    OpenRun(file, items_number);
+}
+
+//  Size-tiered merge: the group starts with the two smallest runs and
+//  takes the next one while it is no larger than the group so far.
+//  Merging all runs every time would rewrite the largest run on each
+//  spill and make the written volume quadratic in the input size
+template <class Item, class Compare>
+void ExternalHeap<Item, Compare>::MergeRuns() {
+    std::vector<size_t> order;
+    for (size_t i = 0; i < runs_.size(); ++i) {
+        if (runs_[i].file) {
+            order.push_back(i);
+        }
+    }
+
+    std::sort(order.begin(), order.end(), [this](size_t lhs, size_t rhs) {
+        return RunItems(lhs) < RunItems(rhs);
+    });
+
+    size_t group = std::min<size_t>(2, order.size());
+    size_t group_items = 0;
+    for (size_t i = 0; i < group; ++i) {
+        group_items += RunItems(order[i]);
+    }
+
+    while (group < order.size() && RunItems(order[group]) <= group_items) {
+        group_items += RunItems(order[group]);
+        ++group;
+    }
+
+    MergeHeap group_heap;
+    for (size_t i = 0; i < group; ++i) {
+        Run& run = runs_[order[i]];
+        group_heap.Insert(RunHead(run.block[run.pos], order[i]));
+    }
+
+    std::FILE* file = NewRunFile();
+    size_t items_number = 0;
+
+    std::vector<Item> block;
+    block.reserve(block_items_);
+    while (!group_heap.Empty()) {
+        RunHead head = group_heap.ExtractHead();
+        AdvanceRun(head.second, group_heap);
+        block.push_back(head.first);
+        ++items_number;
+        if (block.size() == block_items_) {
+            WriteBlock(file, block);
+        }
+    }
+
+    WriteBlock(file, block);
+
+    //  Run indices change, so the merge heap is rebuilt over the rest
+    std::vector<Run> live_runs;
+    std::vector<RunHead> heads;
+    for (Run& run : runs_) {
+        if (run.file) {
+            heads.push_back(RunHead(run.block[run.pos], live_runs.size()));
+            live_runs.push_back(std::move(run));
+        }
+    }
+
+    runs_.swap(live_runs);
+    MergeHeap rebuilt(&heads);
+    merge_heap_.Swap(rebuilt);
+    OpenRun(file, items_number);
+}
+
+template <class Item, class Compare>
+void ExternalHeap<Item, Compare>::OpenRun(std::FILE* file, size_t items_number) {
+    if (std::fflush(file) != 0 || std::fseek(file, 0, SEEK_SET) != 0) {
+        throw std::runtime_error("Can't rewind ExternalHeap run file");
+    }
+
+    runs_.push_back(Run{file, std::vector<Item>(), 0, items_number,
+                        std::future<std::vector<Item>>(), 0});
+    ++live_runs_;
+
+    size_t idx = runs_.size() - 1;
+    ReadAhead(runs_[idx]);
+    ReadBlock(runs_[idx]);
+    if (runs_[idx].block.empty()) {
+        CloseRun(idx);
+        return;
+    }
+
+    merge_heap_.Insert(RunHead(runs_[idx].block.front(), idx));
+}
+
+template <class Item, class Compare>
+void ExternalHeap<Item, Compare>::CloseRun(size_t idx) {
+    Run& run = runs_[idx];
+    if (!run.file) {
+        return;
+    }
+
+    //  A read may still be in flight, its errors don't matter any more
+    if (run.next_block.valid()) {
+        run.next_block.wait();
+    }
+
+    std::fclose(run.file);
+    run.file = nullptr;
+    std::vector<Item>().swap(run.block);
+    --live_runs_;
+}
+
+//  Takes the block read ahead and starts reading the one after it
+template <class Item, class Compare>
+void ExternalHeap<Item, Compare>::ReadBlock(Run& run) {
+    run.pos = 0;
+    if (!run.next_block.valid()) {
+        run.block.clear();
+        return;
+    }
+
+    run.block = run.next_block.get();
+    run.next_items = 0;
+    ReadAhead(run);
+}
+
+template <class Item, class Compare>
+void ExternalHeap<Item, Compare>::ReadAhead(Run& run) {
+    size_t items_number = std::min(read_items_, run.left_in_file);
+    if (items_number == 0) {
+        return;
+    }
+
+    run.next_block = std::async(std::launch::async, &ExternalHeap::ReadFromFile,
+                                run.file, items_number);
+    run.next_items = items_number;
+    run.left_in_file -= items_number;
+}
+
+template <class Item, class Compare>
+void ExternalHeap<Item, Compare>::AdvanceRun(size_t idx, MergeHeap& heap) {
+    Run& run = runs_[idx];
+    if (++run.pos == run.block.size()) {
+        ReadBlock(run);
+    }
+
+    if (run.block.empty()) {
+        CloseRun(idx);
+        return;
+    }
+
+    heap.Insert(RunHead(run.block[run.pos], idx));
+}
+
+template <class Item, class Compare>
+size_t ExternalHeap<Item, Compare>::RunItems(size_t idx) {
+    const Run& run = runs_[idx];
+    return run.block.size() - run.pos + run.next_items + run.left_in_file;
+}
+
+template <class Item, class Compare>
+std::FILE* ExternalHeap<Item, Compare>::NewRunFile() {
+    std::FILE* file = std::tmpfile();
+    if (!file) {
+        throw std::runtime_error("Can't create ExternalHeap run file");
+    }
+
+    //  Blocks are already large, stdio buffering would only copy them
+    std::setvbuf(file, nullptr, _IONBF, 0);
+    return file;
+}
+
+template <class Item, class Compare>
+void ExternalHeap<Item, Compare>::WriteBlock(std::FILE* file, std::vector<Item>& block) {
+    if (block.empty()) {
+        return;
+    }
+
+    if (std::fwrite(block.data(), sizeof(Item), block.size(), file) != block.size()) {
+        throw std::runtime_error("Can't write ExternalHeap run file");
+    }
+
+    block.clear();
+}
+
+template <class Item, class Compare>
+std::vector<Item> ExternalHeap<Item, Compare>::ReadFromFile(std::FILE* file, size_t items_number) {
+    std::vector<Item> block(items_number);
+    if (std::fread(block.data(), sizeof(Item), items_number, file) != items_number) {
+        throw std::runtime_error("Can't read ExternalHeap run file");
+    }
+
+    return block;
+}
+
+#endif //DATA_STRUCTURES_EXTERNAL_HEAP_H
@@ -8,10 +8,19 @@
 #include <vector>
 #include <cstdlib>
 #include <iostream>
+#include <thread>
 
 #include "hash_map.h"
 
 
+//  Heaps smaller than this are built by one thread. Starting and joining
+//  a thread costs about 18 us and heapifying costs about 11 ns per int,
+//  so here even 8 threads cost under a fifth of the serial build
+constexpr size_t heap_parallel_threshold = 1 << 16;
+//  InsertRange re-heapifies when batch * ratio >= heap size
+constexpr size_t heap_batch_insert_ratio = 8;
+
+
 template <class Item, class Compare>
 class Heap {
 public:
@@ -19,18 +28,22 @@ public:
     ~Heap() = default;
     Heap(const Heap&);
     explicit Heap(std::vector<Item>*);
+    Heap(std::vector<Item>*, size_t threads_number);
 
     Heap& operator=(Heap);
     void Swap(Heap&);
 
     template <class U>
     size_t Insert(U&&);
+    template <class InputIterator>
+    void InsertRange(InputIterator first, InputIterator last);
     void Remove(size_t);
 
     Item GetHead();
     Item ExtractHead();
     size_t Size();
     bool Empty();
+    void Reserve(size_t);
     void Print(std::ostream& out = std::cout);
 
 private:
@@ -41,6 +54,8 @@ private:
     size_t SiftDown(size_t idx);
 
     void MakeHeap();
+    void MakeHeap(size_t threads_number);
+    void HeapifySubtree(size_t root);
 
     size_t Parent(size_t idx);
     size_t LeftChild(size_t idx);
@@ -98,6 +113,12 @@ Heap<Item, Compare>::Heap(std::vector<Item>* items) {
     MakeHeap();
 }
 
+template <class Item, class Compare>
+Heap<Item, Compare>::Heap(std::vector<Item>* items, size_t threads_number) {
+    data_ = std::move(*items);
+    MakeHeap(threads_number);
+}
+
 template <class Item, class Compare>
 template <class U>
 size_t Heap<Item, Compare>::Insert(U&& item) {
@@ -105,6 +126,38 @@ size_t Heap<Item, Compare>::Insert(U&& item) {
     return SiftUp(Size() - 1);
 }
 
+template <class Item, class Compare>
+template <class InputIterator>
+void Heap<Item, Compare>::InsertRange(InputIterator first, InputIterator last) {
+    size_t old_size = Size();
+    data_.insert(data_.end(), first, last);
+    if (old_size == 0) {
+        MakeHeap();
+        return;
+    }
+
+    //  Small batch is cheaper to sift up item by item
+    if ((Size() - old_size) * heap_batch_insert_ratio < old_size) {
+        for (size_t i = old_size; i < Size(); ++i) {
+            SiftUp(i);
+        }
+        return;
+    }
+
+    //  Otherwise sift down only the ancestors of new items level by level.
+    //  Children always have greater indices, so going down the index range
+    //  visits every subtree after its children.
+    size_t lo = old_size;
+    size_t hi = Size() - 1;
+    do {
+        lo = (lo - 1) / 2;
+        hi = (hi - 1) / 2;
+        for (size_t i = hi + 1; i > lo; --i) {
+            SiftDown(i - 1);
+        }
+    } while (lo > 0);
+}
+
 template <class Item, class Compare>
 void Heap<Item, Compare>::Remove(size_t idx) {
     //  If idx is the last element just remove it
@@ -143,6 +196,59 @@ void Heap<Item, Compare>::MakeHeap() {
     }
 }
 
+template <class Item, class Compare>
+void Heap<Item, Compare>::MakeHeap(size_t threads_number) {
+    if (threads_number <= 1 || Size() < heap_parallel_threshold) {
+        MakeHeap();
+        return;
+    }
+
+    //  Subtrees of one level are independent, so they are heapified
+    //  concurrently. The level is deep enough to balance the threads.
+    size_t level_begin = 0;
+    size_t level_size = 1;
+    while (level_size < 4 * threads_number) {
+        level_begin += level_size;
+        level_size *= 2;
+    }
+
+    std::vector<std::thread> threads;
+    for (size_t thread_idx = 0; thread_idx < threads_number; ++thread_idx) {
+        threads.emplace_back([this, thread_idx, threads_number, level_begin, level_size]() {
+            for (size_t root = level_begin + thread_idx;
+                 root < level_begin + level_size;
+                 root += threads_number) {
+                HeapifySubtree(root);
+            }
+        });
+    }
+
+    for (auto& thread : threads) {
+        thread.join();
+    }
+
+    //  Top levels are left
+    for (size_t i = level_begin; i > 0; --i) {
+        SiftDown(i - 1);
+    }
+}
+
+template <class Item, class Compare>
+void Heap<Item, Compare>::HeapifySubtree(size_t root) {
+    //  First index and width of every subtree level
+    std::vector<std::pair<size_t, size_t>> levels;
+    for (size_t first = root, width = 1; first < Size(); first = 2 * first + 1, width *= 2) {
+        levels.emplace_back(first, width);
+    }
+
+    for (auto level = levels.rbegin(); level != levels.rend(); ++level) {
+        size_t last = std::min(level->first + level->second, Size());
+        for (size_t i = last; i > level->first; --i) {
+            SiftDown(i - 1);
+        }
+    }
+}
+
 template <class Item, class Compare>
 size_t Heap<Item, Compare>::Size() {
     return data_.size();
@@ -153,6 +259,11 @@ bool Heap<Item, Compare>::Empty() {
     return Size() == 0;
 }
 
+template <class Item, class Compare>
+void Heap<Item, Compare>::Reserve(size_t capacity) {
+    data_.reserve(capacity);
+}
+
 template <class Item, class Compare>
 void Heap<Item, Compare>::Print(std::ostream& out) {
     for (const auto& item : data_) {
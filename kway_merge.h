@@ -0,0 +1,369 @@
+//
+// Created by alexaxnder on 19.10.26.
+//
+
+#ifndef DATA_STRUCTURES_KWAY_MERGE_H
+#define DATA_STRUCTURES_KWAY_MERGE_H
+
+#include <algorithm>
+#include <cstdlib>
+#include <functional>
+#include <iterator>
+#include <thread>
+#include <utility>
+#include <vector>
+
+
+//  ParallelKWayMerge draws this many splitter samples per thread
+constexpr size_t parallel_merge_oversampling = 32;
+
+
+/*
+ *      Merge sources
+ *
+ *      Any type with
+ *          bool Empty();
+ *          const Item& Head();
+ *          void Pop();
+ *      can be merged by LoserTree.
+ */
+template <class Iterator>
+class RangeSource {
+public:
+    typedef typename std::iterator_traits<Iterator>::value_type Item;
+
+    RangeSource(Iterator first, Iterator last);
+
+    bool Empty();
+    const Item& Head();
+    void Pop();
+
+private:
+    Iterator cur_;
+    Iterator last_;
+};
+
+
+//  Streaming reader adapter: reader(&item) fills the next item
+//  and returns false when the stream is over
+template <class Item, class Reader>
+class ReaderSource {
+public:
+    explicit ReaderSource(Reader reader);
+
+    bool Empty();
+    const Item& Head();
+    void Pop();
+
+private:
+    Reader reader_;
+    Item head_;
+    bool empty_;
+};
+
+
+/*
+ *      Loser tree over k sources
+ *
+ *      Every Pop replays one leaf-to-root path of ceil(log2 k) comparisons,
+ *      half of what Heap's ExtractHead + Insert costs for the same step.
+ *      Equal items are emitted in the order of their sources, so the merge
+ *      is stable.
+ */
+template <class Item, class Source, class Compare = std::less<Item>>
+class LoserTree {
+public:
+    explicit LoserTree(std::vector<Source> sources, Compare cmp = Compare());
+
+    bool Empty();
+    const Item& GetHead();
+    size_t HeadSource();
+    void Pop();
+
+    template <class Callback>
+    void MergeTo(Callback&& callback);
+
+private:
+    std::vector<Source> sources_;
+    std::vector<size_t> tree_;  //  tree_[0] is the winner, others are losers
+    Compare cmp_;
+
+    bool Beats(size_t lhs, size_t rhs);
+    void Build();
+    void Replay(size_t source);
+};
+
+
+//  Merges sorted ranges [first_i, last_i) into out
+template <class Iterator, class OutputIterator, class Compare = std::less<
+        typename std::iterator_traits<Iterator>::value_type>>
+OutputIterator KWayMerge(const std::vector<std::pair<Iterator, Iterator>>& ranges,
+                         OutputIterator out, Compare cmp = Compare());
+
+
+//  Same as KWayMerge but splits the key space into threads_number parts
+//  and merges them concurrently. Needs random access input and output.
+template <class Iterator, class OutputIterator, class Compare = std::less<
+        typename std::iterator_traits<Iterator>::value_type>>
+OutputIterator ParallelKWayMerge(const std::vector<std::pair<Iterator, Iterator>>& ranges,
+                                 OutputIterator out, size_t threads_number,
+                                 Compare cmp = Compare());
+
+
+/*
+ *      RangeSource implementation
+ */
+template <class Iterator>
+RangeSource<Iterator>::RangeSource(Iterator first, Iterator last)
+        : cur_(first), last_(last) {}
+
+template <class Iterator>
+bool RangeSource<Iterator>::Empty() {
+    return cur_ == last_;
+}
+
+template <class Iterator>
+const typename RangeSource<Iterator>::Item& RangeSource<Iterator>::Head() {
+    return *cur_;
+}
+
+template <class Iterator>
+void RangeSource<Iterator>::Pop() {
+    ++cur_;
+}
+
+
+/*
+ *      ReaderSource implementation
+ */
+template <class Item, class Reader>
+ReaderSource<Item, Reader>::ReaderSource(Reader reader)
+        : reader_(std::move(reader)), head_(), empty_(false) {
+    Pop();
+}
+
+template <class Item, class Reader>
+bool ReaderSource<Item, Reader>::Empty() {
+    return empty_;
+}
+
+template <class Item, class Reader>
+const Item& ReaderSource<Item, Reader>::Head() {
+    return head_;
+}
+
+template <class Item, class Reader>
+void ReaderSource<Item, Reader>::Pop() {
+    empty_ = !reader_(&head_);
+}
+
+
+/*
+ *      LoserTree implementation
+ *
+ *      Leaf of source i has position i + k, internal nodes are 1..k-1
+ *      and the parent of position p is p / 2.
+ */
+template <class Item, class Source, class Compare>
+LoserTree<Item, Source, Compare>::LoserTree(std::vector<Source> sources, Compare cmp)
+        : sources_(std::move(sources)), tree_(std::max<size_t>(sources_.size(), 1)), cmp_(cmp) {
+    Build();
+}
+
+template <class Item, class Source, class Compare>
+bool LoserTree<Item, Source, Compare>::Empty() {
+    return sources_.empty() || sources_[tree_[0]].Empty();
+}
+
+template <class Item, class Source, class Compare>
+const Item& LoserTree<Item, Source, Compare>::GetHead() {
+    return sources_[tree_[0]].Head();
+}
+
+template <class Item, class Source, class Compare>
+size_t LoserTree<Item, Source, Compare>::HeadSource() {
+    return tree_[0];
+}
+
+template <class Item, class Source, class Compare>
+void LoserTree<Item, Source, Compare>::Pop() {
+    sources_[tree_[0]].Pop();
+    Replay(tree_[0]);
+}
+
+template <class Item, class Source, class Compare>
+template <class Callback>
+void LoserTree<Item, Source, Compare>::MergeTo(Callback&& callback) {
+    while (!Empty()) {
+        callback(GetHead());
+        Pop();
+    }
+}
+
+template <class Item, class Source, class Compare>
+bool LoserTree<Item, Source, Compare>::Beats(size_t lhs, size_t rhs) {
+    //  Exhausted source is an infinite item
+    if (sources_[lhs].Empty()) {
+        return false;
+    }
+
+    if (sources_[rhs].Empty()) {
+        return true;
+    }
+
+    if (cmp_(sources_[rhs].Head(), sources_[lhs].Head())) {
+        return false;
+    }
+
+    if (cmp_(sources_[lhs].Head(), sources_[rhs].Head())) {
+        return true;
+    }
+
+    return lhs < rhs;
+}
+
+template <class Item, class Source, class Compare>
+void LoserTree<Item, Source, Compare>::Build() {
+    size_t k = sources_.size();
+    if (k <= 1) {
+        tree_[0] = 0;
+        return;
+    }
+
+    std::vector<size_t> winners(2 * k);
+    for (size_t i = 0; i < k; ++i) {
+        winners[i + k] = i;
+    }
+
+    for (size_t node = k - 1; node > 0; --node) {
+        size_t left = winners[2 * node];
+        size_t right = winners[2 * node + 1];
+        if (Beats(left, right)) {
+            winners[node] = left;
+            tree_[node] = right;
+
+        } else {
+            winners[node] = right;
+            tree_[node] = left;
+        }
+    }
+
+    tree_[0] = winners[1];
+}
+
+template <class Item, class Source, class Compare>
+void LoserTree<Item, Source, Compare>::Replay(size_t source) {
+    size_t winner = source;
+    for (size_t pos = (source + sources_.size()) / 2; pos > 0; pos /= 2) {
+        if (Beats(tree_[pos], winner)) {
+            std::swap(tree_[pos], winner);
+        }
+    }
+
+    tree_[0] = winner;
+}
+
+
+/*
+ *      Merge functions implementation
+ */
+template <class Iterator, class OutputIterator, class Compare>
+OutputIterator KWayMerge(const std::vector<std::pair<Iterator, Iterator>>& ranges,
+                         OutputIterator out, Compare cmp) {
+    typedef typename std::iterator_traits<Iterator>::value_type Item;
+
+    std::vector<RangeSource<Iterator>> sources;
+    sources.reserve(ranges.size());
+    for (const auto& range : ranges) {
+        sources.emplace_back(range.first, range.second);
+    }
+
+    LoserTree<Item, RangeSource<Iterator>, Compare> tree(std::move(sources), cmp);
+    tree.MergeTo([&out](const Item& item) {
+        *out = item;
+        ++out;
+    });
+
+    return out;
+}
+
+template <class Iterator, class OutputIterator, class Compare>
+OutputIterator ParallelKWayMerge(const std::vector<std::pair<Iterator, Iterator>>& ranges,
+                                 OutputIterator out, size_t threads_number,
+                                 Compare cmp) {
+    typedef typename std::iterator_traits<Iterator>::value_type Item;
+    typedef std::pair<Iterator, Iterator> Range;
+
+    size_t total = 0;
+    for (const auto& range : ranges) {
+        total += range.second - range.first;
+    }
+
+    if (threads_number <= 1 || total == 0) {
+        return KWayMerge(ranges, out, cmp);
+    }
+
+    //  Splitters are quantiles of a sample drawn from every range in
+    //  proportion to its length, so skewed inputs still split evenly.
+    //  Every part takes [lower_bound(s_j), lower_bound(s_j+1)) of each
+    //  range, so equal keys never cross a part boundary and the result
+    //  stays stable.
+    size_t sample_size = std::min(total, threads_number * parallel_merge_oversampling);
+    std::vector<Item> samples;
+    samples.reserve(sample_size);
+    for (const auto& range : ranges) {
+        size_t size = range.second - range.first;
+        size_t count = size * sample_size / total;
+        for (size_t j = 0; j < count; ++j) {
+            samples.push_back(*(range.first + (2 * j + 1) * size / (2 * count)));
+        }
+    }
+
+    if (samples.empty()) {
+        return KWayMerge(ranges, out, cmp);
+    }
+
+    std::sort(samples.begin(), samples.end(), cmp);
+
+    std::vector<std::vector<Range>> parts(threads_number);
+    std::vector<size_t> offsets(threads_number + 1, 0);
+    std::vector<Iterator> starts;
+    for (const auto& range : ranges) {
+        starts.push_back(range.first);
+    }
+
+    for (size_t part = 0; part < threads_number; ++part) {
+        for (size_t i = 0; i < ranges.size(); ++i) {
+            Iterator finish = ranges[i].second;
+            if (part + 1 < threads_number) {
+                const Item& splitter = samples[samples.size() * (part + 1) / threads_number];
+                finish = std::lower_bound(starts[i], ranges[i].second, splitter, cmp);
+            }
+
+            parts[part].emplace_back(starts[i], finish);
+            offsets[part + 1] += finish - starts[i];
+            starts[i] = finish;
+        }
+
+        offsets[part + 1] += offsets[part];
+    }
+
+    std::vector<std::thread> threads;
+    for (size_t part = 0; part < threads_number; ++part) {
+        if (offsets[part] == offsets[part + 1]) {
+            continue;
+        }
+
+        threads.emplace_back([&parts, &offsets, out, cmp, part]() {
+            KWayMerge(parts[part], out + offsets[part], cmp);
+        });
+    }
+
+    for (auto& thread : threads) {
+        thread.join();
+    }
+
+    return out + total;
+}
+
+#endif //DATA_STRUCTURES_KWAY_MERGE_H
@@ -0,0 +1,231 @@
+//  Benchmark of the tower skiplist against the layered design it replaced
+//
+//      gcc -std=c99 -O2 -pthread bench.c skiplist.c lf_list.c smr.c marked_pointers.c -o bench
+//      ./bench [keys] [threads]
+//
+//  Every thread inserts its share of the keys, then every thread finds
+//  each of its keys twice. Times are wall clock for all threads.
+
+#define _POSIX_C_SOURCE 200112L
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "lf_list.h"
+#include "skiplist.h"
+
+
+#define MAX_THREADS     64
+#define LAYERED_LEVELS  16
+
+
+/*
+ *  Copy of the layered skiplist as it was before the tower nodes:
+ *  LAYERED_LEVELS lock-free lists sharing one epoch domain.
+ *
+ *  The old list nodes had down pointers, but only the head and tail
+ *  sentinels ever got them set, so every level was searched from its
+ *  head. The copy passes a NULL start instead, which is the same walk.
+ *  Heights are drawn from time(NULL) on every call as before, so keys
+ *  added within one second get one height.
+ */
+typedef struct layered {
+    lf_list_t *levels[LAYERED_LEVELS];
+    smr_t *smr;
+} layered_t;
+
+
+static layered_t *layered_init() {
+    layered_t *slist = (layered_t *)calloc(1, sizeof(layered_t));
+    if(!slist) {
+        perror("Can't allocate memory for layered skiplist");
+        exit(EXIT_FAILURE);
+    }
+
+    slist->smr = smr_init(SMR_EPOCH);
+    for(int i = LAYERED_LEVELS - 1; i >= 0; --i)
+        slist->levels[i] = lfl_init_smr(slist->smr);
+
+    return slist;
+}
+
+
+static void layered_fini(layered_t *slist) {
+    for(int i = LAYERED_LEVELS - 1; i >= 0; --i)
+        lfl_fini(slist->levels[i]);
+
+    smr_fini(slist->smr);
+    free(slist);
+}
+
+
+static val_t layered_find(layered_t *slist, key_t key) {
+    node_t *left;
+    smr_enter(slist->smr);
+    for(int i = LAYERED_LEVELS - 1; i >= 0; --i) {
+        node_t *right = lfl_find_node(slist->levels[i], key, &left, NULL);
+        if(right && right->key == key) {
+            val_t value = right->value;
+            smr_exit(slist->smr);
+            return value;
+        }
+    }
+    smr_exit(slist->smr);
+
+    return -1;
+}
+
+
+static int layered_add(layered_t *slist, key_t key, val_t val) {
+    node_t *prev[LAYERED_LEVELS];
+    smr_enter(slist->smr);
+    for(int i = LAYERED_LEVELS - 1; i >= 0; --i) {
+        node_t *right = lfl_find_node(slist->levels[i], key, &prev[i], NULL);
+        if(right && right->key == key) {
+            smr_exit(slist->smr);
+            return -1;
+        }
+    }
+
+    unsigned int seed = time(NULL);
+    for(int i = 0; i < LAYERED_LEVELS; ++i) {
+        lfl_add(slist->levels[i], key, val, prev[i]);
+        if(rand_r(&seed) > RAND_MAX / 2)
+            break;
+    }
+    smr_exit(slist->smr);
+
+    return 0;
+}
+
+
+/*
+ *  Benchmark
+ */
+typedef struct bench {
+    int (*add)(void *slist, key_t key, val_t val);
+    val_t (*find)(void *slist, key_t key);
+    void *slist;
+    long keys;
+    long threads;
+} bench_t;
+
+typedef struct worker {
+    bench_t *bench;
+    long idx;
+    long missed;
+} worker_t;
+
+
+static int tower_add(void *slist, key_t key, val_t val) {
+    return sl_add((slist_t *)slist, key, val);
+}
+
+static val_t tower_find(void *slist, key_t key) {
+    return sl_find((slist_t *)slist, key);
+}
+
+static int layered_add_any(void *slist, key_t key, val_t val) {
+    return layered_add((layered_t *)slist, key, val);
+}
+
+static val_t layered_find_any(void *slist, key_t key) {
+    return layered_find((layered_t *)slist, key);
+}
+
+
+//  Distinct keys in random order, the multiplier is coprime with the modulus
+static key_t bench_key(long idx) {
+    return (idx * 2654435761L) % 100000007L;
+}
+
+
+static double now_ms() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
+
+static void *add_worker(void *arg) {
+    worker_t *worker = (worker_t *)arg;
+    bench_t *bench = worker->bench;
+    for(long i = worker->idx; i < bench->keys; i += bench->threads)
+        bench->add(bench->slist, bench_key(i), i);
+
+    smr_thread_fini();
+    return NULL;
+}
+
+
+static void *find_worker(void *arg) {
+    worker_t *worker = (worker_t *)arg;
+    bench_t *bench = worker->bench;
+    for(int round = 0; round < 2; ++round) {
+        for(long i = worker->idx; i < bench->keys; i += bench->threads) {
+            if(bench->find(bench->slist, bench_key(i)) != i)
+                ++worker->missed;
+        }
+    }
+
+    smr_thread_fini();
+    return NULL;
+}
+
+
+//  Returns milliseconds taken by all threads, adds up missed finds
+static double bench_run(bench_t *bench, void *(*routine)(void *), long *missed) {
+    pthread_t threads[MAX_THREADS];
+    worker_t workers[MAX_THREADS];
+
+    double start = now_ms();
+    for(long i = 0; i < bench->threads; ++i) {
+        workers[i].bench = bench;
+        workers[i].idx = i;
+        workers[i].missed = 0;
+        if(pthread_create(&threads[i], NULL, routine, &workers[i])) {
+            perror("Can't create thread");
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    for(long i = 0; i < bench->threads; ++i) {
+        pthread_join(threads[i], NULL);
+        *missed += workers[i].missed;
+    }
+
+    return now_ms() - start;
+}
+
+
+static void bench_print(const char *name, bench_t *bench) {
+    long missed = 0;
+    double add_ms = bench_run(bench, add_worker, &missed);
+    double find_ms = bench_run(bench, find_worker, &missed);
+    printf("%-8s keys %ld threads %ld: add %.0f ms, find x2 %.0f ms, missed %ld\n",
+           name, bench->keys, bench->threads, add_ms, find_ms, missed);
+}
+
+
+int main(int argc, char **argv) {
+    long keys = argc > 1 ? atol(argv[1]) : 20000;
+    long threads = argc > 2 ? atol(argv[2]) : 1;
+    if(threads < 1 || threads > MAX_THREADS) {
+        fprintf(stderr, "Threads number must be in [1, %d]\n", MAX_THREADS);
+        return EXIT_FAILURE;
+    }
+
+    slist_t *tower = sl_init();
+    bench_t bench = {tower_add, tower_find, tower, keys, threads};
+    bench_print("tower", &bench);
+    sl_fini(tower);
+
+    layered_t *layered = layered_init();
+    bench_t layered_bench = {layered_add_any, layered_find_any, layered, keys, threads};
+    bench_print("layered", &layered_bench);
+    layered_fini(layered);
+
+    return 0;
+}
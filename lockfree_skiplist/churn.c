@@ -0,0 +1,132 @@
+//  Churn benchmark of the lock-free list reclamation schemes
+//
+//      gcc -std=c99 -O2 -pthread churn.c lf_list.c smr.c marked_pointers.c -o churn
+//      ./churn [epoch|hazard] [threads] [ops per thread] [rounds]
+//
+//  Threads add, delete and find random keys of a small range on one list,
+//  so nearly every delete unlinks a node that has to be reclaimed. After
+//  every round the throughput and max RSS are printed: with reclamation
+//  working RSS stays flat from round to round. Run one scheme per process,
+//  max RSS never goes down.
+
+#define _POSIX_C_SOURCE 200112L
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <sys/resource.h>
+
+#include "lf_list.h"
+
+
+#define MAX_THREADS     64
+#define CHURN_KEYS      512
+
+
+typedef struct worker {
+    lf_list_t *list;
+    unsigned seed;
+    long ops;
+    long wrong;
+} worker_t;
+
+
+static double now_ms() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
+
+static long max_rss_kb() {
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_maxrss;
+}
+
+
+//  Values equal keys, so a find returns the first key not less than asked
+static void *churn_worker(void *arg) {
+    worker_t *worker = (worker_t *)arg;
+    for(long i = 0; i < worker->ops; ++i) {
+        key_t key = rand_r(&worker->seed) % CHURN_KEYS;
+        node_t *left;
+        switch(rand_r(&worker->seed) % 3) {
+            case 0:
+                lfl_add(worker->list, key, key, NULL);
+                break;
+            case 1:
+                lfl_del(worker->list, key);
+                break;
+            default:
+                if(lfl_find(worker->list, key, &left) < key)
+                    ++worker->wrong;
+        }
+    }
+
+    smr_thread_fini();
+    return NULL;
+}
+
+
+int main(int argc, char **argv) {
+    const char *scheme = argc > 1 ? argv[1] : "epoch";
+    long threads = argc > 2 ? atol(argv[2]) : 4;
+    long ops = argc > 3 ? atol(argv[3]) : 1000000;
+    long rounds = argc > 4 ? atol(argv[4]) : 5;
+    if(threads < 1 || threads > MAX_THREADS) {
+        fprintf(stderr, "Threads number must be in [1, %d]\n", MAX_THREADS);
+        return EXIT_FAILURE;
+    }
+
+    lf_list_t *list;
+    smr_t *smr = NULL;
+    if(!strcmp(scheme, "epoch")) {
+        list = lfl_init();
+    } else if(!strcmp(scheme, "hazard")) {
+        smr = smr_init(SMR_HAZARD);
+        list = lfl_init_smr(smr);
+    } else {
+        fprintf(stderr, "Scheme must be epoch or hazard\n");
+        return EXIT_FAILURE;
+    }
+
+    pthread_t tids[MAX_THREADS];
+    worker_t workers[MAX_THREADS];
+    long wrong = 0;
+    for(long round = 0; round < rounds; ++round) {
+        double start = now_ms();
+        for(long i = 0; i < threads; ++i) {
+            workers[i].list = list;
+            workers[i].seed = (unsigned)(round * MAX_THREADS + i + 1);
+            workers[i].ops = ops;
+            workers[i].wrong = 0;
+            if(pthread_create(&tids[i], NULL, churn_worker, &workers[i])) {
+                perror("Can't create thread");
+                exit(EXIT_FAILURE);
+            }
+        }
+
+        for(long i = 0; i < threads; ++i) {
+            pthread_join(tids[i], NULL);
+            wrong += workers[i].wrong;
+        }
+
+        double ms = now_ms() - start;
+        printf("%s round %ld: %ld threads, %.2f M ops/s, size %u, max RSS %ld KB\n",
+               scheme, round, threads, threads * ops / ms / 1e3, list->size, max_rss_kb());
+    }
+
+    lfl_fini(list);
+    if(smr)
+        smr_fini(smr);
+
+    if(wrong) {
+        printf("%ld wrong finds\n", wrong);
+        return EXIT_FAILURE;
+    }
+
+    return 0;
+}
@@ -26,24 +26,39 @@ node_t *node_init(key_t key, val_t val, node_t *next) {
 
 
 lf_list_t *lfl_init() {
+    lf_list_t *list = lfl_init_smr(smr_init(SMR_EPOCH));
+    list->own_smr = 1;
+
+    return list;
+}
+
+
+lf_list_t *lfl_init_smr(smr_t *smr) {
     lf_list_t *list = (lf_list_t *)calloc(1, sizeof(lf_list_t));
     if(!list)
         err_exit("Can't allocate memory for lock-free list");
 
-    list->tail = node_init(INT_MAX, INT_MAX, NULL);
-    list->head = node_init(INT_MIN, INT_MIN, list->tail);
+    list->tail = node_init(LONG_MAX, LONG_MAX, NULL);
+    list->head = node_init(LONG_MIN, LONG_MIN, list->tail);
     list->size = 0;
+    list->smr  = smr;
+    list->own_smr = 0;
 
     return list;
 }
 
 
 void lfl_fini(lf_list_t *list) {
-    node_t *curr_node = list->head->next;
-    while(curr_node != list->tail) {
-        lfl_del(list, curr_node->value);
-        curr_node = list->head->next;
+    node_t *curr_node = list->head;
+    while(curr_node) {
+        node_t *next = (node_t *)get_unmarked_ref((long)curr_node->next);
+        free(curr_node);
+        curr_node = next;
     }
+
+    if(list->own_smr)
+        smr_fini(list->smr);
+    free(list);
 }
 
 
@@ -57,92 +72,88 @@ void lfl_print(lf_list_t *list) {
     //printf("### head : %u, %ld\n", list->head, list->head->value);
     //printf("### tail : %u, %ld\n", list->tail, list->tail->value);
     node_t *curr_node = list->head->next;
-    if(!curr_node)
+    if(curr_node == list->tail)
         printf("# empty\n");
 
     while(curr_node != list->tail) {
-        if(is_marked_ref(curr_node)) {
-            curr_node = (node_t *)get_unmarked_ref(curr_node);
-            curr_node = curr_node->next;
-            continue;
-        }
+        node_t *next = curr_node->next;
+        if(!is_marked_ref((long)next))
+            printf("# %ld : %ld\n", curr_node->key, curr_node->value);
 
-        printf("# %ld : %ld\n", curr_node->key, curr_node->value);
-        curr_node = curr_node->next;
+        curr_node = (node_t *)get_unmarked_ref((long)next);
     }
     printf("########################\n");
 }
 
 
+//  Hazard slots used by the traversal
+#define HP_NEXT 0
+#define HP_CURR 1
+#define HP_PREV 2
+
+
+//  Unlinks marked nodes one by one rather than a whole marked chain,
+//  so that a node is only dereferenced while its predecessor is
+//  known to be linked, which is what hazard pointers need
 node_t *lfl_find_node(lf_list_t *list, key_t key, node_t **left, node_t *start) {
-    node_t *left_next, *right;
-    left_next = right = NULL;
+    smr_t *smr = list->smr;
     if(!start)
         start = list->head;
-    else if(start->key > key)
+    else if(start->key >= key)
         return NULL;
 
     while(1) {
-        node_t *curr = start;
-        node_t *curr_next = start->next;
-
-        //  Find place for new node
-        while(is_marked_ref(curr_next) || (curr->key < key)) {
-            //  Check node for logical deletion
-            if(!is_marked_ref(curr_next)) {
-                (*left) = curr;
-                left_next = curr_next;
+        //  Nothing can be unlinked after a deleted start node
+        node_t *prev = start;
+        if(is_marked_ref((long)prev->next))
+            prev = list->head;
+
+        smr_hold(smr, HP_PREV, prev);
+        node_t *curr = (node_t *)smr_protect(smr, HP_CURR, (void **)&prev->next);
+        if(is_marked_ref((long)curr))
+            continue;
+
+        while(1) {
+            if(curr == list->tail) {
+                (*left) = prev;
+                return curr;
             }
-            curr = get_unmarked_ref(curr_next);
-            if(curr == list->tail)
+
+            node_t *next = (node_t *)smr_protect(smr, HP_NEXT, (void **)&curr->next);
+            if(prev->next != curr)
                 break;
 
-            curr_next = curr->next;
-        }
-        right = curr;
-
-        if(left_next == right) {
-            if(!is_marked_ref(right->next))
-                return right;
-        } else {
-            if(__sync_bool_compare_and_swap(&((*left)->next), left_next, right))
-                return right;
+            if(is_marked_ref((long)next)) {
+                next = (node_t *)get_unmarked_ref((long)next);
+                if(!__sync_bool_compare_and_swap(&(prev->next), curr, next))
+                    break;
+
+                smr_retire(smr, curr);
+                smr_hold(smr, HP_CURR, next);
+                curr = next;
+                continue;
+            }
+
+            if(curr->key >= key) {
+                (*left) = prev;
+                return curr;
+            }
+
+            smr_hold(smr, HP_PREV, curr);
+            smr_hold(smr, HP_CURR, next);
+            prev = curr;
+            curr = next;
         }
     }
 }
 
 
 val_t lfl_find(lf_list_t *list, key_t key, node_t **left) {
-    node_t *left_next, *right;
-    left_next = right = NULL;
+    smr_enter(list->smr);
+    val_t value = lfl_find_node(list, key, left, NULL)->value;
+    smr_exit(list->smr);
 
-    while(1) {
-        node_t *curr = list->head;
-        node_t *curr_next = list->head->next;
-
-        //  Find place for new node
-        while(is_marked_ref(curr_next) || (curr->key < key)) {
-            //  Check node for logical deletion
-            if(!is_marked_ref(curr_next)) {
-                (*left) = curr;
-                left_next = curr_next;
-            }
-            curr = get_unmarked_ref(curr_next);
-            if(curr == list->tail)
-                break;
-
-            curr_next = curr->next;
-        }
-        right = curr;
-
-        if(left_next == right) {
-            if(!is_marked_ref(right->next))
-                return right->value;
-        } else {
-            if(__sync_bool_compare_and_swap(&((*left)->next), left_next, right))
-                return right->value;
-        }
-    }
+    return value;
 }
 
 
@@ -154,36 +165,54 @@ int lfl_add(lf_list_t *list, key_t key, val_t value, node_t *start) {
     left = right = NULL;
     node_t *node = node_init(key, value, NULL);
 
+    smr_enter(list->smr);
     while(1) {
         right = lfl_find_node(list, key, &left, start);
-        if(right && right->key == key)
+        if(right != list->tail && right->key == key) {
+            smr_exit(list->smr);
+            free(node);
             return -1;
+        }
 
         node->next = right;
         if(__sync_bool_compare_and_swap(&(left->next), right, node)) {
             __sync_fetch_and_add(&(list->size), 1);
+            smr_exit(list->smr);
             return 0;
         }
     }
 }
 
 
+//  Marks the node's own next pointer first, the node is deleted from
+//  that moment. Then one try to unlink it, a failed one is left to the
+//  next traversal. Only the thread whose CAS unlinks a node retires it
 int lfl_del(lf_list_t *list, key_t key) {
-    node_t *right, *left, *left_next;
-    right = left = left_next = NULL;
+    node_t *right, *left, *right_next;
+    right = left = right_next = NULL;
 
+    smr_enter(list->smr);
     while(1) {
         //  Check if our node exist
         right = lfl_find_node(list, key, &left, NULL);
-        if(right == list->tail || right->key != key)
+        if(right == list->tail || right->key != key) {
+            smr_exit(list->smr);
             return -1;
+        }
 
-        left_next = left->next;
-        if(!is_marked_ref(left_next)) {
-            if(__sync_bool_compare_and_swap(&(left->next), left_next, get_marked_ref(left_next))) {
-                __sync_fetch_and_sub(&(list->size), 1);
-                return 0;
-            }
+        right_next = right->next;
+        if(is_marked_ref((long)right_next))
+            continue;
+
+        if(__sync_bool_compare_and_swap(&(right->next), right_next, get_marked_ref((long)right_next))) {
+            __sync_fetch_and_sub(&(list->size), 1);
+            if(__sync_bool_compare_and_swap(&(left->next), right, right_next))
+                smr_retire(list->smr, right);
+            else
+                lfl_find_node(list, key, &left, NULL);
+
+            smr_exit(list->smr);
+            return 0;
         }
     }
 }
@@ -2,6 +2,8 @@
 #define LF_LIST_H
 
 
+#include "smr.h"
+
 typedef long val_t;
 typedef long key_t;
 
@@ -9,19 +11,29 @@ typedef long key_t;
 typedef struct node {
     key_t key;
     val_t value;
-    struct lfl_node *next;
-    struct lfl_node *down;  //  Only for skiplist
+    struct node *next;
 } node_t;
 
 
+//  Deleted nodes are unlinked by whoever meets them first
+//  and retired to the reclamation domain of the list
 typedef struct lf_list {
     struct node *head;
     struct node *tail;
     unsigned size;
+    smr_t *smr;
+    int own_smr;
 } lf_list_t;
 
 
+//  List with its own epoch based reclamation domain
 lf_list_t *lfl_init();
+
+//  List retiring nodes to a domain the caller owns, several lists may
+//  share one. Pass a SMR_HAZARD domain to keep garbage bounded
+lf_list_t *lfl_init_smr(smr_t *smr);
+
+//  Frees all nodes, no other thread may use the list
 void lfl_fini(lf_list_t *list);
 void lfl_print(lf_list_t *list);
 val_t lfl_find(lf_list_t *list, key_t key, node_t **left);
@@ -43,6 +55,11 @@ int lfl_del(lf_list_t *list, key_t key);
 int lfl_add(lf_list_t *list, key_t key, val_t value, node_t *start);
 
 //  Finds the node by key from the start node.
+//  Marked nodes met on the way are unlinked and retired.
+//
+//  Must be called between smr_enter and smr_exit on the list domain,
+//  returned nodes and start stay valid only until smr_exit, with
+//  hazard pointers only until the next call on the list.
 //
 //  ARGUMENTS
 //  ---------
@@ -55,7 +72,7 @@ int lfl_add(lf_list_t *list, key_t key, val_t value, node_t *start);
 //  --------------
 //  Pointer to a node with the key if it exists
 //  or pointer to a node with key next to required
-//  If start node key is greater than required key => returns NULL
+//  If start node key is not less than required key => returns NULL
 //
 node_t *lfl_find_node(lf_list_t *list, key_t key, node_t **left, node_t *start);
 
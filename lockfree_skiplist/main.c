@@ -32,6 +32,11 @@ int main(void)
     sl_print(slist);
     sl_add(slist, 5, 5);
     sl_print(slist);
+    sl_del(slist, 4);
+    sl_print(slist);
+    sl_del(slist, 2);
+    sl_print(slist);
+    sl_fini(slist);
 
     return 0;
 }
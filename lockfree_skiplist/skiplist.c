@@ -13,7 +13,48 @@
                         } while(0)
 
 
-node_t *node_init(val_t value, node_t *next, node_t *down);
+static sl_node_t *sl_node_init(key_t key, val_t value, int height) {
+    sl_node_t *node = (sl_node_t *)calloc(1, sizeof(sl_node_t) + height * sizeof(sl_node_t *));
+    if(!node)
+        err_exit("Can't allocate memory for lock-free skiplist new node");
+
+    node->key    = key;
+    node->value  = value;
+    node->height = height;
+    node->refs   = 2;
+
+    return node;
+}
+
+
+//  xorshift64 per thread, seeded once from the thread's own address
+static unsigned long sl_random() {
+    static __thread unsigned long state = 0;
+    if(!state) {
+        state = (unsigned long)&state ^ ((unsigned long)time(NULL) << 32);
+        state = state * 0x9E3779B97F4A7C15UL | 1;
+    }
+
+    state ^= state << 13;
+    state ^= state >> 7;
+    state ^= state << 17;
+
+    return state;
+}
+
+
+//  Each level keeps about a half of the level below, so trailing zeros
+//  of a random word give the height. It is capped a bit above log2 of
+//  the size so that a few tall towers can't appear in a small skiplist
+static int sl_random_level(slist_t *slist) {
+    unsigned long size = slist->size;
+    int limit = 1;
+    while(limit < MAX_LEVEL && (size >> limit))
+        ++limit;
+    limit = limit + 1 < MAX_LEVEL ? limit + 1 : MAX_LEVEL;
+
+    return 1 + __builtin_ctzl(sl_random() | (1UL << (limit - 1)));
+}
 
 
 slist_t *sl_init() {
@@ -21,61 +62,238 @@ slist_t *sl_init() {
     if(!slist)
         err_exit("Can't allocate memory for lock-free skiplist");
 
-    for(int i = MAX_LEVEL - 1; i >= 0; --i)
-        slist->levels[i] = lfl_init();
-
-    for(int i = MAX_LEVEL - 1; i > 0; --i) {
-        slist->levels[i]->head->down = slist->levels[i - 1]->head;
-        slist->levels[i]->tail->down = slist->levels[i - 1]->tail;
-    }
+    slist->tail = sl_node_init(LONG_MAX, LONG_MAX, MAX_LEVEL);
+    slist->head = sl_node_init(LONG_MIN, LONG_MIN, MAX_LEVEL);
+    for(int i = 0; i < MAX_LEVEL; ++i)
+        slist->head->next[i] = slist->tail;
 
-    //slist->level = 1;
-    //slist->size  = 0;
+    slist->level = 1;
+    slist->size  = 0;
+    slist->smr   = smr_init(SMR_EPOCH);
 
     return slist;
 }
 
 
 void sl_fini(slist_t *slist) {
-    for(int i = MAX_LEVEL - 1; i >= 0; --i)
-        lfl_fini(slist->levels[i]);
+    sl_node_t *curr_node = slist->head;
+    while(curr_node) {
+        sl_node_t *next = (sl_node_t *)get_unmarked_ref((long)curr_node->next[0]);
+        free(curr_node);
+        curr_node = next;
+    }
+
+    smr_fini(slist->smr);
+    free(slist);
 }
 
-//  It needs to check
-val_t sl_find(slist_t *slist, key_t key) {
-    node_t *start_node = slist->levels[MAX_LEVEL - 1]->head;
-    node_t *left = (node_t *)calloc(1, sizeof(node_t));
-    for(int i = MAX_LEVEL - 1; i >= 0; --i) {
-        node_t *right = lfl_find_node(slist->levels[i], key, &left, start_node);
-        if(right && right->key == key)
-            return right->value;               
-
-        start_node = left->down;
+
+//  Finds the last node before the key and the first one
+//  not before it on every level, dropping down inside a tower.
+//  Marked nodes on the way are unlinked, a failed unlink means
+//  the predecessor changed and the search starts over
+//
+//  RETURNED VALUE
+//  --------------
+//  1 if the key is in the skiplist or 0
+//
+static int sl_search(slist_t *slist, key_t key, sl_node_t **preds, sl_node_t **succs) {
+    int restart = 1;
+    while(restart) {
+        restart = 0;
+        sl_node_t *pred = slist->head;
+        for(int level = (int)slist->level - 1; level >= 0 && !restart; --level) {
+            sl_node_t *curr = (sl_node_t *)get_unmarked_ref((long)pred->next[level]);
+            while(1) {
+                sl_node_t *succ = curr->next[level];
+                if(is_marked_ref((long)succ)) {
+                    succ = (sl_node_t *)get_unmarked_ref((long)succ);
+                    if(!__sync_bool_compare_and_swap(&(pred->next[level]), curr, succ)) {
+                        restart = 1;
+                        break;
+                    }
+
+                    curr = succ;
+                    continue;
+                }
+
+                if(curr->key >= key)
+                    break;
+
+                pred = curr;
+                curr = succ;
+            }
+
+            preds[level] = pred;
+            succs[level] = curr;
+        }
     }
 
-    return -1;
+    return succs[0] != slist->tail && succs[0]->key == key;
+}
+
+
+//  Drops the caller's share of the node, the second one retires it
+static void sl_release(slist_t *slist, sl_node_t *node) {
+    if(__sync_sub_and_fetch(&(node->refs), 1) == 0)
+        smr_retire(slist->smr, node);
+}
+
+
+sl_node_t *sl_find_node(slist_t *slist, key_t key) {
+    sl_node_t *pred = slist->head;
+    sl_node_t *curr = NULL;
+    for(int level = (int)slist->level - 1; level >= 0; --level) {
+        curr = (sl_node_t *)get_unmarked_ref((long)pred->next[level]);
+        while(1) {
+            //  Links of a deleted node still lead forward
+            sl_node_t *succ = curr->next[level];
+            if(is_marked_ref((long)succ)) {
+                curr = (sl_node_t *)get_unmarked_ref((long)succ);
+                continue;
+            }
+
+            if(curr->key >= key)
+                break;
+
+            pred = curr;
+            curr = succ;
+        }
+    }
+
+    if(curr == slist->tail || curr->key != key)
+        return NULL;
+
+    return curr;
+}
+
+
+int sl_contains(slist_t *slist, key_t key) {
+    smr_enter(slist->smr);
+    int found = sl_find_node(slist, key) != NULL;
+    smr_exit(slist->smr);
+
+    return found;
+}
+
+
+int sl_get(slist_t *slist, key_t key, val_t *out) {
+    smr_enter(slist->smr);
+    sl_node_t *node = sl_find_node(slist, key);
+    if(node)
+        (*out) = node->value;
+    smr_exit(slist->smr);
+
+    return node != NULL;
+}
+
+
+val_t sl_find(slist_t *slist, key_t key) {
+    val_t value = -1;
+    sl_get(slist, key, &value);
+
+    return value;
+}
+
+
+//  Links the upper levels of a node that is already on level 0. The
+//  node's own link is moved with a CAS, so a deleter's mark stops it
+static void sl_link_upper(slist_t *slist, sl_node_t *node, sl_node_t **preds, sl_node_t **succs) {
+    for(int i = 1; i < node->height; ++i) {
+        while(1) {
+            sl_node_t *next = node->next[i];
+            if(is_marked_ref((long)next))
+                return;
+
+            if(next != succs[i] && !__sync_bool_compare_and_swap(&(node->next[i]), next, succs[i]))
+                continue;
+
+            if(__sync_bool_compare_and_swap(&(preds[i]->next[i]), succs[i], node))
+                break;
+
+            //  Lost race means searching again for the new neighbours
+            sl_search(slist, node->key, preds, succs);
+        }
+    }
 }
 
 
 int sl_add(slist_t *slist, key_t key, val_t val) {
-    //  Go down level by level and find places to insert
-    node_t *prev[MAX_LEVEL];
-    node_t *start_node = slist->levels[MAX_LEVEL - 1]->head;
-    for(int i = MAX_LEVEL - 1; i >= 0; --i) {
-        node_t *right = lfl_find_node(slist->levels[i], key, &prev[i], start_node);
-        if(right && right->key == key)
+    sl_node_t *preds[MAX_LEVEL], *succs[MAX_LEVEL];
+    int height = sl_random_level(slist);
+    sl_node_t *node = sl_node_init(key, val, height);
+
+    //  Searches have to see every level the node may be linked on
+    unsigned level = slist->level;
+    while(level < (unsigned)height && !__sync_bool_compare_and_swap(&(slist->level), level, height))
+        level = slist->level;
+
+    smr_enter(slist->smr);
+    while(1) {
+        if(sl_search(slist, key, preds, succs)) {
+            smr_exit(slist->smr);
+            free(node);
             return -1;
+        }
+
+        for(int i = 0; i < height; ++i)
+            node->next[i] = succs[i];
+
+        if(__sync_bool_compare_and_swap(&(preds[0]->next[0]), succs[0], node))
+            break;
+    }
+    __sync_fetch_and_add(&(slist->size), 1);
+
+    sl_link_upper(slist, node, preds, succs);
+
+    //  A deleter may have finished its cleanup before the last link
+    if(is_marked_ref((long)node->next[0]))
+        sl_search(slist, key, preds, succs);
+
+    sl_release(slist, node);
+    smr_exit(slist->smr);
 
-        start_node = prev[i]->down;
+    return 0;
+}
+
+
+int sl_del(slist_t *slist, key_t key) {
+    sl_node_t *preds[MAX_LEVEL], *succs[MAX_LEVEL];
+
+    smr_enter(slist->smr);
+    if(!sl_search(slist, key, preds, succs)) {
+        smr_exit(slist->smr);
+        return -1;
+    }
+
+    sl_node_t *node = succs[0];
+    for(int i = node->height - 1; i > 0; --i) {
+        sl_node_t *next = node->next[i];
+        while(!is_marked_ref((long)next)) {
+            __sync_bool_compare_and_swap(&(node->next[i]), next, get_marked_ref((long)next));
+            next = node->next[i];
+        }
     }
 
-    //  Add to each level from the bottom while
-    unsigned int seed = time(NULL);
-    for(int i = 0; i < MAX_LEVEL; ++i) {
-        lfl_add(slist->levels[i], key, val, prev[i]);
-        if(rand_r(&seed) > RAND_MAX / 2)
+    //  Only one thread marks level 0, the others lost the key to it
+    sl_node_t *next = node->next[0];
+    while(1) {
+        if(is_marked_ref((long)next)) {
+            smr_exit(slist->smr);
+            return -1;
+        }
+
+        if(__sync_bool_compare_and_swap(&(node->next[0]), next, get_marked_ref((long)next)))
             break;
+
+        next = node->next[0];
     }
+    __sync_fetch_and_sub(&(slist->size), 1);
+
+    //  Search unlinks the node from every level it is on
+    sl_search(slist, key, preds, succs);
+    sl_release(slist, node);
+    smr_exit(slist->smr);
 
     return 0;
 }
@@ -85,43 +303,23 @@ void sl_print(slist_t *slist) {
     printf("\n############################\n");
     printf("###  lock-free skiplist  ###\n");
     printf("############################\n");
-    //printf("### size : %u\n", slist->size);
-    for(int i = MAX_LEVEL - 1; i >= 0; --i) {
+    printf("### size : %lu\n", slist->size);
+    for(int i = (int)slist->level - 1; i >= 0; --i) {
         printf("level %d : ", i);
-        print_level(slist, i);
+
+        //  Bottom level keeps the columns of the towers
+        sl_node_t *curr_node = slist->head->next[0];
+        while(curr_node != slist->tail) {
+            int width = snprintf(NULL, 0, "(%ld, %ld) ", curr_node->key, curr_node->value);
+            sl_node_t *next = curr_node->next[0];
+            if(!is_marked_ref((long)next) && curr_node->height > i)
+                printf("(%ld, %ld) ", curr_node->key, curr_node->value);
+            else
+                printf("%*s", width, "");
+            curr_node = (sl_node_t *)get_unmarked_ref((long)next);
+        }
         printf("\n");
     }
 
     printf("########################\n");
 }
-
-//  Doesn't work right
-void print_level(slist_t *slist, int level) {
-    lf_list_t *list = slist->levels[level];
-    node_t *prev_node = NULL;
-    if(level > 0)
-        prev_node = slist->levels[level - 1]->head->next;
-
-    node_t *curr_node = list->head->next;
-    while(curr_node != list->tail) {
-        if(is_marked_ref(curr_node)) {
-            curr_node = get_unmarked_ref(curr_node);
-            curr_node = curr_node->next;
-            continue;
-        }
-
-        if(level > 0) {
-            lf_list_t *prev_list = slist->levels[level - 1];
-            node_t *prev_curr_node = prev_node->next;
-            while(prev_curr_node != prev_list->tail &&
-                  prev_curr_node->key != curr_node->key) {
-                printf("      ");
-                prev_node = prev_curr_node;
-                prev_curr_node = prev_curr_node->next;
-            }
-        }
-
-        printf("(%ld, %ld) ", curr_node->key, curr_node->value);
-        curr_node = curr_node->next;
-    }
-}
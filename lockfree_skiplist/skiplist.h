@@ -5,24 +5,77 @@
 #include "lf_list.h"
 
 
-#define MAX_LEVEL   16
+#define MAX_LEVEL   32
+
+
+//  Whole tower in one allocation, next[i] is the link on level i.
+//  A marked next[i] means the node is deleted from level i,
+//  levels are marked top-down so a marked next[0] means it is deleted
+typedef struct sl_node {
+    key_t key;
+    val_t value;
+    int height;
+    int refs;   //  Inserter and deleter, the last to let go retires it
+    struct sl_node *next[];
+} sl_node_t;
 
 
 typedef struct skiplist {
-    //unsigned level;
-    //unsigned size;
-    lf_list_t *levels[MAX_LEVEL];
+    sl_node_t *head;    //  Both sentinels are MAX_LEVEL tall
+    sl_node_t *tail;
+    unsigned level;     //  Levels in use, only grows
+    unsigned long size;
+    smr_t *smr;         //  Always SMR_EPOCH, readers walk towers without hazards
 } slist_t;
 
 
 slist_t *sl_init();
 void    sl_fini(slist_t *slist);
+
+//  Value by key or -1, which can't be told from a stored -1, prefer sl_get
 val_t   sl_find(slist_t *slist, key_t key);
+
+//  Lookups that never allocate, never write shared memory and never
+//  restart: marked nodes are stepped over instead of unlinked, so
+//  readers don't invalidate each other's or the writers' cache lines
+int     sl_contains(slist_t *slist, key_t key);
+
+//  Finds value by key
+//
+//  RETURNED VALUE
+//  --------------
+//  1 and the value in *out if the key is in the skiplist or 0
+//
+int     sl_get(slist_t *slist, key_t key, val_t *out);
+
+//  Adding new element to the skiplist
+//
+//  The node is linked on level 0 first, from that moment it is in
+//  the set. Upper levels are linked bottom-up with one CAS each
+//
+//  RETURNED VALUE
+//  --------------
+//  0 if success or -1 if such key has already exist
+//
 int     sl_add(slist_t *slist, key_t key, val_t val);
 
+//  Deleting element from the skiplist
+//
+//  Levels are marked from the top, marking level 0 is the moment the
+//  key leaves the set. Marked nodes are unlinked by searches passing
+//  them and retired once both the inserter and the deleter are done
+//
+//  RETURNED VALUE
+//  --------------
+//  0 if success or -1 if there is no such key
+//
+int     sl_del(slist_t *slist, key_t key);
+
 void sl_print(slist_t *slist);
 
-node_t *sl_find_node(slist_t *slist, key_t key);
+//  Node with the key or NULL, read-only as sl_get. Must be called between
+//  smr_enter and smr_exit on slist->smr and is valid only until smr_exit
+sl_node_t *sl_find_node(slist_t *slist, key_t key);
 
 
 #endif // LF_SKIPLIST_H
@@ -0,0 +1,218 @@
+#include "smr.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include "marked_pointers.h"
+
+
+#define err_exit(msg)   do {                        \
+                            perror(msg);            \
+                            exit(EXIT_FAILURE);     \
+                        } while(0)
+
+
+//  Thread ids are shared by all domains, a thread keeps its id
+//  until smr_thread_fini so its records are found without a lookup
+static volatile int smr_slots[SMR_MAX_THREADS];
+static __thread int smr_tid = -1;
+
+
+static int smr_thread_id() {
+    if(smr_tid >= 0)
+        return smr_tid;
+
+    for(int i = 0; i < SMR_MAX_THREADS; ++i) {
+        if(!smr_slots[i] && __sync_bool_compare_and_swap(&smr_slots[i], 0, 1)) {
+            smr_tid = i;
+            return i;
+        }
+    }
+
+    fprintf(stderr, "More than %d threads use safe memory reclamation\n", SMR_MAX_THREADS);
+    exit(EXIT_FAILURE);
+}
+
+
+void smr_thread_fini(void) {
+    if(smr_tid < 0)
+        return;
+
+    __atomic_store_n(&smr_slots[smr_tid], 0, __ATOMIC_RELEASE);
+    smr_tid = -1;
+}
+
+
+smr_t *smr_init(smr_kind_t kind) {
+    smr_t *smr = (smr_t *)calloc(1, sizeof(smr_t));
+    if(!smr)
+        err_exit("Can't allocate memory for reclamation domain");
+
+    smr->kind  = kind;
+    smr->epoch = 0;
+
+    return smr;
+}
+
+
+void smr_fini(smr_t *smr) {
+    for(int i = 0; i < SMR_MAX_THREADS; ++i) {
+        smr_thread_t *rec = &smr->threads[i];
+        for(unsigned j = 0; j < rec->retired_count; ++j)
+            free(rec->retired[j]);
+
+        free(rec->retired);
+        free(rec->retired_epochs);
+    }
+
+    free(smr);
+}
+
+
+void smr_enter(smr_t *smr) {
+    smr_thread_t *rec = &smr->threads[smr_thread_id()];
+    if(rec->active++ || smr->kind != SMR_EPOCH)
+        return;
+
+    //  A stale epoch only holds the next advance back, so no recheck,
+    //  but it has to be visible before any node is read
+    rec->epoch = (smr->epoch << 1) | 1;
+    __sync_synchronize();
+}
+
+
+void smr_exit(smr_t *smr) {
+    smr_thread_t *rec = &smr->threads[smr_thread_id()];
+    if(--rec->active)
+        return;
+
+    if(smr->kind == SMR_EPOCH) {
+        __atomic_store_n(&rec->epoch, 0, __ATOMIC_RELEASE);
+        return;
+    }
+
+    for(int i = 0; i < SMR_HAZARDS; ++i)
+        __atomic_store_n(&rec->hazards[i], NULL, __ATOMIC_RELEASE);
+}
+
+
+void *smr_protect(smr_t *smr, int slot, void * volatile *src) {
+    if(smr->kind == SMR_EPOCH)
+        return __atomic_load_n(src, __ATOMIC_ACQUIRE);
+
+    smr_thread_t *rec = &smr->threads[smr_thread_id()];
+    void *ptr = __atomic_load_n(src, __ATOMIC_ACQUIRE);
+    while(1) {
+        rec->hazards[slot] = (void *)get_unmarked_ref((long)ptr);
+        __sync_synchronize();
+
+        //  Unchanged source means the node was still linked
+        //  when the hazard became visible to reclaimers
+        void *again = __atomic_load_n(src, __ATOMIC_ACQUIRE);
+        if(again == ptr)
+            return ptr;
+
+        ptr = again;
+    }
+}
+
+
+void smr_hold(smr_t *smr, int slot, void *ptr) {
+    if(smr->kind == SMR_EPOCH)
+        return;
+
+    smr_thread_t *rec = &smr->threads[smr_thread_id()];
+    __atomic_store_n(&rec->hazards[slot], (void *)get_unmarked_ref((long)ptr), __ATOMIC_RELEASE);
+}
+
+
+//  Epoch moves on only when every thread inside a critical section has
+//  seen the current one, so nodes retired two epochs ago are unreachable
+static void smr_try_advance(smr_t *smr) {
+    unsigned long epoch = __atomic_load_n(&smr->epoch, __ATOMIC_ACQUIRE);
+    for(int i = 0; i < SMR_MAX_THREADS; ++i) {
+        unsigned long announced = __atomic_load_n(&smr->threads[i].epoch, __ATOMIC_ACQUIRE);
+        if((announced & 1) && (announced >> 1) != epoch)
+            return;
+    }
+
+    __sync_bool_compare_and_swap(&smr->epoch, epoch, epoch + 1);
+}
+
+
+static int smr_ptr_cmp(const void *lhs, const void *rhs) {
+    unsigned long l = (unsigned long)*(void * const *)lhs;
+    unsigned long r = (unsigned long)*(void * const *)rhs;
+    return (l > r) - (l < r);
+}
+
+
+//  Frees retired nodes that are safe and keeps the rest in place
+static void smr_scan(smr_t *smr, smr_thread_t *rec) {
+    void *hazards[SMR_MAX_THREADS * SMR_HAZARDS];
+    unsigned hazard_count = 0;
+    unsigned long epoch = 0;
+
+    if(smr->kind == SMR_EPOCH) {
+        smr_try_advance(smr);
+        epoch = __atomic_load_n(&smr->epoch, __ATOMIC_ACQUIRE);
+    } else {
+        __sync_synchronize();
+        for(int i = 0; i < SMR_MAX_THREADS; ++i) {
+            for(int j = 0; j < SMR_HAZARDS; ++j) {
+                void *hazard = __atomic_load_n(&smr->threads[i].hazards[j], __ATOMIC_ACQUIRE);
+                if(hazard)
+                    hazards[hazard_count++] = hazard;
+            }
+        }
+        qsort(hazards, hazard_count, sizeof(void *), smr_ptr_cmp);
+    }
+
+    unsigned kept = 0;
+    for(unsigned i = 0; i < rec->retired_count; ++i) {
+        void *ptr = rec->retired[i];
+        int reachable;
+        if(smr->kind == SMR_EPOCH)
+            reachable = rec->retired_epochs[i] + 2 > epoch;
+        else
+            reachable = bsearch(&ptr, hazards, hazard_count, sizeof(void *), smr_ptr_cmp) != NULL;
+
+        if(!reachable) {
+            free(ptr);
+            continue;
+        }
+
+        rec->retired[kept] = ptr;
+        rec->retired_epochs[kept] = rec->retired_epochs[i];
+        ++kept;
+    }
+    rec->retired_count = kept;
+}
+
+
+void smr_retire(smr_t *smr, void *ptr) {
+    smr_thread_t *rec = &smr->threads[smr_thread_id()];
+    if(rec->retired_count == rec->retired_cap) {
+        unsigned cap = rec->retired_cap ? rec->retired_cap * 2 : SMR_RETIRE_BATCH;
+        void **retired = (void **)realloc(rec->retired, cap * sizeof(void *));
+        if(!retired)
+            err_exit("Can't allocate memory for retired nodes");
+        rec->retired = retired;
+
+        unsigned long *epochs = (unsigned long *)realloc(rec->retired_epochs, cap * sizeof(unsigned long));
+        if(!epochs)
+            err_exit("Can't allocate memory for retired nodes");
+        rec->retired_epochs = epochs;
+
+        rec->retired_cap = cap;
+    }
+
+    //  The unlinking CAS is a full barrier, so this epoch is not older
+    //  than the one any thread could have found the node in
+    rec->retired[rec->retired_count] = ptr;
+    rec->retired_epochs[rec->retired_count] = __atomic_load_n(&smr->epoch, __ATOMIC_ACQUIRE);
+    ++rec->retired_count;
+
+    //  Nodes that survive a scan wait for the next batch
+    if(rec->retired_count % SMR_RETIRE_BATCH == 0)
+        smr_scan(smr, rec);
+}
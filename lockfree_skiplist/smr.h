@@ -0,0 +1,98 @@
+#ifndef SMR_H
+#define SMR_H
+
+
+/*
+ *  Safe memory reclamation for the lock-free structures
+ *
+ *  A node unlinked from a lock-free structure may still be read by other
+ *  threads, so it is retired instead of freed and released only when no
+ *  thread can reach it any more. Two schemes are behind the same calls:
+ *
+ *  SMR_EPOCH   epoch based reclamation. Readers only announce the epoch
+ *              they started in, retired nodes are freed two epochs later.
+ *              Cheapest for readers, but one stalled thread delays
+ *              every free.
+ *  SMR_HAZARD  hazard pointers. Readers publish each node they are about
+ *              to dereference, retired nodes are freed once no hazard
+ *              points to them. Every pointer load pays a store and a
+ *              fence, but garbage stays bounded even if a thread stalls.
+ *
+ *  Structures run every access between smr_enter and smr_exit and load
+ *  shared pointers through smr_protect, the scheme decides what that costs.
+ */
+
+
+#define SMR_MAX_THREADS     64
+#define SMR_HAZARDS         3   //  Per thread, enough for a list traversal
+
+//  A thread frees its retired nodes when this many are waiting
+#define SMR_RETIRE_BATCH    (2 * SMR_MAX_THREADS * SMR_HAZARDS)
+
+
+typedef enum smr_kind {
+    SMR_EPOCH,
+    SMR_HAZARD
+} smr_kind_t;
+
+
+typedef struct smr_thread {
+    //  Epoch of the current critical section shifted left by one
+    //  with the lowest bit set, 0 outside of critical sections
+    volatile unsigned long epoch;
+    void * volatile hazards[SMR_HAZARDS];
+    unsigned active;            //  Nesting depth of smr_enter
+
+    void        **retired;
+    unsigned long *retired_epochs;
+    unsigned      retired_count;
+    unsigned      retired_cap;
+
+    char padding[64];
+} smr_thread_t;
+
+
+typedef struct smr {
+    smr_kind_t kind;
+    volatile unsigned long epoch;
+    smr_thread_t threads[SMR_MAX_THREADS];
+} smr_t;
+
+
+smr_t   *smr_init(smr_kind_t kind);
+
+//  Frees everything retired, no thread may be inside the domain
+void    smr_fini(smr_t *smr);
+
+//  Critical sections nest, only the outermost smr_exit leaves
+void    smr_enter(smr_t *smr);
+void    smr_exit(smr_t *smr);
+
+//  Loads a shared pointer so that the node it points to
+//  can be dereferenced until the slot is reused or smr_exit
+//
+//  ARGUMENTS
+//  ---------
+//  smr:    reclamation domain
+//  slot:   hazard slot, 0 <= slot < SMR_HAZARDS
+//  src:    location of the pointer, it may carry the deletion mark
+//
+//  RETURNED VALUE
+//  --------------
+//  Value of *src as it was when the protection was already visible,
+//  the mark is kept
+//
+void    *smr_protect(smr_t *smr, int slot, void * volatile *src);
+
+//  Moves a pointer that is already protected to another slot
+void    smr_hold(smr_t *smr, int slot, void *ptr);
+
+//  Hands an unlinked node over to be freed when it is unreachable
+void    smr_retire(smr_t *smr, void *ptr);
+
+//  Gives the calling thread's slot back, call it before the thread exits.
+//  Nodes it retired stay with the slot and are freed by the next owner
+void    smr_thread_fini(void);
+
+
+#endif // SMR_H
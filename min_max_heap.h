@@ -0,0 +1,328 @@
+//
+// Created by alexaxnder on 19.10.26.
+//
+
+#ifndef DATA_STRUCTURES_MIN_MAX_HEAP_H
+#define DATA_STRUCTURES_MIN_MAX_HEAP_H
+
+#include <algorithm>
+#include <cstdlib>
+#include <functional>
+#include <iostream>
+#include <stdexcept>
+#include <vector>
+
+
+/*
+ *      Min-max heap (Atkinson et al, 1986)
+ *
+ *      Items on even levels are not greater than their descendants,
+ *      items on odd levels are not less than their descendants.
+ *      So the minimum is the root and the maximum is one of its children.
+ */
+template <class Item, class Compare = std::less<Item>>
+class MinMaxHeap {
+public:
+    MinMaxHeap() = default;
+    ~MinMaxHeap() = default;
+    explicit MinMaxHeap(std::vector<Item>*);
+
+    template <class U>
+    void Insert(U&&);
+
+    Item GetMin();
+    Item GetMax();
+    Item ExtractMin();
+    Item ExtractMax();
+    void ReplaceMin(const Item&);
+    void ReplaceMax(const Item&);
+
+    size_t Size();
+    bool Empty();
+    void Reserve(size_t);
+    void Print(std::ostream& out = std::cout);
+
+private:
+    std::vector<Item> data_;
+    Compare cmp_;
+
+    size_t MaxIdx();
+    bool IsMinLevel(size_t idx);
+    bool Before(bool min_level, size_t lhs, size_t rhs);
+
+    void BubbleUp(size_t idx);
+    void BubbleUpLevel(size_t idx, bool min_level);
+    void TrickleDown(size_t idx);
+};
+
+
+/*
+ *      Keeps k greatest (by Compare) items of a stream.
+ *      The worst kept item is the min of a single MinMaxHeap,
+ *      so eviction happens in place.
+ */
+template <class Item, class Compare = std::less<Item>>
+class BoundedTopK {
+public:
+    explicit BoundedTopK(size_t k);
+
+    bool Push(const Item&);
+
+    Item GetBest();
+    Item GetWorst();
+    Item ExtractBest();
+    Item ExtractWorst();
+
+    size_t Size();
+    bool Empty();
+    bool Full();
+
+private:
+    MinMaxHeap<Item, Compare> heap_;
+    Compare cmp_;
+    size_t k_;
+};
+
+
+/*
+ *      MinMaxHeap implementation
+ */
+template <class Item, class Compare>
+MinMaxHeap<Item, Compare>::MinMaxHeap(std::vector<Item>* items) {
+    data_ = std::move(*items);
+    for (size_t i = data_.size() / 2 + 1; i > 0; --i) {
+        TrickleDown(i - 1);
+    }
+}
+
+template <class Item, class Compare>
+template <class U>
+void MinMaxHeap<Item, Compare>::Insert(U&& item) {
+    data_.push_back(std::forward<U>(item));
+    BubbleUp(Size() - 1);
+}
+
+template <class Item, class Compare>
+Item MinMaxHeap<Item, Compare>::GetMin() {
+    return data_.front();
+}
+
+template <class Item, class Compare>
+Item MinMaxHeap<Item, Compare>::GetMax() {
+    return data_[MaxIdx()];
+}
+
+template <class Item, class Compare>
+Item MinMaxHeap<Item, Compare>::ExtractMin() {
+    std::swap(data_.front(), data_.back());
+    Item result = data_.back();
+    data_.pop_back();
+    TrickleDown(0);
+    return result;
+}
+
+template <class Item, class Compare>
+Item MinMaxHeap<Item, Compare>::ExtractMax() {
+    size_t idx = MaxIdx();
+    std::swap(data_[idx], data_.back());
+    Item result = data_.back();
+    data_.pop_back();
+    TrickleDown(idx);
+    return result;
+}
+
+template <class Item, class Compare>
+void MinMaxHeap<Item, Compare>::ReplaceMin(const Item& item) {
+    data_.front() = item;
+    TrickleDown(0);
+}
+
+template <class Item, class Compare>
+void MinMaxHeap<Item, Compare>::ReplaceMax(const Item& item) {
+    size_t idx = MaxIdx();
+    data_[idx] = item;
+
+    //  New item may be less than the root
+    if (idx != 0 && cmp_(data_[idx], data_[0])) {
+        std::swap(data_[idx], data_[0]);
+    }
+
+    TrickleDown(idx);
+}
+
+template <class Item, class Compare>
+size_t MinMaxHeap<Item, Compare>::Size() {
+    return data_.size();
+}
+
+template <class Item, class Compare>
+bool MinMaxHeap<Item, Compare>::Empty() {
+    return Size() == 0;
+}
+
+template <class Item, class Compare>
+void MinMaxHeap<Item, Compare>::Reserve(size_t capacity) {
+    data_.reserve(capacity);
+}
+
+template <class Item, class Compare>
+void MinMaxHeap<Item, Compare>::Print(std::ostream& out) {
+    for (const auto& item : data_) {
+        out << item << " ";
+    }
+    out << "\n";
+}
+
+template <class Item, class Compare>
+size_t MinMaxHeap<Item, Compare>::MaxIdx() {
+    if (Size() <= 2) {
+        return Size() - 1;
+    }
+
+    return cmp_(data_[1], data_[2]) ? 2 : 1;
+}
+
+template <class Item, class Compare>
+bool MinMaxHeap<Item, Compare>::IsMinLevel(size_t idx) {
+    bool min_level = true;
+    for (++idx; idx > 1; idx /= 2) {
+        min_level = !min_level;
+    }
+
+    return min_level;
+}
+
+//  Whether lhs should be closer to the root than rhs on the given level
+template <class Item, class Compare>
+bool MinMaxHeap<Item, Compare>::Before(bool min_level, size_t lhs, size_t rhs) {
+    return min_level ? cmp_(data_[lhs], data_[rhs]) : cmp_(data_[rhs], data_[lhs]);
+}
+
+template <class Item, class Compare>
+void MinMaxHeap<Item, Compare>::BubbleUp(size_t idx) {
+    if (idx == 0) {
+        return;
+    }
+
+    bool min_level = IsMinLevel(idx);
+    size_t parent = (idx - 1) / 2;
+    if (Before(!min_level, idx, parent)) {
+        std::swap(data_[idx], data_[parent]);
+        BubbleUpLevel(parent, !min_level);
+
+    } else {
+        BubbleUpLevel(idx, min_level);
+    }
+}
+
+template <class Item, class Compare>
+void MinMaxHeap<Item, Compare>::BubbleUpLevel(size_t idx, bool min_level) {
+    while (idx >= 3) {
+        size_t grandparent = ((idx - 1) / 2 - 1) / 2;
+        if (!Before(min_level, idx, grandparent)) {
+            break;
+        }
+
+        std::swap(data_[idx], data_[grandparent]);
+        idx = grandparent;
+    }
+}
+
+template <class Item, class Compare>
+void MinMaxHeap<Item, Compare>::TrickleDown(size_t idx) {
+    bool min_level = IsMinLevel(idx);
+
+    while (2 * idx + 1 < Size()) {
+        //  Find the best among children and grandchildren
+        size_t best = 2 * idx + 1;
+        size_t candidates[] = {2 * idx + 2, 4 * idx + 3, 4 * idx + 4, 4 * idx + 5, 4 * idx + 6};
+        for (size_t candidate : candidates) {
+            if (candidate < Size() && Before(min_level, candidate, best)) {
+                best = candidate;
+            }
+        }
+
+        if (!Before(min_level, best, idx)) {
+            return;
+        }
+
+        std::swap(data_[best], data_[idx]);
+        if (best <= 2 * idx + 2) {
+            return;
+        }
+
+        size_t parent = (best - 1) / 2;
+        if (Before(!min_level, best, parent)) {
+            std::swap(data_[best], data_[parent]);
+        }
+
+        idx = best;
+    }
+}
+
+
+/*
+ *      BoundedTopK implementation
+ */
+template <class Item, class Compare>
+BoundedTopK<Item, Compare>::BoundedTopK(size_t k)
+        : k_(k) {
+    if (k == 0) {
+        throw std::invalid_argument("BoundedTopK needs positive k");
+    }
+
+    heap_.Reserve(k);
+}
+
+//  Returns whether the item was kept
+template <class Item, class Compare>
+bool BoundedTopK<Item, Compare>::Push(const Item& item) {
+    if (!Full()) {
+        heap_.Insert(item);
+        return true;
+    }
+
+    if (!cmp_(heap_.GetMin(), item)) {
+        return false;
+    }
+
+    heap_.ReplaceMin(item);
+    return true;
+}
+
+template <class Item, class Compare>
+Item BoundedTopK<Item, Compare>::GetBest() {
+    return heap_.GetMax();
+}
+
+template <class Item, class Compare>
+Item BoundedTopK<Item, Compare>::GetWorst() {
+    return heap_.GetMin();
+}
+
+template <class Item, class Compare>
+Item BoundedTopK<Item, Compare>::ExtractBest() {
+    return heap_.ExtractMax();
+}
+
+template <class Item, class Compare>
+Item BoundedTopK<Item, Compare>::ExtractWorst() {
+    return heap_.ExtractMin();
+}
+
+template <class Item, class Compare>
+size_t BoundedTopK<Item, Compare>::Size() {
+    return heap_.Size();
+}
+
+template <class Item, class Compare>
+bool BoundedTopK<Item, Compare>::Empty() {
+    return heap_.Empty();
+}
+
+template <class Item, class Compare>
+bool BoundedTopK<Item, Compare>::Full() {
+    return heap_.Size() == k_;
+}
+
+#endif //DATA_STRUCTURES_MIN_MAX_HEAP_H
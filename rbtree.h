@@ -6,20 +6,167 @@
 #define DATA_STRUCTURES_RBTREE_H
 
 #include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <exception>
+#include <functional>
 #include <iostream>
 #include <initializer_list>
+#include <memory>
+#include <new>
 #include <stdexcept>
+#include <thread>
+#include <tuple>
+#include <type_traits>
+#include <utility>
 #include <vector>
 #include <set>
 
+#include "epoch_allocator.h"
+#include "slab_allocator.h"
+
+//  Whether nodes may be allocated and freed from several threads at once
+template <class Allocator>
+struct ConcurrentAllocator: std::false_type {};
+
+template <class T>
+struct ConcurrentAllocator<std::allocator<T>>: std::true_type {};
+
+
+/*
+ *      Node augmentation policies
+ *
+ *      Data is kept in every node and in nil_ (default constructed there),
+ *      Update recomputes node data from its children. It is called for
+ *      every node whose subtree changed, children first.
+ */
+struct NoAugmentation {
+    static constexpr bool kEnabled = false;
+
+    struct Data {};
+
+    template <class Node>
+    static void Update(Node*) {}
+};
+
+struct SubtreeSize {
+    static constexpr bool kEnabled = true;
+
+    struct Data {
+        size_t subtree_size = 0;
+    };
+
+    template <class Node>
+    static void Update(Node* node) {
+        node->subtree_size = node->left->subtree_size + node->right->subtree_size + 1;
+    }
+};
+
+//  In-order neighbour links kept on insert and erase, so iterator steps
+//  are single loads. nil_ closes the list into a ring. Set algebra
+//  relinks the whole result in O(n). Other data may be combined with
+//  it by deriving Data from several policy Data structs.
+struct ThreadedLinks {
+    static constexpr bool kEnabled = false;
+
+    struct Data {
+        Data* prev = nullptr;
+        Data* next = nullptr;
+    };
+
+    template <class Node>
+    static void Update(Node*) {}
+};
+
+//  Values are [first, second) intervals, max_end is the greatest
+//  second in the subtree. nil_ has no intervals and no max_end.
+template <class EndType>
+struct IntervalMaxEnd {
+    static constexpr bool kEnabled = true;
+
+    struct Data {
+        EndType max_end = EndType();
+        bool has_end = false;
+    };
+
+    template <class Node>
+    static void Update(Node* node) {
+        node->max_end = node->value.second;
+        node->has_end = true;
+        if (node->left->has_end && node->max_end < node->left->max_end) {
+            node->max_end = node->left->max_end;
+        }
+
+        if (node->right->has_end && node->max_end < node->right->max_end) {
+            node->max_end = node->right->max_end;
+        }
+    }
+};
+
+
+//  Key extractors: Set orders values themselves, Map orders pairs by first
 template <class ValueType>
+struct RBIdentity {
+    typedef ValueType KeyType;
+
+    const KeyType& operator()(const ValueType& value) const {
+        return value;
+    }
+};
+
+template <class PairType>
+struct RBSelectFirst {
+    typedef typename std::remove_const<typename PairType::first_type>::type KeyType;
+
+    const KeyType& operator()(const PairType& value) const {
+        return value.first;
+    }
+};
+
+
+//  FrozenSet search prefetches this many levels ahead,
+//  batched search runs this many descents side by side
+constexpr size_t frozen_prefetch_levels = 4;
+constexpr size_t frozen_batch_size = 16;
+
+template <class ValueType,
+          class Compare = std::less<ValueType>,
+          class KeyOfValue = RBIdentity<ValueType>>
+class FrozenSet;
+
+
+template <class ValueType,
+          class Allocator = std::allocator<ValueType>,
+          class Augmentation = NoAugmentation,
+          class Compare = std::less<ValueType>,
+          class KeyOfValue = RBIdentity<ValueType>>
 class Set {
+    struct NodeLinks;
     struct Node;
     enum class Color;
 
+    typedef typename KeyOfValue::KeyType KeyType;
+    typedef std::integral_constant<
+            bool, std::is_base_of<ThreadedLinks::Data, typename Augmentation::Data>::value
+    > Threaded;
+    typedef HasConcurrentReaders<Allocator> SharedLinks;
+
+    //  Iterator gives const access when the whole value is the key,
+    //  Map pairs keep the key const and the mapped value writable
+    typedef typename std::conditional<
+            std::is_same<KeyType, ValueType>::value,
+            const ValueType, ValueType>::type IteratorValue;
+
+    template <class MapKey, class MapMapped, class MapCompare, class MapAllocator>
+    friend class Map;
+    template <class ConcurrentValue, class ConcurrentCompare>
+    friend class ConcurrentSet;
+
 public:
     class iterator:
-            public std::iterator<std::bidirectional_iterator_tag, ValueType> {
+            public std::iterator<std::bidirectional_iterator_tag, IteratorValue> {
+        friend class Set;
+
     public:
         iterator(): cur_node_{nullptr}, set_{nullptr} {};
         explicit iterator(Node* node, const Set* set);
@@ -30,8 +177,12 @@ public:
         iterator& operator--();
         iterator operator--(int);
 
-        const ValueType& operator*();
-        const ValueType* operator->();
+        IteratorValue& operator*();
+        IteratorValue* operator->();
+
+        //  O(log n), only with SubtreeSize augmentation
+        iterator& operator+=(ptrdiff_t n);
+        iterator& operator-=(ptrdiff_t n);
 
         bool operator==(const iterator& rhs) const;
         bool operator!=(const iterator& rhs) const;
@@ -50,49 +201,148 @@ public:
     Set(BidirectionalIterator first, BidirectionalIterator last);
 
     Set(std::initializer_list<ValueType> list);
-    Set(const Set<ValueType>& rhs);
+    Set(const Set& rhs);
+    Set(Set&& rhs) noexcept;
+
+    Set& operator=(const Set& rhs);
+    Set& operator=(Set&& rhs) noexcept;
 
-    Set& operator=(const Set<ValueType>& rhs);
+    template <class ForwardIterator>
+    static Set from_sorted(ForwardIterator first, ForwardIterator last);
+
+    //  O(n) read only copy with cache friendly search
+    FrozenSet<ValueType, Compare, KeyOfValue> freeze() const;
 
     ~Set();
-    void insert(const ValueType& value);
-    void erase(const ValueType& value);
-    iterator find(const ValueType& value) const;
-    iterator lower_bound(const ValueType& value) const;
+
+    //  Single descent, the bool tells whether value was inserted
+    std::pair<iterator, bool> insert(const ValueType& value);
+
+    //  Amortized O(1) when value goes right before or right after hint,
+    //  e.g. appending ascending values with end() or the last result as hint
+    iterator insert(iterator hint, const ValueType& value);
+
+    template <class... Args>
+    std::pair<iterator, bool> emplace(Args&&... args);
+    void erase(const KeyType& key);
+
+    //  Range erasure cuts [first, last) out with two splits and a join,
+    //  O(log n + k) for k erased values without any per value rebalancing
+    iterator erase(iterator first, iterator last);
+    void erase_range(const KeyType& lo, const KeyType& hi);
+
+    //  O(n), survivors are relinked into a balanced tree at once.
+    //  Returns the number of erased values.
+    template <class Predicate>
+    size_t erase_if(Predicate pred);
+    iterator find(const KeyType& key) const;
+    iterator lower_bound(const KeyType& key) const;
 
 
     size_t size() const;
     bool empty() const;
+    void swap(Set& rhs) noexcept;
+
+    //  Set algebra is done in place with rhs left intact. It costs
+    //  O(m log(n / m + 1)) for m = rhs.size() <= n = size(),
+    //  recursion branches run on up to threads_number threads.
+    void unite(const Set& rhs, size_t threads_number = 1);
+    void intersect(const Set& rhs, size_t threads_number = 1);
+    void subtract(const Set& rhs, size_t threads_number = 1);
+
+    //  Order statistics, O(log n), only with SubtreeSize augmentation.
+    //  rank is the number of values less than value,
+    //  count_range is the number of values in [lo, hi).
+    size_t rank(const KeyType& key) const;
+    iterator select(size_t k) const;
+    size_t count_range(const KeyType& lo, const KeyType& hi) const;
+
+    //  Calls visit for every value in [lo, hi) in order, O(log n + k)
+    //  and one load per step with ThreadedLinks
+    template <class Visitor>
+    void for_each_in_range(const KeyType& lo, const KeyType& hi, Visitor visit) const;
+
+    //  Interval queries, only with IntervalMaxEnd augmentation. Compare
+    //  must order intervals by first, bounds are compared with operator<.
+    //  overlaps visits intervals meeting [lo, hi), stab those containing
+    //  point, both in order and in O((k + 1) log n) for k results.
+    //  overlaps_batch takes a range of (lo, hi) pairs and calls
+    //  visit(query number, interval), walking the tree once for all.
+    template <class Bound, class Visitor>
+    void overlaps(const Bound& lo, const Bound& hi, Visitor visit) const;
+    template <class Bound, class Visitor>
+    void stab(const Bound& point, Visitor visit) const;
+    template <class ForwardIterator, class Visitor>
+    void overlaps_batch(ForwardIterator first, ForwardIterator last, Visitor visit) const;
 
 private:
 
-    struct Node {
-        const ValueType value;
+    struct NodeLinks: Augmentation::Data {
         Color color;
         Node* left;
         Node* right;
         Node* parent;
 
-        explicit Node(ValueType value);
-        Node(const ValueType& value, Color color);
-        Node(const ValueType&, Color color, Node* left, Node* right, Node* parent);
+        NodeLinks(Color color, Node* left, Node* right, Node* parent);
+    };
+
+    //  value is a union member so that nil_ is a real Node without one
+    struct Node: NodeLinks {
+        union {
+            ValueType value;
+        };
+
+        struct NilTag {};
+
+        explicit Node(NilTag);
+        template <class... Args>
+        explicit Node(Args&&... args);
+        ~Node();
     };
 
     enum class Color {
         kRed, kBlack
     };
 
+    typedef typename std::allocator_traits<Allocator>
+            ::template rebind_alloc<Node> NodeAllocator;
+    typedef std::allocator_traits<NodeAllocator> NodeAllocatorTraits;
+
+    template <class... Args>
+    Node* CreateNode(Args&&... args);
+    void DestroyNode(Node*);
+
+    void Update(Node*);
+    void UpdateToRoot(Node*);
+    size_t NodeRank(Node*) const;
+    Node* SelectNode(size_t k) const;
+
     Node* TreeMinimum(Node*) const;
     Node* TreeMaximum(Node*) const;
     Node* TreeSuccessor(Node*) const;
     Node* TreePredecessor(Node*) const;
-    Node* TreeFind(const ValueType&) const;
-    Node* TreeLowerBound(const ValueType&) const;
-
-    bool Geq(const ValueType&, const ValueType&) const;
-    bool Greater(const ValueType&, const ValueType&) const;
-    bool Eq(const ValueType&, const ValueType&) const;
-    bool Neq(const ValueType&, const ValueType&) const;
+    Node* TreeFind(const KeyType&) const;
+    Node* TreeLowerBound(const KeyType&) const;
+    Node* FindInsertPosition(const KeyType&, Node** parent, bool* as_left) const;
+    Node* HintParent(Node* hint, const KeyType&, bool* as_left, Node** found) const;
+    void ResetBounds();
+    void Rethread();
+    void ThreadSubtree(Node* node, Node** last);
+    void ThreadLink(Node* prev, Node* next);
+    void ThreadLink(Node* prev, Node* next, std::true_type);
+    void ThreadLink(Node* prev, Node* next, std::false_type);
+    Node* ThreadNext(Node*, std::true_type) const;
+    Node* ThreadNext(Node*, std::false_type) const;
+    Node* ThreadPrev(Node*, std::true_type) const;
+    Node* ThreadPrev(Node*, std::false_type) const;
+    void AcquireNil();
+
+    static const KeyType& KeyOf(const Node*);
+    bool Less(const KeyType&, const KeyType&) const;
+    bool Geq(const KeyType&, const KeyType&) const;
+    bool Greater(const KeyType&, const KeyType&) const;
+    bool Eq(const KeyType&, const KeyType&) const;
+    bool Neq(const KeyType&, const KeyType&) const;
 
     bool IsNil(Node*) const;
     bool IsRoot(Node*) const;
@@ -101,24 +351,210 @@ private:
     void SetRed(Node*);
     void SetBlack(Node*);
 
-    void DeleteSubtree(Node*&);
+    size_t DeleteSubtree(Node*&);
+    size_t CloneSubtree(Node* src, Node* parent, Node*& slot, const Set& rhs);
+
+    template <class ForwardIterator>
+    void BuildSorted(ForwardIterator first, ForwardIterator last);
+    template <class Item, class MakeNode>
+    void BuildBalanced(const std::vector<Item>& items, MakeNode make);
+    template <class Item, class MakeNode>
+    void BuildSubtree(const std::vector<Item>& items, size_t lo, size_t hi,
+                      Node* parent, Node*& slot, size_t depth, size_t red_depth,
+                      MakeNode make);
+
+    void EraseRange(Node* first, Node* last);
+
+    template <class Bound, class StartsBefore, class Visitor>
+    void OverlapSubtree(Node*, const Bound& lo, StartsBefore starts_before,
+                        Visitor& visit) const;
+    template <class Query, class Visitor>
+    void BatchOverlaps(Node*, const std::vector<Query>& queries,
+                       size_t* first, size_t* last, Visitor& visit) const;
+
+    //  Stores left, right and root_ links that ConcurrentSet readers follow
+    void SetLink(Node*& link, Node* node);
+    void SetLink(Node*& link, Node* node, std::true_type);
+    void SetLink(Node*& link, Node* node, std::false_type);
 
     void LeftRotate(Node*);
     void RightRotate(Node*);
 
-    void RBInsert(Node*&);
+    void RBLink(Node* z_node, Node* y_node, bool as_left);
     void RBInsertFixup(Node*&);
 
     void RBTransplant(Node*&, Node*&);
     void RBDelete(Node*&);
     void RBDeleteFixup(Node*&);
 
+    //  Detached subtree with its black height (nil has zero)
+    struct Subtree {
+        Node* root;
+        size_t black_height;
+    };
+
+    size_t BlackHeight(Node*) const;
+    Subtree Child(const Subtree&, Node* child) const;
+    Subtree Blacken(Subtree);
+    Node* Link(Node* left, Node* key, Node* right, Color color);
+    Node* RotateLeftDetached(Node*);
+    Node* RotateRightDetached(Node*);
+
+    Subtree Join(Subtree left, Node* key, Subtree right);
+    Subtree JoinRight(Subtree left, Node* key, Subtree right);
+    Subtree JoinLeft(Subtree left, Node* key, Subtree right);
+    Subtree Join2(Subtree left, Subtree right);
+    void Split(Subtree tree, const KeyType& key,
+               Subtree* left, Node** found, Subtree* right);
+    void SplitLast(Subtree tree, Subtree* rest, Node** last);
+
+    Subtree Union(Subtree, Node* rhs_node, const Set& rhs, size_t threads_number, long* delta);
+    Subtree Intersection(Subtree, Node* rhs_node, const Set& rhs, size_t threads_number, long* delta);
+    Subtree Difference(Subtree, Node* rhs_node, const Set& rhs, size_t threads_number, long* delta);
+    void SetRoot(Subtree, long delta);
+
+    template <class LeftTask, class RightTask>
+    static void ForkJoin(size_t threads_number, LeftTask left, RightTask right);
+
+    //  nil_ is nullptr only in a moved from Set, it is recreated on write.
+    //  leftmost_ and rightmost_ are nil_ in an empty Set.
+    NodeAllocator alloc_;
+    Compare comp_;
     Node* nil_;
     Node* root_;
+    Node* leftmost_;
+    Node* rightmost_;
     size_t size_;
 };
 
 
+//  Pass the bigger set as lhs, it is consumed instead of being walked
+template <class ValueType, class Allocator, class Augmentation, class Compare, class KeyOfValue>
+Set<ValueType, Allocator, Augmentation, Compare, KeyOfValue>
+set_union(Set<ValueType, Allocator, Augmentation, Compare, KeyOfValue> lhs,
+          const Set<ValueType, Allocator, Augmentation, Compare, KeyOfValue>& rhs,
+          size_t threads_number = 1);
+
+template <class ValueType, class Allocator, class Augmentation, class Compare, class KeyOfValue>
+Set<ValueType, Allocator, Augmentation, Compare, KeyOfValue>
+set_intersection(Set<ValueType, Allocator, Augmentation, Compare, KeyOfValue> lhs,
+                 const Set<ValueType, Allocator, Augmentation, Compare, KeyOfValue>& rhs,
+                 size_t threads_number = 1);
+
+template <class ValueType, class Allocator, class Augmentation, class Compare, class KeyOfValue>
+Set<ValueType, Allocator, Augmentation, Compare, KeyOfValue>
+set_difference(Set<ValueType, Allocator, Augmentation, Compare, KeyOfValue> lhs,
+               const Set<ValueType, Allocator, Augmentation, Compare, KeyOfValue>& rhs,
+               size_t threads_number = 1);
+
+
+/*
+ *      Ordered map on the same red-black core.
+ *      Values are pairs ordered by key, mapped values may be changed
+ *      through iterator. Set algebra works on keys.
+ */
+template <class KeyType,
+          class MappedType,
+          class Compare = std::less<KeyType>,
+          class Allocator = std::allocator<std::pair<const KeyType, MappedType>>>
+class Map: public Set<std::pair<const KeyType, MappedType>, Allocator, NoAugmentation, Compare,
+                      RBSelectFirst<std::pair<const KeyType, MappedType>>> {
+    typedef Set<std::pair<const KeyType, MappedType>, Allocator, NoAugmentation, Compare,
+                RBSelectFirst<std::pair<const KeyType, MappedType>>> Tree;
+
+public:
+    using Tree::Tree;
+
+    //  Single descent, default constructs the mapped value if key is absent
+    MappedType& operator[](const KeyType& key);
+
+    MappedType& at(const KeyType& key);
+    const MappedType& at(const KeyType& key) const;
+};
+
+
+/*
+ *      Immutable set in Eytzinger (BFS) order: node k has children 2k
+ *      and 2k + 1, so the top levels share a few cache lines. Search is
+ *      branchless and prefetches the cache line of the descendants
+ *      frozen_prefetch_levels levels below. Batched search interleaves
+ *      frozen_batch_size descents to overlap their cache misses.
+ *      Iteration walks the implicit tree in sorted order.
+ */
+template <class ValueType, class Compare, class KeyOfValue>
+class FrozenSet {
+    typedef typename KeyOfValue::KeyType KeyType;
+
+public:
+    class iterator:
+            public std::iterator<std::bidirectional_iterator_tag, const ValueType> {
+    public:
+        iterator(): idx_{0}, set_{nullptr} {};
+        iterator(size_t idx, const FrozenSet* set);
+
+        iterator& operator++();
+        iterator operator++(int);
+
+        iterator& operator--();
+        iterator operator--(int);
+
+        const ValueType& operator*();
+        const ValueType* operator->();
+
+        bool operator==(const iterator& rhs) const;
+        bool operator!=(const iterator& rhs) const;
+
+    private:
+        //  Eytzinger index, 0 is end
+        size_t idx_;
+        const FrozenSet* set_;
+    };
+
+    iterator begin() const;
+    iterator end() const;
+
+    FrozenSet() = default;
+
+    //  Range must be sorted by Compare and have no equal keys
+    template <class ForwardIterator>
+    FrozenSet(ForwardIterator first, ForwardIterator last, const Compare& comp = Compare());
+
+    iterator find(const KeyType& key) const;
+    iterator lower_bound(const KeyType& key) const;
+
+    //  Write one iterator per key to out, keys are read once
+    template <class ForwardIterator, class OutputIterator>
+    OutputIterator find_batch(ForwardIterator first, ForwardIterator last,
+                              OutputIterator out) const;
+    template <class ForwardIterator, class OutputIterator>
+    OutputIterator lower_bound_batch(ForwardIterator first, ForwardIterator last,
+                                     OutputIterator out) const;
+
+    size_t size() const;
+    bool empty() const;
+
+private:
+    static constexpr size_t kPrefetchStride = size_t(1) << frozen_prefetch_levels;
+
+    template <class Iterator>
+    static void FillOrder(const std::vector<Iterator>& items, std::vector<Iterator>* order,
+                          size_t idx, size_t* next);
+
+    const ValueType& At(size_t idx) const;
+    bool Less(const KeyType&, const KeyType&) const;
+    void Prefetch(size_t idx) const;
+    static size_t ResolveDescent(size_t idx);
+
+    template <class ForwardIterator, class Visitor>
+    void BatchDescent(ForwardIterator first, ForwardIterator last, Visitor visit) const;
+
+    //  Node k is values_[k - 1]
+    std::vector<ValueType> values_;
+    Compare comp_;
+    size_t depth_ = 0;
+};
+
+
 /*
  *
  *              Set implementation
@@ -131,51 +567,82 @@ private:
  *
  */
 
-template <class ValueType>
-Set<ValueType>
+template <class ValueType, class Allocator, class Augmentation, class Compare, class KeyOfValue>
+Set<ValueType, Allocator, Augmentation, Compare, KeyOfValue>
 ::Set():
-        nil_{new Node(ValueType(), Color::kBlack)},
+        nil_{nullptr},
         size_{0}
 {
-    root_ = nil_->left = nil_->right = nil_->parent = nil_;
+    AcquireNil();
 }
 
-template <class ValueType>
+template <class ValueType, class Allocator, class Augmentation, class Compare, class KeyOfValue>
 template <class BidirectionalIterator>
-Set<ValueType>
+Set<ValueType, Allocator, Augmentation, Compare, KeyOfValue>
 ::Set(
         BidirectionalIterator first,
         BidirectionalIterator last
 ):
         Set()
 {
+    auto key_less = [this](const ValueType& lhs, const ValueType& rhs) {
+        return Less(KeyOfValue()(lhs), KeyOfValue()(rhs));
+    };
+
+    if (std::is_sorted(first, last, key_less)) {
+        BuildSorted(first, last);
+        return;
+    }
+
     while (first != last) {
         insert(*first);
         ++first;
     }
 }
 
-template <class ValueType>
-Set<ValueType>
+template <class ValueType, class Allocator, class Augmentation, class Compare, class KeyOfValue>
+Set<ValueType, Allocator, Augmentation, Compare, KeyOfValue>
 ::Set(
         std::initializer_list<ValueType> list
 ):
         Set(list.begin(), list.end())
 {}
 
-template <class ValueType>
-Set<ValueType>
+template <class ValueType, class Allocator, class Augmentation, class Compare, class KeyOfValue>
+Set<ValueType, Allocator, Augmentation, Compare, KeyOfValue>
 ::Set(
         const Set& rhs
 ):
-        Set(rhs.begin(), rhs.end())
+        Set()
 {
-    size_ = rhs.size_;
+    comp_ = rhs.comp_;
+    if (!rhs.IsNil(rhs.root_)) {
+        size_ = CloneSubtree(rhs.root_, nil_, root_, rhs);
+        ResetBounds();
+    }
 }
 
-template <class ValueType>
-Set<ValueType>&
-Set<ValueType>
+//  Takes rhs sentinel with the tree, so rhs is left without one
+template <class ValueType, class Allocator, class Augmentation, class Compare, class KeyOfValue>
+Set<ValueType, Allocator, Augmentation, Compare, KeyOfValue>
+::Set(
+        Set&& rhs
+) noexcept:
+        alloc_{rhs.alloc_},
+        comp_{rhs.comp_},
+        nil_{rhs.nil_},
+        root_{rhs.root_},
+        leftmost_{rhs.leftmost_},
+        rightmost_{rhs.rightmost_},
+        size_{rhs.size_}
+{
+    rhs.nil_ = rhs.root_ = rhs.leftmost_ = rhs.rightmost_ = nullptr;
+    rhs.size_ = 0;
+}
+
+template <class ValueType, class Allocator, class Augmentation, class Compare, class KeyOfValue>
+Set<ValueType, Allocator, Augmentation, Compare, KeyOfValue>&
+Set<ValueType, Allocator, Augmentation, Compare, KeyOfValue>
 ::operator=(
         const Set& rhs
 ) {
@@ -183,50 +650,151 @@ Set<ValueType>
         return *this;
     }
 
-    DeleteSubtree(root_);
+    AcquireNil();
+    if (!IsNil(root_)) {
+        DeleteSubtree(root_);
+    }
+
     root_ = nil_;
+    size_ = 0;
+    comp_ = rhs.comp_;
+
+    if (!rhs.IsNil(rhs.root_)) {
+        try {
+            size_ = CloneSubtree(rhs.root_, nil_, root_, rhs);
 
-    auto it = rhs.begin();
-    while (it != rhs.end()) {
-        insert(*it);
-        ++it;
+        } catch (...) {
+            DeleteSubtree(root_);
+            root_ = nil_;
+            throw;
+        }
     }
 
-    size_ = rhs.size_;
+    ResetBounds();
     return *this;
 }
 
-template <class ValueType>
-Set<ValueType>
+//  Old values of this are destroyed together with rhs
+template <class ValueType, class Allocator, class Augmentation, class Compare, class KeyOfValue>
+Set<ValueType, Allocator, Augmentation, Compare, KeyOfValue>&
+Set<ValueType, Allocator, Augmentation, Compare, KeyOfValue>
+::operator=(
+        Set&& rhs
+) noexcept {
+    swap(rhs);
+    return *this;
+}
+
+template <class ValueType, class Allocator, class Augmentation, class Compare, class KeyOfValue>
+template <class ForwardIterator>
+Set<ValueType, Allocator, Augmentation, Compare, KeyOfValue>
+Set<ValueType, Allocator, Augmentation, Compare, KeyOfValue>
+::from_sorted(
+        ForwardIterator first,
+        ForwardIterator last
+) {
+    Set result;
+    result.BuildSorted(first, last);
+    return result;
+}
+
+template <class ValueType, class Allocator, class Augmentation, class Compare, class KeyOfValue>
+FrozenSet<ValueType, Compare, KeyOfValue>
+Set<ValueType, Allocator, Augmentation, Compare, KeyOfValue>
+::freeze() const {
+    return FrozenSet<ValueType, Compare, KeyOfValue>(begin(), end(), comp_);
+}
+
+template <class ValueType, class Allocator, class Augmentation, class Compare, class KeyOfValue>
+Set<ValueType, Allocator, Augmentation, Compare, KeyOfValue>
 ::~Set() {
-    if (!IsNil(root_)) {
+    //  Bulk releasing allocator frees nodes itself when it dies
+    bool skip_nodes = ReleasesInBulk<NodeAllocator>::value &&
+                      std::is_trivially_destructible<ValueType>::value;
+
+    if (!IsNil(root_) && !skip_nodes) {
         DeleteSubtree(root_);
     }
 
-    delete nil_;
+    //  ~Node would destroy the value nil_ never had
+    ::operator delete(nil_);
 }
 
-template <class ValueType>
-void
-Set<ValueType>
+template <class ValueType, class Allocator, class Augmentation, class Compare, class KeyOfValue>
+std::pair<typename Set<ValueType, Allocator, Augmentation, Compare, KeyOfValue>::iterator, bool>
+Set<ValueType, Allocator, Augmentation, Compare, KeyOfValue>
 ::insert(
         const ValueType& value
 ) {
-    if (!IsNil(TreeFind(value))) {
-        return;
+    AcquireNil();
+
+    Node* parent;
+    bool as_left;
+    Node* found = FindInsertPosition(KeyOfValue()(value), &parent, &as_left);
+    if (!IsNil(found)) {
+        return {iterator(found, this), false};
     }
 
-    auto val_node = new Node(value);
-    return RBInsert(val_node);
+    Node* val_node = CreateNode(value);
+    RBLink(val_node, parent, as_left);
+    return {iterator(val_node, this), true};
 }
 
-template <class ValueType>
+template <class ValueType, class Allocator, class Augmentation, class Compare, class KeyOfValue>
+typename Set<ValueType, Allocator, Augmentation, Compare, KeyOfValue>::iterator
+Set<ValueType, Allocator, Augmentation, Compare, KeyOfValue>
+::insert(
+        iterator hint,
+        const ValueType& value
+) {
+    AcquireNil();
+
+    const KeyType& key = KeyOfValue()(value);
+    Node* found = nil_;
+    bool as_left;
+    Node* parent = HintParent(hint.cur_node_, key, &as_left, &found);
+    if (!parent) {
+        found = FindInsertPosition(key, &parent, &as_left);
+    }
+
+    if (!IsNil(found)) {
+        return iterator(found, this);
+    }
+
+    Node* val_node = CreateNode(value);
+    RBLink(val_node, parent, as_left);
+    return iterator(val_node, this);
+}
+
+template <class ValueType, class Allocator, class Augmentation, class Compare, class KeyOfValue>
+template <class... Args>
+std::pair<typename Set<ValueType, Allocator, Augmentation, Compare, KeyOfValue>::iterator, bool>
+Set<ValueType, Allocator, Augmentation, Compare, KeyOfValue>
+::emplace(
+        Args&&... args
+) {
+    AcquireNil();
+
+    Node* val_node = CreateNode(std::forward<Args>(args)...);
+    Node* parent;
+    bool as_left;
+    Node* found = FindInsertPosition(KeyOf(val_node), &parent, &as_left);
+    if (!IsNil(found)) {
+        DestroyNode(val_node);
+        return {iterator(found, this), false};
+    }
+
+    RBLink(val_node, parent, as_left);
+    return {iterator(val_node, this), true};
+}
+
+template <class ValueType, class Allocator, class Augmentation, class Compare, class KeyOfValue>
 void
-Set<ValueType>
+Set<ValueType, Allocator, Augmentation, Compare, KeyOfValue>
 ::erase(
-        const ValueType& value
+        const KeyType& key
 ) {
-    auto val_node = TreeFind(value);
+    auto val_node = TreeFind(key);
     if (IsNil(val_node)) {
         return;
     }
@@ -234,93 +802,381 @@ Set<ValueType>
     return RBDelete(val_node);
 }
 
-template <class ValueType>
-typename Set<ValueType>::iterator
-Set<ValueType>
+template <class ValueType, class Allocator, class Augmentation, class Compare, class KeyOfValue>
+typename Set<ValueType, Allocator, Augmentation, Compare, KeyOfValue>::iterator
+Set<ValueType, Allocator, Augmentation, Compare, KeyOfValue>
+::erase(
+        iterator first,
+        iterator last
+) {
+    EraseRange(first.cur_node_, last.cur_node_);
+    return iterator(last.cur_node_, this);
+}
+
+template <class ValueType, class Allocator, class Augmentation, class Compare, class KeyOfValue>
+void
+Set<ValueType, Allocator, Augmentation, Compare, KeyOfValue>
+::erase_range(
+        const KeyType& lo,
+        const KeyType& hi
+) {
+    if (!Less(lo, hi)) {
+        return;
+    }
+
+    EraseRange(TreeLowerBound(lo), TreeLowerBound(hi));
+}
+
+template <class ValueType, class Allocator, class Augmentation, class Compare, class KeyOfValue>
+template <class Predicate>
+size_t
+Set<ValueType, Allocator, Augmentation, Compare, KeyOfValue>
+::erase_if(
+        Predicate pred
+) {
+    std::vector<Node*> kept;
+    std::vector<Node*> erased;
+    kept.reserve(size_);
+    for (Node* node = leftmost_; !IsNil(node); node = TreeSuccessor(node)) {
+        if (pred(static_cast<const ValueType&>(node->value))) {
+            erased.push_back(node);
+
+        } else {
+            kept.push_back(node);
+        }
+    }
+
+    if (erased.empty()) {
+        return 0;
+    }
+
+    for (Node* node : erased) {
+        DestroyNode(node);
+    }
+
+    size_ = kept.size();
+    BuildBalanced(kept, [](Node* node) {
+        return node;
+    });
+
+    return erased.size();
+}
+
+template <class ValueType, class Allocator, class Augmentation, class Compare, class KeyOfValue>
+typename Set<ValueType, Allocator, Augmentation, Compare, KeyOfValue>::iterator
+Set<ValueType, Allocator, Augmentation, Compare, KeyOfValue>
 ::find(
-        const ValueType& value
+        const KeyType& key
 ) const {
-    return iterator(TreeFind(value), this);
+    return iterator(TreeFind(key), this);
 }
 
-template <class ValueType>
-typename Set<ValueType>::iterator
-Set<ValueType>
+template <class ValueType, class Allocator, class Augmentation, class Compare, class KeyOfValue>
+typename Set<ValueType, Allocator, Augmentation, Compare, KeyOfValue>::iterator
+Set<ValueType, Allocator, Augmentation, Compare, KeyOfValue>
 ::lower_bound(
-        const ValueType &value
+        const KeyType& key
 ) const {
-    return iterator(TreeLowerBound(value), this);
+    return iterator(TreeLowerBound(key), this);
 }
 
-template <class ValueType>
+template <class ValueType, class Allocator, class Augmentation, class Compare, class KeyOfValue>
 size_t
-Set<ValueType>
+Set<ValueType, Allocator, Augmentation, Compare, KeyOfValue>
 ::size() const {
     return size_;
 }
 
-template <class ValueType>
+template <class ValueType, class Allocator, class Augmentation, class Compare, class KeyOfValue>
 bool
-Set<ValueType>
+Set<ValueType, Allocator, Augmentation, Compare, KeyOfValue>
 ::empty() const {
     return size_ == 0;
 }
 
-template <class ValueType>
-typename Set<ValueType>::Node*
-Set<ValueType>
-::TreeMinimum(
-        Node* root
+template <class ValueType, class Allocator, class Augmentation, class Compare, class KeyOfValue>
+size_t
+Set<ValueType, Allocator, Augmentation, Compare, KeyOfValue>
+::rank(
+        const KeyType& key
 ) const {
-    Node* cur = root;
+    static_assert(std::is_base_of<SubtreeSize::Data, typename Augmentation::Data>::value,
+                  "Order statistics need SubtreeSize augmentation");
 
-    while (!IsNil(cur->left)) {
-        cur = cur->left;
+    size_t rank = 0;
+    Node* cur = root_;
+    while (!IsNil(cur)) {
+        if (Less(KeyOf(cur), key)) {
+            rank += cur->left->subtree_size + 1;
+            cur = cur->right;
+
+        } else {
+            cur = cur->left;
+        }
     }
 
-    return cur;
+    return rank;
 }
 
-template <class ValueType>
-typename Set<ValueType>::Node*
-Set<ValueType>
-::TreeMaximum(
-        Node* root
+template <class ValueType, class Allocator, class Augmentation, class Compare, class KeyOfValue>
+typename Set<ValueType, Allocator, Augmentation, Compare, KeyOfValue>::iterator
+Set<ValueType, Allocator, Augmentation, Compare, KeyOfValue>
+::select(
+        size_t k
 ) const {
-    Node* cur = root;
+    return iterator(SelectNode(k), this);
+}
 
-    while (!IsNil(cur->right)) {
-        cur = cur->right;
+template <class ValueType, class Allocator, class Augmentation, class Compare, class KeyOfValue>
+size_t
+Set<ValueType, Allocator, Augmentation, Compare, KeyOfValue>
+::count_range(
+        const KeyType& lo,
+        const KeyType& hi
+) const {
+    if (!Less(lo, hi)) {
+        return 0;
     }
 
-    return cur;
+    return rank(hi) - rank(lo);
 }
 
-template <class ValueType>
-typename Set<ValueType>::Node*
-Set<ValueType>
-::TreeSuccessor(
-        Node* root
+template <class ValueType, class Allocator, class Augmentation, class Compare, class KeyOfValue>
+template <class Visitor>
+void
+Set<ValueType, Allocator, Augmentation, Compare, KeyOfValue>
+::for_each_in_range(
+        const KeyType& lo,
+        const KeyType& hi,
+        Visitor visit
 ) const {
-    if (!IsNil(root->right)) {
-        return TreeMinimum(root->right);
+    for (Node* node = TreeLowerBound(lo); !IsNil(node) && Less(KeyOf(node), hi);
+         node = TreeSuccessor(node)) {
+        visit(static_cast<IteratorValue&>(node->value));
     }
+}
 
-    auto y_node = root->parent;
-    while (!IsNil(y_node) && root == y_node->right) {
-        root = y_node;
-        y_node = y_node->parent;
+template <class ValueType, class Allocator, class Augmentation, class Compare, class KeyOfValue>
+template <class Bound, class Visitor>
+void
+Set<ValueType, Allocator, Augmentation, Compare, KeyOfValue>
+::overlaps(
+        const Bound& lo,
+        const Bound& hi,
+        Visitor visit
+) const {
+    static_assert(std::is_base_of<typename IntervalMaxEnd<typename ValueType::second_type>::Data,
+                                  typename Augmentation::Data>::value,
+                  "Interval queries need IntervalMaxEnd augmentation");
+
+    if (!(lo < hi)) {
+        return;
     }
 
-    return y_node;
+    OverlapSubtree(root_, lo, [&hi](const Bound& start) {
+        return start < hi;
+    }, visit);
 }
 
-template <class ValueType>
-typename Set<ValueType>::Node*
-Set<ValueType>
+template <class ValueType, class Allocator, class Augmentation, class Compare, class KeyOfValue>
+template <class Bound, class Visitor>
+void
+Set<ValueType, Allocator, Augmentation, Compare, KeyOfValue>
+::stab(
+        const Bound& point,
+        Visitor visit
+) const {
+    static_assert(std::is_base_of<typename IntervalMaxEnd<typename ValueType::second_type>::Data,
+                                  typename Augmentation::Data>::value,
+                  "Interval queries need IntervalMaxEnd augmentation");
+
+    OverlapSubtree(root_, point, [&point](const Bound& start) {
+        return !(point < start);
+    }, visit);
+}
+
+template <class ValueType, class Allocator, class Augmentation, class Compare, class KeyOfValue>
+template <class ForwardIterator, class Visitor>
+void
+Set<ValueType, Allocator, Augmentation, Compare, KeyOfValue>
+::overlaps_batch(
+        ForwardIterator first,
+        ForwardIterator last,
+        Visitor visit
+) const {
+    static_assert(std::is_base_of<typename IntervalMaxEnd<typename ValueType::second_type>::Data,
+                                  typename Augmentation::Data>::value,
+                  "Interval queries need IntervalMaxEnd augmentation");
+
+    typedef typename std::iterator_traits<ForwardIterator>::value_type Query;
+    std::vector<Query> queries(first, last);
+    std::vector<size_t> active;
+    for (size_t query = 0; query < queries.size(); ++query) {
+        if (queries[query].first < queries[query].second) {
+            active.push_back(query);
+        }
+    }
+
+    if (!active.empty()) {
+        BatchOverlaps(root_, queries, active.data(), active.data() + active.size(), visit);
+    }
+}
+
+template <class ValueType, class Allocator, class Augmentation, class Compare, class KeyOfValue>
+void
+Set<ValueType, Allocator, Augmentation, Compare, KeyOfValue>
+::swap(
+        Set& rhs
+) noexcept {
+    std::swap(alloc_, rhs.alloc_);
+    std::swap(comp_, rhs.comp_);
+    std::swap(nil_, rhs.nil_);
+    std::swap(root_, rhs.root_);
+    std::swap(leftmost_, rhs.leftmost_);
+    std::swap(rightmost_, rhs.rightmost_);
+    std::swap(size_, rhs.size_);
+}
+
+template <class ValueType, class Allocator, class Augmentation, class Compare, class KeyOfValue>
+void
+Set<ValueType, Allocator, Augmentation, Compare, KeyOfValue>
+::unite(
+        const Set& rhs,
+        size_t threads_number
+) {
+    if (&rhs == this) {
+        return;
+    }
+
+    AcquireNil();
+
+    if (!ConcurrentAllocator<NodeAllocator>::value) {
+        threads_number = 1;
+    }
+
+    long delta = 0;
+    Subtree tree = Union({root_, BlackHeight(root_)}, rhs.root_, rhs, threads_number, &delta);
+    SetRoot(tree, delta);
+    ResetBounds();
+}
+
+template <class ValueType, class Allocator, class Augmentation, class Compare, class KeyOfValue>
+void
+Set<ValueType, Allocator, Augmentation, Compare, KeyOfValue>
+::intersect(
+        const Set& rhs,
+        size_t threads_number
+) {
+    if (&rhs == this) {
+        return;
+    }
+
+    AcquireNil();
+
+    if (!ConcurrentAllocator<NodeAllocator>::value) {
+        threads_number = 1;
+    }
+
+    long delta = 0;
+    Subtree tree = Intersection({root_, BlackHeight(root_)}, rhs.root_, rhs,
+                                threads_number, &delta);
+    SetRoot(tree, delta);
+    ResetBounds();
+}
+
+template <class ValueType, class Allocator, class Augmentation, class Compare, class KeyOfValue>
+void
+Set<ValueType, Allocator, Augmentation, Compare, KeyOfValue>
+::subtract(
+        const Set& rhs,
+        size_t threads_number
+) {
+    AcquireNil();
+    if (&rhs == this) {
+        if (!IsNil(root_)) {
+            DeleteSubtree(root_);
+        }
+
+        root_ = nil_;
+        size_ = 0;
+        ResetBounds();
+        return;
+    }
+
+    if (!ConcurrentAllocator<NodeAllocator>::value) {
+        threads_number = 1;
+    }
+
+    long delta = 0;
+    Subtree tree = Difference({root_, BlackHeight(root_)}, rhs.root_, rhs,
+                              threads_number, &delta);
+    SetRoot(tree, delta);
+    ResetBounds();
+}
+
+template <class ValueType, class Allocator, class Augmentation, class Compare, class KeyOfValue>
+typename Set<ValueType, Allocator, Augmentation, Compare, KeyOfValue>::Node*
+Set<ValueType, Allocator, Augmentation, Compare, KeyOfValue>
+::TreeMinimum(
+        Node* root
+) const {
+    Node* cur = root;
+
+    while (!IsNil(cur->left)) {
+        cur = cur->left;
+    }
+
+    return cur;
+}
+
+template <class ValueType, class Allocator, class Augmentation, class Compare, class KeyOfValue>
+typename Set<ValueType, Allocator, Augmentation, Compare, KeyOfValue>::Node*
+Set<ValueType, Allocator, Augmentation, Compare, KeyOfValue>
+::TreeMaximum(
+        Node* root
+) const {
+    Node* cur = root;
+
+    while (!IsNil(cur->right)) {
+        cur = cur->right;
+    }
+
+    return cur;
+}
+
+template <class ValueType, class Allocator, class Augmentation, class Compare, class KeyOfValue>
+typename Set<ValueType, Allocator, Augmentation, Compare, KeyOfValue>::Node*
+Set<ValueType, Allocator, Augmentation, Compare, KeyOfValue>
+::TreeSuccessor(
+        Node* root
+) const {
+    if (Threaded::value) {
+        return ThreadNext(root, Threaded());
+    }
+
+    if (!IsNil(root->right)) {
+        return TreeMinimum(root->right);
+    }
+
+    auto y_node = root->parent;
+    while (!IsNil(y_node) && root == y_node->right) {
+        root = y_node;
+        y_node = y_node->parent;
+    }
+
+    return y_node;
+}
+
+template <class ValueType, class Allocator, class Augmentation, class Compare, class KeyOfValue>
+typename Set<ValueType, Allocator, Augmentation, Compare, KeyOfValue>::Node*
+Set<ValueType, Allocator, Augmentation, Compare, KeyOfValue>
 ::TreePredecessor(
         Node* root
 ) const {
+    if (Threaded::value) {
+        return ThreadPrev(root, Threaded());
+    }
+
     if (!IsNil(root->left)) {
         return TreeMaximum(root->left);
     }
@@ -334,15 +1190,15 @@ Set<ValueType>
     return y_node;
 }
 
-template <class ValueType>
-typename Set<ValueType>::Node*
-Set<ValueType>
+template <class ValueType, class Allocator, class Augmentation, class Compare, class KeyOfValue>
+typename Set<ValueType, Allocator, Augmentation, Compare, KeyOfValue>::Node*
+Set<ValueType, Allocator, Augmentation, Compare, KeyOfValue>
 ::TreeFind(
-        const ValueType& value
+        const KeyType& key
 ) const {
     auto cur = root_;
-    while (!IsNil(cur) && Neq(cur->value, value)) {
-        if (value < cur->value) {
+    while (!IsNil(cur) && Neq(KeyOf(cur), key)) {
+        if (Less(key, KeyOf(cur))) {
             cur = cur->left;
 
         } else {
@@ -353,18 +1209,18 @@ Set<ValueType>
     return cur;
 }
 
-template <class ValueType>
-typename Set<ValueType>::Node*
-Set<ValueType>
+template <class ValueType, class Allocator, class Augmentation, class Compare, class KeyOfValue>
+typename Set<ValueType, Allocator, Augmentation, Compare, KeyOfValue>::Node*
+Set<ValueType, Allocator, Augmentation, Compare, KeyOfValue>
 ::TreeLowerBound(
-        const ValueType& value
+        const KeyType& key
 ) const {
     Node* cur = root_;
     Node* cur_parent = cur;
 
-    while (!IsNil(cur) && Neq(cur->value, value)) {
+    while (!IsNil(cur) && Neq(KeyOf(cur), key)) {
         cur_parent = cur;
-        if (value < cur->value) {
+        if (Less(key, KeyOf(cur))) {
             cur = cur->left;
 
         } else {
@@ -372,232 +1228,739 @@ Set<ValueType>
         }
     }
 
-    if (!IsNil(cur)) {
+    if (!IsNil(cur) || IsNil(cur_parent)) {
         return cur;
     }
 
-    if (cur_parent->value < value) {
+    if (Less(KeyOf(cur_parent), key)) {
         return TreeSuccessor(cur_parent);
     }
 
     return cur_parent;
 }
 
-template <class ValueType>
+//  Returns the node equal to key or nil, in the latter case
+//  parent and side tell where the new node should be linked
+template <class ValueType, class Allocator, class Augmentation, class Compare, class KeyOfValue>
+typename Set<ValueType, Allocator, Augmentation, Compare, KeyOfValue>::Node*
+Set<ValueType, Allocator, Augmentation, Compare, KeyOfValue>
+::FindInsertPosition(
+        const KeyType& key,
+        Node** parent,
+        bool* as_left
+) const {
+    Node* cur = root_;
+    *parent = nil_;
+    *as_left = false;
+
+    while (!IsNil(cur)) {
+        *parent = cur;
+        if (Less(key, KeyOf(cur))) {
+            *as_left = true;
+            cur = cur->left;
+
+        } else if (Less(KeyOf(cur), key)) {
+            *as_left = false;
+            cur = cur->right;
+
+        } else {
+            return cur;
+        }
+    }
+
+    return nil_;
+}
+
+/*
+ *      Checks that key goes right before or right after hint and returns
+ *      the parent for the new node, or nullptr when hint does not help.
+ *      The neighbour on the other side is reached through leftmost_ and
+ *      rightmost_, or by a successor/predecessor step otherwise.
+ *      Node equal to key goes to found.
+ */
+template <class ValueType, class Allocator, class Augmentation, class Compare, class KeyOfValue>
+typename Set<ValueType, Allocator, Augmentation, Compare, KeyOfValue>::Node*
+Set<ValueType, Allocator, Augmentation, Compare, KeyOfValue>
+::HintParent(
+        Node* hint,
+        const KeyType& key,
+        bool* as_left,
+        Node** found
+) const {
+    if (IsNil(root_)) {
+        *as_left = false;
+        return nil_;
+    }
+
+    if (IsNil(hint)) {
+        *as_left = false;
+        return Less(KeyOf(rightmost_), key) ? rightmost_ : nullptr;
+    }
+
+    if (Less(key, KeyOf(hint))) {
+        if (hint == leftmost_) {
+            *as_left = true;
+            return hint;
+        }
+
+        Node* before = TreePredecessor(hint);
+        if (!Less(KeyOf(before), key)) {
+            return nullptr;
+        }
+
+        //  One of two adjacent nodes always has a free slot between them
+        *as_left = !IsNil(before->right);
+        return *as_left ? hint : before;
+    }
+
+    if (Less(KeyOf(hint), key)) {
+        if (hint == rightmost_) {
+            *as_left = false;
+            return hint;
+        }
+
+        Node* after = TreeSuccessor(hint);
+        if (!Less(key, KeyOf(after))) {
+            return nullptr;
+        }
+
+        *as_left = !IsNil(hint->right);
+        return *as_left ? after : hint;
+    }
+
+    *found = hint;
+    return hint;
+}
+
+template <class ValueType, class Allocator, class Augmentation, class Compare, class KeyOfValue>
+void
+Set<ValueType, Allocator, Augmentation, Compare, KeyOfValue>
+::ResetBounds() {
+    leftmost_ = IsNil(root_) ? nil_ : TreeMinimum(root_);
+    rightmost_ = IsNil(root_) ? nil_ : TreeMaximum(root_);
+    Rethread();
+}
+
+//  Relinks all nodes in order after bulk changes, O(n)
+template <class ValueType, class Allocator, class Augmentation, class Compare, class KeyOfValue>
+void
+Set<ValueType, Allocator, Augmentation, Compare, KeyOfValue>
+::Rethread() {
+    if (!Threaded::value) {
+        return;
+    }
+
+    Node* last = nil_;
+    if (!IsNil(root_)) {
+        ThreadSubtree(root_, &last);
+    }
+
+    ThreadLink(last, nil_);
+}
+
+template <class ValueType, class Allocator, class Augmentation, class Compare, class KeyOfValue>
+void
+Set<ValueType, Allocator, Augmentation, Compare, KeyOfValue>
+::ThreadSubtree(
+        Node* node,
+        Node** last
+) {
+    if (!IsNil(node->left)) {
+        ThreadSubtree(node->left, last);
+    }
+
+    ThreadLink(*last, node);
+    *last = node;
+
+    if (!IsNil(node->right)) {
+        ThreadSubtree(node->right, last);
+    }
+}
+
+template <class ValueType, class Allocator, class Augmentation, class Compare, class KeyOfValue>
+void
+Set<ValueType, Allocator, Augmentation, Compare, KeyOfValue>
+::ThreadLink(
+        Node* prev,
+        Node* next
+) {
+    ThreadLink(prev, next, Threaded());
+}
+
+template <class ValueType, class Allocator, class Augmentation, class Compare, class KeyOfValue>
+void
+Set<ValueType, Allocator, Augmentation, Compare, KeyOfValue>
+::ThreadLink(
+        Node* prev,
+        Node* next,
+        std::true_type
+) {
+    prev->next = next;
+    next->prev = prev;
+}
+
+template <class ValueType, class Allocator, class Augmentation, class Compare, class KeyOfValue>
+void
+Set<ValueType, Allocator, Augmentation, Compare, KeyOfValue>
+::ThreadLink(
+        Node*,
+        Node*,
+        std::false_type
+) {}
+
+template <class ValueType, class Allocator, class Augmentation, class Compare, class KeyOfValue>
+typename Set<ValueType, Allocator, Augmentation, Compare, KeyOfValue>::Node*
+Set<ValueType, Allocator, Augmentation, Compare, KeyOfValue>
+::ThreadNext(
+        Node* node,
+        std::true_type
+) const {
+    return static_cast<Node*>(node->next);
+}
+
+template <class ValueType, class Allocator, class Augmentation, class Compare, class KeyOfValue>
+typename Set<ValueType, Allocator, Augmentation, Compare, KeyOfValue>::Node*
+Set<ValueType, Allocator, Augmentation, Compare, KeyOfValue>
+::ThreadNext(
+        Node*,
+        std::false_type
+) const {
+    return nil_;
+}
+
+template <class ValueType, class Allocator, class Augmentation, class Compare, class KeyOfValue>
+typename Set<ValueType, Allocator, Augmentation, Compare, KeyOfValue>::Node*
+Set<ValueType, Allocator, Augmentation, Compare, KeyOfValue>
+::ThreadPrev(
+        Node* node,
+        std::true_type
+) const {
+    return static_cast<Node*>(node->prev);
+}
+
+template <class ValueType, class Allocator, class Augmentation, class Compare, class KeyOfValue>
+typename Set<ValueType, Allocator, Augmentation, Compare, KeyOfValue>::Node*
+Set<ValueType, Allocator, Augmentation, Compare, KeyOfValue>
+::ThreadPrev(
+        Node*,
+        std::false_type
+) const {
+    return nil_;
+}
+
+//  Moved from Set has no sentinel until it is written again
+template <class ValueType, class Allocator, class Augmentation, class Compare, class KeyOfValue>
+void
+Set<ValueType, Allocator, Augmentation, Compare, KeyOfValue>
+::AcquireNil() {
+    if (nil_) {
+        return;
+    }
+
+    nil_ = new (::operator new(sizeof(Node))) Node(typename Node::NilTag());
+    root_ = leftmost_ = rightmost_ = nil_->left = nil_->right = nil_->parent = nil_;
+    ThreadLink(nil_, nil_);
+}
+
+template <class ValueType, class Allocator, class Augmentation, class Compare, class KeyOfValue>
+const typename Set<ValueType, Allocator, Augmentation, Compare, KeyOfValue>::KeyType&
+Set<ValueType, Allocator, Augmentation, Compare, KeyOfValue>
+::KeyOf(
+        const Node* node
+) {
+    return KeyOfValue()(node->value);
+}
+
+template <class ValueType, class Allocator, class Augmentation, class Compare, class KeyOfValue>
+bool
+Set<ValueType, Allocator, Augmentation, Compare, KeyOfValue>
+::Less(
+        const KeyType& lhs,
+        const KeyType& rhs
+) const {
+    return comp_(lhs, rhs);
+}
+
+template <class ValueType, class Allocator, class Augmentation, class Compare, class KeyOfValue>
 bool
-Set<ValueType>
+Set<ValueType, Allocator, Augmentation, Compare, KeyOfValue>
 ::Greater(
-        const ValueType& lhs,
-        const ValueType& rhs
+        const KeyType& lhs,
+        const KeyType& rhs
 ) const {
-    return rhs < lhs;
+    return Less(rhs, lhs);
 }
 
-template <class ValueType>
+template <class ValueType, class Allocator, class Augmentation, class Compare, class KeyOfValue>
 bool
-Set<ValueType>
+Set<ValueType, Allocator, Augmentation, Compare, KeyOfValue>
 ::Geq(
-        const ValueType& lhs,
-        const ValueType& rhs
+        const KeyType& lhs,
+        const KeyType& rhs
 ) const {
     return Greater(lhs, rhs) || Eq(lhs, rhs);
 }
 
-template <class ValueType>
+template <class ValueType, class Allocator, class Augmentation, class Compare, class KeyOfValue>
 bool
-Set<ValueType>
+Set<ValueType, Allocator, Augmentation, Compare, KeyOfValue>
 ::Eq(
-        const ValueType& lhs,
-        const ValueType& rhs
+        const KeyType& lhs,
+        const KeyType& rhs
 ) const {
-    return !(lhs < rhs) && !(rhs < lhs);
+    return !Less(lhs, rhs) && !Less(rhs, lhs);
 }
 
-template <class ValueType>
+template <class ValueType, class Allocator, class Augmentation, class Compare, class KeyOfValue>
 bool
-Set<ValueType>
+Set<ValueType, Allocator, Augmentation, Compare, KeyOfValue>
 ::Neq(
-        const ValueType& lhs,
-        const ValueType& rhs
+        const KeyType& lhs,
+        const KeyType& rhs
 ) const {
     return !Eq(lhs, rhs);
 }
 
-template <class ValueType>
+template <class ValueType, class Allocator, class Augmentation, class Compare, class KeyOfValue>
 bool
-Set<ValueType>
+Set<ValueType, Allocator, Augmentation, Compare, KeyOfValue>
 ::IsNil(
         Node* node
 ) const {
     return node == nil_;
 }
 
-template <class ValueType>
+template <class ValueType, class Allocator, class Augmentation, class Compare, class KeyOfValue>
 bool
-Set<ValueType>
+Set<ValueType, Allocator, Augmentation, Compare, KeyOfValue>
 ::IsRoot(
         Node* node
 ) const {
     return node == root_;
 }
 
-template <class ValueType>
+template <class ValueType, class Allocator, class Augmentation, class Compare, class KeyOfValue>
 bool
-Set<ValueType>
+Set<ValueType, Allocator, Augmentation, Compare, KeyOfValue>
 ::IsRed(
         Node* node
 ) const {
     return node->color == Color::kRed;
 }
 
-template <class ValueType>
+template <class ValueType, class Allocator, class Augmentation, class Compare, class KeyOfValue>
 bool
-Set<ValueType>
+Set<ValueType, Allocator, Augmentation, Compare, KeyOfValue>
 ::IsBlack(
         Node* node
 ) const {
     return node->color == Color::kBlack;
 }
 
-template <class ValueType>
+template <class ValueType, class Allocator, class Augmentation, class Compare, class KeyOfValue>
 void
-Set<ValueType>
+Set<ValueType, Allocator, Augmentation, Compare, KeyOfValue>
 ::SetRed(
         Node* node
 ) {
     node->color = Color::kRed;
 }
 
-template <class ValueType>
+template <class ValueType, class Allocator, class Augmentation, class Compare, class KeyOfValue>
 void
-Set<ValueType>
+Set<ValueType, Allocator, Augmentation, Compare, KeyOfValue>
 ::SetBlack(
         Node* node
 ) {
     node->color = Color::kBlack;
 }
 
-template <class ValueType>
-void
-Set<ValueType>
+template <class ValueType, class Allocator, class Augmentation, class Compare, class KeyOfValue>
+size_t
+Set<ValueType, Allocator, Augmentation, Compare, KeyOfValue>
 ::DeleteSubtree(
         Node*& root
 ) {
+    size_t deleted = 1;
     if (!IsNil(root->left)) {
-        DeleteSubtree(root->left);
+        deleted += DeleteSubtree(root->left);
     }
 
     if (!IsNil(root->right)) {
-        DeleteSubtree(root->right);
+        deleted += DeleteSubtree(root->right);
     }
 
-    delete root;
+    DestroyNode(root);
+    return deleted;
 }
 
-template <class ValueType>
-void
-Set<ValueType>
-::LeftRotate(
-        Node* x_node
+/*
+ *      Copies shape and colors of rhs subtree in O(n).
+ *      New node is linked into slot before its children are copied,
+ *      so the tree stays valid for destruction if an allocation throws.
+ */
+template <class ValueType, class Allocator, class Augmentation, class Compare, class KeyOfValue>
+size_t
+Set<ValueType, Allocator, Augmentation, Compare, KeyOfValue>
+::CloneSubtree(
+        Node* src,
+        Node* parent,
+        Node*& slot,
+        const Set& rhs
 ) {
-    if (!x_node->right) {
-        throw std::logic_error(
-                "Trying to rotate left node without right child!");
+    Node* node = CreateNode(src->value);
+    node->color = src->color;
+    node->parent = parent;
+    node->left = node->right = nil_;
+    slot = node;
+
+    size_t cloned = 1;
+    if (!rhs.IsNil(src->left)) {
+        cloned += CloneSubtree(src->left, node, node->left, rhs);
     }
 
-    Node* y_node = x_node->right;
-    x_node->right = y_node->left;
-    if (!IsNil(y_node->left)) {
-        y_node->left->parent = x_node;
+    if (!rhs.IsNil(src->right)) {
+        cloned += CloneSubtree(src->right, node, node->right, rhs);
     }
 
-    y_node->parent = x_node->parent;
-    if (IsNil(x_node->parent)) {
-        root_ = y_node;
-
-    } else if (x_node == x_node->parent->left) {
-        x_node->parent->left = y_node;
+    Update(node);
+    return cloned;
+}
 
-    } else {
-        x_node->parent->right = y_node;
+/*
+ *      Builds a balanced tree from sorted values in O(n), equal values
+ *      are taken once. Middle value becomes the root, so all levels but
+ *      the last one are full. Nodes of the last level are red, others are
+ *      black, which gives every path the same black height.
+ */
+template <class ValueType, class Allocator, class Augmentation, class Compare, class KeyOfValue>
+template <class ForwardIterator>
+void
+Set<ValueType, Allocator, Augmentation, Compare, KeyOfValue>
+::BuildSorted(
+        ForwardIterator first,
+        ForwardIterator last
+) {
+    std::vector<ForwardIterator> items;
+    for (; first != last; ++first) {
+        if (items.empty() || Less(KeyOfValue()(*items.back()), KeyOfValue()(*first))) {
+            items.push_back(first);
+        }
     }
 
-    y_node->left = x_node;
-    x_node->parent = y_node;
+    BuildBalanced(items, [this](ForwardIterator it) {
+        Node* node = CreateNode(*it);
+        ++size_;
+        return node;
+    });
 }
 
-template <class ValueType>
+//  Replaces the tree with nodes made from sorted items in O(n)
+template <class ValueType, class Allocator, class Augmentation, class Compare, class KeyOfValue>
+template <class Item, class MakeNode>
 void
-Set<ValueType>
-::RightRotate(
-        Node* x_node
+Set<ValueType, Allocator, Augmentation, Compare, KeyOfValue>
+::BuildBalanced(
+        const std::vector<Item>& items,
+        MakeNode make
 ) {
-    if (!x_node->left) {
-        throw std::logic_error(
-                "Trying to rotate right node without left child!");
+    root_ = nil_;
+
+    size_t full_levels = 0;
+    while ((size_t(2) << full_levels) - 1 <= items.size()) {
+        ++full_levels;
     }
 
-    auto y_node = x_node->left;
-    x_node->left = y_node->right;
-    if (!IsNil(y_node->right)) {
-        y_node->right->parent = x_node;
+    BuildSubtree(items, 0, items.size(), nil_, root_, 0, full_levels, make);
+    ResetBounds();
+}
+
+template <class ValueType, class Allocator, class Augmentation, class Compare, class KeyOfValue>
+template <class Item, class MakeNode>
+void
+Set<ValueType, Allocator, Augmentation, Compare, KeyOfValue>
+::BuildSubtree(
+        const std::vector<Item>& items,
+        size_t lo,
+        size_t hi,
+        Node* parent,
+        Node*& slot,
+        size_t depth,
+        size_t red_depth,
+        MakeNode make
+) {
+    if (lo == hi) {
+        return;
     }
 
-    y_node->parent = x_node->parent;
+    size_t mid = lo + (hi - lo) / 2;
+    Node* node = make(items[mid]);
+    node->color = depth == red_depth ? Color::kRed : Color::kBlack;
+    node->parent = parent;
+    node->left = node->right = nil_;
+    slot = node;
 
-    if (IsNil(x_node->parent)) {
-        root_ = y_node;
+    BuildSubtree(items, lo, mid, node, node->left, depth + 1, red_depth, make);
+    BuildSubtree(items, mid + 1, hi, node, node->right, depth + 1, red_depth, make);
+    Update(node);
+}
 
-    } else if (x_node == x_node->parent->left) {
-        x_node->parent->left = y_node;
+template <class ValueType, class Allocator, class Augmentation, class Compare, class KeyOfValue>
+template <class... Args>
+typename Set<ValueType, Allocator, Augmentation, Compare, KeyOfValue>::Node*
+Set<ValueType, Allocator, Augmentation, Compare, KeyOfValue>
+::CreateNode(
+        Args&&... args
+) {
+    Node* node = NodeAllocatorTraits::allocate(alloc_, 1);
+    try {
+        NodeAllocatorTraits::construct(alloc_, node, std::forward<Args>(args)...);
 
-    } else {
-        x_node->parent->right = y_node;
+    } catch (...) {
+        NodeAllocatorTraits::deallocate(alloc_, node, 1);
+        throw;
     }
 
-    y_node->right = x_node;
-    x_node->parent = y_node;
+    return node;
 }
 
-template <class ValueType>
+template <class ValueType, class Allocator, class Augmentation, class Compare, class KeyOfValue>
 void
-Set<ValueType>
-::RBInsert(
-        Node*& z_node
+Set<ValueType, Allocator, Augmentation, Compare, KeyOfValue>
+::DestroyNode(
+        Node* node
 ) {
-    auto y_node = nil_;
-    auto x_node = root_;
-    while (!IsNil(x_node)) {
-        y_node = x_node;
-        if (z_node->value < x_node->value) {
-            x_node = x_node->left;
+    NodeAllocatorTraits::destroy(alloc_, node);
+    NodeAllocatorTraits::deallocate(alloc_, node, 1);
+}
+
+template <class ValueType, class Allocator, class Augmentation, class Compare, class KeyOfValue>
+void
+Set<ValueType, Allocator, Augmentation, Compare, KeyOfValue>
+::Update(
+        Node* node
+) {
+    Augmentation::Update(node);
+}
+
+template <class ValueType, class Allocator, class Augmentation, class Compare, class KeyOfValue>
+void
+Set<ValueType, Allocator, Augmentation, Compare, KeyOfValue>
+::UpdateToRoot(
+        Node* node
+) {
+    if (!Augmentation::kEnabled) {
+        return;
+    }
+
+    while (!IsNil(node)) {
+        Update(node);
+        node = node->parent;
+    }
+}
+
+template <class ValueType, class Allocator, class Augmentation, class Compare, class KeyOfValue>
+size_t
+Set<ValueType, Allocator, Augmentation, Compare, KeyOfValue>
+::NodeRank(
+        Node* node
+) const {
+    static_assert(std::is_base_of<SubtreeSize::Data, typename Augmentation::Data>::value,
+                  "Order statistics need SubtreeSize augmentation");
+
+    if (IsNil(node)) {
+        return size_;
+    }
+
+    size_t rank = node->left->subtree_size;
+    while (!IsRoot(node)) {
+        if (node == node->parent->right) {
+            rank += node->parent->left->subtree_size + 1;
+        }
+
+        node = node->parent;
+    }
+
+    return rank;
+}
+
+template <class ValueType, class Allocator, class Augmentation, class Compare, class KeyOfValue>
+typename Set<ValueType, Allocator, Augmentation, Compare, KeyOfValue>::Node*
+Set<ValueType, Allocator, Augmentation, Compare, KeyOfValue>
+::SelectNode(
+        size_t k
+) const {
+    static_assert(std::is_base_of<SubtreeSize::Data, typename Augmentation::Data>::value,
+                  "Order statistics need SubtreeSize augmentation");
+
+    Node* cur = root_;
+    while (!IsNil(cur)) {
+        size_t left_size = cur->left->subtree_size;
+        if (k == left_size) {
+            return cur;
+        }
+
+        if (k < left_size) {
+            cur = cur->left;
 
         } else {
-            x_node = x_node->right;
+            k -= left_size + 1;
+            cur = cur->right;
         }
     }
 
+    return nil_;
+}
+
+template <class ValueType, class Allocator, class Augmentation, class Compare, class KeyOfValue>
+void
+Set<ValueType, Allocator, Augmentation, Compare, KeyOfValue>
+::SetLink(
+        Node*& link,
+        Node* node
+) {
+    SetLink(link, node, SharedLinks());
+}
+
+//  Release pairs with the acquire loads of readers, so a node they
+//  reach through the link is seen with the value it was created with
+template <class ValueType, class Allocator, class Augmentation, class Compare, class KeyOfValue>
+void
+Set<ValueType, Allocator, Augmentation, Compare, KeyOfValue>
+::SetLink(
+        Node*& link,
+        Node* node,
+        std::true_type
+) {
+    __atomic_store_n(&link, node, __ATOMIC_RELEASE);
+}
+
+template <class ValueType, class Allocator, class Augmentation, class Compare, class KeyOfValue>
+void
+Set<ValueType, Allocator, Augmentation, Compare, KeyOfValue>
+::SetLink(
+        Node*& link,
+        Node* node,
+        std::false_type
+) {
+    link = node;
+}
+
+template <class ValueType, class Allocator, class Augmentation, class Compare, class KeyOfValue>
+void
+Set<ValueType, Allocator, Augmentation, Compare, KeyOfValue>
+::LeftRotate(
+        Node* x_node
+) {
+    if (!x_node->right) {
+        throw std::logic_error(
+                "Trying to rotate left node without right child!");
+    }
+
+    Node* y_node = x_node->right;
+    SetLink(x_node->right, y_node->left);
+    if (!IsNil(y_node->left)) {
+        y_node->left->parent = x_node;
+    }
+
+    y_node->parent = x_node->parent;
+    if (IsNil(x_node->parent)) {
+        SetLink(root_, y_node);
+
+    } else if (x_node == x_node->parent->left) {
+        SetLink(x_node->parent->left, y_node);
+
+    } else {
+        SetLink(x_node->parent->right, y_node);
+    }
+
+    SetLink(y_node->left, x_node);
+    x_node->parent = y_node;
+    Update(x_node);
+    Update(y_node);
+}
+
+template <class ValueType, class Allocator, class Augmentation, class Compare, class KeyOfValue>
+void
+Set<ValueType, Allocator, Augmentation, Compare, KeyOfValue>
+::RightRotate(
+        Node* x_node
+) {
+    if (!x_node->left) {
+        throw std::logic_error(
+                "Trying to rotate right node without left child!");
+    }
+
+    auto y_node = x_node->left;
+    SetLink(x_node->left, y_node->right);
+    if (!IsNil(y_node->right)) {
+        y_node->right->parent = x_node;
+    }
+
+    y_node->parent = x_node->parent;
+
+    if (IsNil(x_node->parent)) {
+        SetLink(root_, y_node);
+
+    } else if (x_node == x_node->parent->left) {
+        SetLink(x_node->parent->left, y_node);
+
+    } else {
+        SetLink(x_node->parent->right, y_node);
+    }
+
+    SetLink(y_node->right, x_node);
+    x_node->parent = y_node;
+    Update(x_node);
+    Update(y_node);
+}
+
+template <class ValueType, class Allocator, class Augmentation, class Compare, class KeyOfValue>
+void
+Set<ValueType, Allocator, Augmentation, Compare, KeyOfValue>
+::RBLink(
+        Node* z_node,
+        Node* y_node,
+        bool as_left
+) {
+    //  Children are set first, a reader may reach z_node once it is linked
+    SetLink(z_node->left, nil_);
+    SetLink(z_node->right, nil_);
     z_node->parent = y_node;
     if (IsNil(y_node)) {
-        root_ = z_node;
+        SetLink(root_, z_node);
+        leftmost_ = rightmost_ = z_node;
+        ThreadLink(nil_, z_node);
+        ThreadLink(z_node, nil_);
+
+    } else if (as_left) {
+        SetLink(y_node->left, z_node);
+        if (y_node == leftmost_) {
+            leftmost_ = z_node;
+        }
 
-    } else if (z_node->value < y_node->value) {
-        y_node->left = z_node;
+        ThreadLink(ThreadPrev(y_node, Threaded()), z_node);
+        ThreadLink(z_node, y_node);
 
     } else {
-        y_node->right = z_node;
+        SetLink(y_node->right, z_node);
+        if (y_node == rightmost_) {
+            rightmost_ = z_node;
+        }
+
+        ThreadLink(z_node, ThreadNext(y_node, Threaded()));
+        ThreadLink(y_node, z_node);
     }
 
-    z_node->left = nil_;
-    z_node->right = nil_;
     SetRed(z_node);
+    UpdateToRoot(z_node);
     RBInsertFixup(z_node);
     ++size_;
 }
 
-template <class ValueType>
+template <class ValueType, class Allocator, class Augmentation, class Compare, class KeyOfValue>
 void
-Set<ValueType>
+Set<ValueType, Allocator, Augmentation, Compare, KeyOfValue>
 ::RBInsertFixup(
         Node*& z_node
 ) {
@@ -645,32 +2008,42 @@ Set<ValueType>
     SetBlack(root_);
 }
 
-template <class ValueType>
+template <class ValueType, class Allocator, class Augmentation, class Compare, class KeyOfValue>
 void
-Set<ValueType>
+Set<ValueType, Allocator, Augmentation, Compare, KeyOfValue>
 ::RBTransplant(
         Node*& u_node,
         Node*& v_node
 ) {
     if (IsNil(u_node->parent)) {
-        root_ = v_node;
+        SetLink(root_, v_node);
 
     } else if (u_node == u_node->parent->left) {
-        u_node->parent->left = v_node;
+        SetLink(u_node->parent->left, v_node);
 
     } else {
-        u_node->parent->right = v_node;
+        SetLink(u_node->parent->right, v_node);
     }
 
     v_node->parent = u_node->parent;
 }
 
-template <class ValueType>
+template <class ValueType, class Allocator, class Augmentation, class Compare, class KeyOfValue>
 void
-Set<ValueType>
+Set<ValueType, Allocator, Augmentation, Compare, KeyOfValue>
 ::RBDelete(
         Node*& z_node
 ) {
+    if (z_node == leftmost_) {
+        leftmost_ = TreeSuccessor(z_node);
+    }
+
+    if (z_node == rightmost_) {
+        rightmost_ = TreePredecessor(z_node);
+    }
+
+    ThreadLink(ThreadPrev(z_node, Threaded()), ThreadNext(z_node, Threaded()));
+
     auto x_node = nil_;
     auto y_node = z_node;
     auto y_original_color = y_node->color;
@@ -692,27 +2065,28 @@ Set<ValueType>
 
         } else {
             RBTransplant(y_node, y_node->right);
-            y_node->right = z_node->right;
+            SetLink(y_node->right, z_node->right);
             y_node->right->parent = y_node;
         }
 
         RBTransplant(z_node, y_node);
-        y_node->left = z_node->left;
+        SetLink(y_node->left, z_node->left);
         y_node->left->parent = y_node;
         y_node->color = z_node->color;
     }
 
+    UpdateToRoot(x_node->parent);
     if (y_original_color == Color::kBlack) {
         RBDeleteFixup(x_node);
     }
 
-    delete z_node;
+    DestroyNode(z_node);
     --size_;
 }
 
-template <class ValueType>
+template <class ValueType, class Allocator, class Augmentation, class Compare, class KeyOfValue>
 void
-Set<ValueType>
+Set<ValueType, Allocator, Augmentation, Compare, KeyOfValue>
 ::RBDeleteFixup(
         Node*& x_node
 ) {
@@ -784,144 +2158,2989 @@ Set<ValueType>
 
 /*
  *
- *      Iterator implementation
+ *      Join based set algebra
+ *
+ *      Blelloch, Ferizovic, Sun, "Just Join for Parallel Ordered Sets".
+ *      All functions work with detached subtrees: the returned root
+ *      parent link is meaningless until the caller links it.
+ *      nil_ is never written, so disjoint subtrees can be processed
+ *      from different threads.
  *
  */
 
-template <class ValueType>
-typename Set<ValueType>::iterator
-Set<ValueType>
-::begin() const {
-    return iterator(TreeMinimum(root_), this);
+template <class ValueType, class Allocator, class Augmentation, class Compare, class KeyOfValue>
+size_t
+Set<ValueType, Allocator, Augmentation, Compare, KeyOfValue>
+::BlackHeight(
+        Node* node
+) const {
+    size_t height = 0;
+    while (!IsNil(node)) {
+        height += IsBlack(node);
+        node = node->left;
+    }
+
+    return height;
 }
 
-template <class ValueType>
-typename Set<ValueType>::iterator
-Set<ValueType>
-::end() const {
-    return iterator(nil_, this);
+template <class ValueType, class Allocator, class Augmentation, class Compare, class KeyOfValue>
+typename Set<ValueType, Allocator, Augmentation, Compare, KeyOfValue>::Subtree
+Set<ValueType, Allocator, Augmentation, Compare, KeyOfValue>
+::Child(
+        const Subtree& tree,
+        Node* child
+) const {
+    return {child, tree.black_height - IsBlack(tree.root)};
 }
 
-template <class ValueType>
-Set<ValueType>::iterator
-::iterator(
-        Node* node,
-        const Set* set
-):
-        cur_node_{node},
-        set_{set}
-{}
+template <class ValueType, class Allocator, class Augmentation, class Compare, class KeyOfValue>
+typename Set<ValueType, Allocator, Augmentation, Compare, KeyOfValue>::Subtree
+Set<ValueType, Allocator, Augmentation, Compare, KeyOfValue>
+::Blacken(
+        Subtree tree
+) {
+    if (IsRed(tree.root)) {
+        SetBlack(tree.root);
+        ++tree.black_height;
+    }
 
-template <class ValueType>
-const ValueType&
-Set<ValueType>::iterator
-::operator*() {
-    return cur_node_->value;
+    return tree;
 }
 
-template <class ValueType>
-const ValueType*
-Set<ValueType>::iterator
-::operator->() {
-    return &(cur_node_->value);
+template <class ValueType, class Allocator, class Augmentation, class Compare, class KeyOfValue>
+typename Set<ValueType, Allocator, Augmentation, Compare, KeyOfValue>::Node*
+Set<ValueType, Allocator, Augmentation, Compare, KeyOfValue>
+::Link(
+        Node* left,
+        Node* key,
+        Node* right,
+        Color color
+) {
+    key->left = left;
+    key->right = right;
+    key->parent = nil_;
+    key->color = color;
+
+    if (!IsNil(left)) {
+        left->parent = key;
+    }
+
+    if (!IsNil(right)) {
+        right->parent = key;
+    }
+
+    Update(key);
+    return key;
 }
 
-template <class ValueType>
-typename Set<ValueType>::iterator&
-Set<ValueType>::iterator
-::operator++() {
-    cur_node_ = set_->TreeSuccessor(cur_node_);
-    return *this;
+template <class ValueType, class Allocator, class Augmentation, class Compare, class KeyOfValue>
+typename Set<ValueType, Allocator, Augmentation, Compare, KeyOfValue>::Node*
+Set<ValueType, Allocator, Augmentation, Compare, KeyOfValue>
+::RotateLeftDetached(
+        Node* x_node
+) {
+    Node* y_node = x_node->right;
+    x_node->right = y_node->left;
+    if (!IsNil(y_node->left)) {
+        y_node->left->parent = x_node;
+    }
+
+    y_node->left = x_node;
+    x_node->parent = y_node;
+    y_node->parent = nil_;
+    Update(x_node);
+    Update(y_node);
+    return y_node;
 }
 
-template <class ValueType>
-typename Set<ValueType>::iterator
-Set<ValueType>::iterator
-::operator++(int dummy) {
-    iterator cpy(cur_node_, set_);
-    this->operator++();
-    return cpy;
+template <class ValueType, class Allocator, class Augmentation, class Compare, class KeyOfValue>
+typename Set<ValueType, Allocator, Augmentation, Compare, KeyOfValue>::Node*
+Set<ValueType, Allocator, Augmentation, Compare, KeyOfValue>
+::RotateRightDetached(
+        Node* x_node
+) {
+    Node* y_node = x_node->left;
+    x_node->left = y_node->right;
+    if (!IsNil(y_node->right)) {
+        y_node->right->parent = x_node;
+    }
+
+    y_node->right = x_node;
+    x_node->parent = y_node;
+    y_node->parent = nil_;
+    Update(x_node);
+    Update(y_node);
+    return y_node;
 }
 
-template <class ValueType>
-typename Set<ValueType>::iterator&
-Set<ValueType>::iterator
-::operator--() {
-    if (set_->IsNil(cur_node_)) {
-        cur_node_ = set_->TreeMaximum(set_->root_);
+//  All values of left < key < all values of right
+template <class ValueType, class Allocator, class Augmentation, class Compare, class KeyOfValue>
+typename Set<ValueType, Allocator, Augmentation, Compare, KeyOfValue>::Subtree
+Set<ValueType, Allocator, Augmentation, Compare, KeyOfValue>
+::Join(
+        Subtree left,
+        Node* key,
+        Subtree right
+) {
+    left = Blacken(left);
+    right = Blacken(right);
 
-    } else {
-        cur_node_ = set_->TreePredecessor(cur_node_);
+    if (left.black_height > right.black_height) {
+        Subtree tree = JoinRight(left, key, right);
+        return Blacken(tree);
     }
 
-    return *this;
+    if (right.black_height > left.black_height) {
+        Subtree tree = JoinLeft(left, key, right);
+        return Blacken(tree);
+    }
+
+    return {Link(left.root, key, right.root, Color::kRed), left.black_height};
 }
 
-template <class ValueType>
-typename Set<ValueType>::iterator
-Set<ValueType>::iterator
-::operator--(int dummy) {
-    iterator cpy(cur_node_, set_);
-    this->operator--();
-    return cpy;
+//  Goes down the right spine of the higher left tree to a black node
+//  of the right tree height and hangs key there. Red-red violation
+//  is pushed up and fixed by a rotation at the nearest black ancestor.
+template <class ValueType, class Allocator, class Augmentation, class Compare, class KeyOfValue>
+typename Set<ValueType, Allocator, Augmentation, Compare, KeyOfValue>::Subtree
+Set<ValueType, Allocator, Augmentation, Compare, KeyOfValue>
+::JoinRight(
+        Subtree left,
+        Node* key,
+        Subtree right
+) {
+    if (IsBlack(left.root) && left.black_height == right.black_height) {
+        return {Link(left.root, key, right.root, Color::kRed), left.black_height};
+    }
+
+    Node* node = left.root;
+    Subtree joined = JoinRight(Child(left, node->right), key, right);
+    node->right = joined.root;
+    joined.root->parent = node;
+    Update(node);
+
+    if (IsBlack(node) && IsRed(node->right) && IsRed(node->right->right)) {
+        SetBlack(node->right->right);
+        node = RotateLeftDetached(node);
+    }
+
+    return {node, left.black_height};
 }
 
-template <class ValueType>
-bool
-Set<ValueType>::iterator
-::operator==(
-        const iterator& rhs
-) const {
-    return cur_node_ == rhs.cur_node_;
+template <class ValueType, class Allocator, class Augmentation, class Compare, class KeyOfValue>
+typename Set<ValueType, Allocator, Augmentation, Compare, KeyOfValue>::Subtree
+Set<ValueType, Allocator, Augmentation, Compare, KeyOfValue>
+::JoinLeft(
+        Subtree left,
+        Node* key,
+        Subtree right
+) {
+    if (IsBlack(right.root) && left.black_height == right.black_height) {
+        return {Link(left.root, key, right.root, Color::kRed), right.black_height};
+    }
+
+    Node* node = right.root;
+    Subtree joined = JoinLeft(left, key, Child(right, node->left));
+    node->left = joined.root;
+    joined.root->parent = node;
+    Update(node);
+
+    if (IsBlack(node) && IsRed(node->left) && IsRed(node->left->left)) {
+        SetBlack(node->left->left);
+        node = RotateRightDetached(node);
+    }
+
+    return {node, right.black_height};
 }
 
-template <class ValueType>
-bool
-Set<ValueType>::iterator
-::operator!=(
-        const iterator& rhs
-) const {
-    return cur_node_ != rhs.cur_node_;
+//  Join without a middle key
+template <class ValueType, class Allocator, class Augmentation, class Compare, class KeyOfValue>
+typename Set<ValueType, Allocator, Augmentation, Compare, KeyOfValue>::Subtree
+Set<ValueType, Allocator, Augmentation, Compare, KeyOfValue>
+::Join2(
+        Subtree left,
+        Subtree right
+) {
+    if (IsNil(left.root)) {
+        return right;
+    }
+
+    Subtree rest;
+    Node* last;
+    SplitLast(left, &rest, &last);
+    return Join(rest, last, right);
 }
 
-/*
- *
- *      Node implementation
- *
- */
+//  Splits tree into values less and greater than value,
+//  the node equal to value (or nil) goes to found
+template <class ValueType, class Allocator, class Augmentation, class Compare, class KeyOfValue>
+void
+Set<ValueType, Allocator, Augmentation, Compare, KeyOfValue>
+::Split(
+        Subtree tree,
+        const KeyType& key,
+        Subtree* left,
+        Node** found,
+        Subtree* right
+) {
+    if (IsNil(tree.root)) {
+        *left = *right = tree;
+        *found = nil_;
+        return;
+    }
 
-template <class ValueType>
-Set<ValueType>::Node
-::Node(
-        ValueType value
-):
-        Node(value, Color::kRed)
-{}
+    Node* node = tree.root;
+    Subtree node_left = Child(tree, node->left);
+    Subtree node_right = Child(tree, node->right);
 
-template <class ValueType>
-Set<ValueType>::Node
-::Node(
-        const ValueType& value,
-        Color color
-):
-        Node(value, color, nullptr, nullptr, nullptr)
-{}
+    if (Eq(key, KeyOf(node))) {
+        *left = node_left;
+        *right = node_right;
+        *found = node;
 
-template <class ValueType>
-Set<ValueType>::Node
-::Node(
+    } else if (Less(key, KeyOf(node))) {
+        Subtree less_right;
+        Split(node_left, key, left, found, &less_right);
+        *right = Join(less_right, node, node_right);
+
+    } else {
+        Subtree greater_left;
+        Split(node_right, key, &greater_left, found, right);
+        *left = Join(node_left, node, greater_left);
+    }
+}
+
+template <class ValueType, class Allocator, class Augmentation, class Compare, class KeyOfValue>
+void
+Set<ValueType, Allocator, Augmentation, Compare, KeyOfValue>
+::SplitLast(
+        Subtree tree,
+        Subtree* rest,
+        Node** last
+) {
+    Node* node = tree.root;
+    if (IsNil(node->right)) {
+        *rest = Child(tree, node->left);
+        *last = node;
+        return;
+    }
+
+    Subtree right_rest;
+    SplitLast(Child(tree, node->right), &right_rest, last);
+    *rest = Join(Child(tree, node->left), node, right_rest);
+}
+
+template <class ValueType, class Allocator, class Augmentation, class Compare, class KeyOfValue>
+typename Set<ValueType, Allocator, Augmentation, Compare, KeyOfValue>::Subtree
+Set<ValueType, Allocator, Augmentation, Compare, KeyOfValue>
+::Union(
+        Subtree tree,
+        Node* rhs_node,
+        const Set& rhs,
+        size_t threads_number,
+        long* delta
+) {
+    if (rhs.IsNil(rhs_node)) {
+        return tree;
+    }
+
+    if (IsNil(tree.root)) {
+        Node* root = nil_;
+        *delta += CloneSubtree(rhs_node, nil_, root, rhs);
+        return {root, BlackHeight(root)};
+    }
+
+    Subtree less, greater;
+    Node* key;
+    Split(tree, KeyOf(rhs_node), &less, &key, &greater);
+    if (IsNil(key)) {
+        key = CreateNode(rhs_node->value);
+        ++*delta;
+    }
+
+    long right_delta = 0;
+    ForkJoin(threads_number, [&]() {
+        less = Union(less, rhs_node->left, rhs, threads_number / 2, delta);
+    }, [&]() {
+        greater = Union(greater, rhs_node->right, rhs,
+                        threads_number - threads_number / 2, &right_delta);
+    });
+
+    *delta += right_delta;
+    return Join(less, key, greater);
+}
+
+template <class ValueType, class Allocator, class Augmentation, class Compare, class KeyOfValue>
+typename Set<ValueType, Allocator, Augmentation, Compare, KeyOfValue>::Subtree
+Set<ValueType, Allocator, Augmentation, Compare, KeyOfValue>
+::Intersection(
+        Subtree tree,
+        Node* rhs_node,
+        const Set& rhs,
+        size_t threads_number,
+        long* delta
+) {
+    if (IsNil(tree.root)) {
+        return tree;
+    }
+
+    if (rhs.IsNil(rhs_node)) {
+        *delta -= DeleteSubtree(tree.root);
+        return {nil_, 0};
+    }
+
+    Subtree less, greater;
+    Node* key;
+    Split(tree, KeyOf(rhs_node), &less, &key, &greater);
+
+    long right_delta = 0;
+    ForkJoin(threads_number, [&]() {
+        less = Intersection(less, rhs_node->left, rhs, threads_number / 2, delta);
+    }, [&]() {
+        greater = Intersection(greater, rhs_node->right, rhs,
+                               threads_number - threads_number / 2, &right_delta);
+    });
+
+    *delta += right_delta;
+    if (IsNil(key)) {
+        return Join2(less, greater);
+    }
+
+    return Join(less, key, greater);
+}
+
+template <class ValueType, class Allocator, class Augmentation, class Compare, class KeyOfValue>
+typename Set<ValueType, Allocator, Augmentation, Compare, KeyOfValue>::Subtree
+Set<ValueType, Allocator, Augmentation, Compare, KeyOfValue>
+::Difference(
+        Subtree tree,
+        Node* rhs_node,
+        const Set& rhs,
+        size_t threads_number,
+        long* delta
+) {
+    if (IsNil(tree.root) || rhs.IsNil(rhs_node)) {
+        return tree;
+    }
+
+    Subtree less, greater;
+    Node* key;
+    Split(tree, KeyOf(rhs_node), &less, &key, &greater);
+    if (!IsNil(key)) {
+        DestroyNode(key);
+        --*delta;
+    }
+
+    long right_delta = 0;
+    ForkJoin(threads_number, [&]() {
+        less = Difference(less, rhs_node->left, rhs, threads_number / 2, delta);
+    }, [&]() {
+        greater = Difference(greater, rhs_node->right, rhs,
+                             threads_number - threads_number / 2, &right_delta);
+    });
+
+    *delta += right_delta;
+    return Join2(less, greater);
+}
+
+template <class ValueType, class Allocator, class Augmentation, class Compare, class KeyOfValue>
+void
+Set<ValueType, Allocator, Augmentation, Compare, KeyOfValue>
+::SetRoot(
+        Subtree tree,
+        long delta
+) {
+    root_ = tree.root;
+    if (!IsNil(root_)) {
+        root_->parent = nil_;
+        SetBlack(root_);
+    }
+
+    size_ += delta;
+}
+
+/*
+ *      Intervals meeting the query have end above lo and start before
+ *      its upper bound. A subtree whose max_end is not above lo has no
+ *      such intervals, nodes to the right of a late start neither.
+ */
+template <class ValueType, class Allocator, class Augmentation, class Compare, class KeyOfValue>
+template <class Bound, class StartsBefore, class Visitor>
+void
+Set<ValueType, Allocator, Augmentation, Compare, KeyOfValue>
+::OverlapSubtree(
+        Node* node,
+        const Bound& lo,
+        StartsBefore starts_before,
+        Visitor& visit
+) const {
+    while (!IsNil(node) && lo < node->max_end) {
+        OverlapSubtree(node->left, lo, starts_before, visit);
+        if (!starts_before(node->value.first)) {
+            return;
+        }
+
+        if (lo < node->value.second) {
+            visit(static_cast<IteratorValue&>(node->value));
+        }
+
+        node = node->right;
+    }
+}
+
+//  Queries still alive in the subtree are kept in [first, last)
+//  and partitioned in place on the way down
+template <class ValueType, class Allocator, class Augmentation, class Compare, class KeyOfValue>
+template <class Query, class Visitor>
+void
+Set<ValueType, Allocator, Augmentation, Compare, KeyOfValue>
+::BatchOverlaps(
+        Node* node,
+        const std::vector<Query>& queries,
+        size_t* first,
+        size_t* last,
+        Visitor& visit
+) const {
+    if (IsNil(node)) {
+        return;
+    }
+
+    last = std::partition(first, last, [&](size_t query) {
+        return queries[query].first < node->max_end;
+    });
+    if (first == last) {
+        return;
+    }
+
+    BatchOverlaps(node->left, queries, first, last, visit);
+
+    last = std::partition(first, last, [&](size_t query) {
+        return node->value.first < queries[query].second;
+    });
+    for (size_t* query = first; query != last; ++query) {
+        if (queries[*query].first < node->value.second) {
+            visit(*query, static_cast<IteratorValue&>(node->value));
+        }
+    }
+
+    BatchOverlaps(node->right, queries, first, last, visit);
+}
+
+/*
+ *      Erases [first, last), last may be nil. Splitting at first and last
+ *      leaves the erased values in one detached subtree, last goes back
+ *      as the join key. Neighbours of the range are known beforehand,
+ *      so bounds and threading are fixed in O(1).
+ */
+template <class ValueType, class Allocator, class Augmentation, class Compare, class KeyOfValue>
+void
+Set<ValueType, Allocator, Augmentation, Compare, KeyOfValue>
+::EraseRange(
+        Node* first,
+        Node* last
+) {
+    if (first == last) {
+        return;
+    }
+
+    Node* before = TreePredecessor(first);
+    if (first == leftmost_) {
+        leftmost_ = last;
+    }
+
+    if (IsNil(last)) {
+        rightmost_ = before;
+    }
+
+    ThreadLink(before, last);
+
+    Subtree less, rest, middle, greater;
+    Node* found;
+    Split({root_, BlackHeight(root_)}, KeyOf(first), &less, &found, &rest);
+
+    Subtree tree = less;
+    if (IsNil(last)) {
+        middle = rest;
+
+    } else {
+        Split(rest, KeyOf(last), &middle, &found, &greater);
+        tree = Join(less, last, greater);
+    }
+
+    long erased = 1;
+    DestroyNode(first);
+    if (!IsNil(middle.root)) {
+        erased += DeleteSubtree(middle.root);
+    }
+
+    SetRoot(tree, -erased);
+}
+
+//  Runs left task on a new thread while the current one runs the right task
+template <class ValueType, class Allocator, class Augmentation, class Compare, class KeyOfValue>
+template <class LeftTask, class RightTask>
+void
+Set<ValueType, Allocator, Augmentation, Compare, KeyOfValue>
+::ForkJoin(
+        size_t threads_number,
+        LeftTask left,
+        RightTask right
+) {
+    if (threads_number <= 1) {
+        left();
+        right();
+        return;
+    }
+
+    std::exception_ptr left_error;
+    std::thread worker([&left, &left_error]() {
+        try {
+            left();
+
+        } catch (...) {
+            left_error = std::current_exception();
+        }
+    });
+
+    try {
+        right();
+
+    } catch (...) {
+        worker.join();
+        throw;
+    }
+
+    worker.join();
+    if (left_error) {
+        std::rethrow_exception(left_error);
+    }
+}
+
+/*
+ *
+ *      Set algebra functions implementation
+ *
+ */
+
+template <class ValueType, class Allocator, class Augmentation, class Compare, class KeyOfValue>
+Set<ValueType, Allocator, Augmentation, Compare, KeyOfValue>
+set_union(
+        Set<ValueType, Allocator, Augmentation, Compare, KeyOfValue> lhs,
+        const Set<ValueType, Allocator, Augmentation, Compare, KeyOfValue>& rhs,
+        size_t threads_number
+) {
+    lhs.unite(rhs, threads_number);
+    return lhs;
+}
+
+template <class ValueType, class Allocator, class Augmentation, class Compare, class KeyOfValue>
+Set<ValueType, Allocator, Augmentation, Compare, KeyOfValue>
+set_intersection(
+        Set<ValueType, Allocator, Augmentation, Compare, KeyOfValue> lhs,
+        const Set<ValueType, Allocator, Augmentation, Compare, KeyOfValue>& rhs,
+        size_t threads_number
+) {
+    lhs.intersect(rhs, threads_number);
+    return lhs;
+}
+
+template <class ValueType, class Allocator, class Augmentation, class Compare, class KeyOfValue>
+Set<ValueType, Allocator, Augmentation, Compare, KeyOfValue>
+set_difference(
+        Set<ValueType, Allocator, Augmentation, Compare, KeyOfValue> lhs,
+        const Set<ValueType, Allocator, Augmentation, Compare, KeyOfValue>& rhs,
+        size_t threads_number
+) {
+    lhs.subtract(rhs, threads_number);
+    return lhs;
+}
+
+/*
+ *
+ *      Map implementation
+ *
+ */
+
+template <class KeyType, class MappedType, class Compare, class Allocator>
+MappedType&
+Map<KeyType, MappedType, Compare, Allocator>
+::operator[](
+        const KeyType& key
+) {
+    this->AcquireNil();
+
+    typename Tree::Node* parent;
+    bool as_left;
+    typename Tree::Node* found = this->FindInsertPosition(key, &parent, &as_left);
+    if (this->IsNil(found)) {
+        found = this->CreateNode(std::piecewise_construct,
+                                 std::forward_as_tuple(key), std::forward_as_tuple());
+        this->RBLink(found, parent, as_left);
+    }
+
+    return found->value.second;
+}
+
+template <class KeyType, class MappedType, class Compare, class Allocator>
+MappedType&
+Map<KeyType, MappedType, Compare, Allocator>
+::at(
+        const KeyType& key
+) {
+    auto it = this->find(key);
+    if (it == this->end()) {
+        throw std::out_of_range("No such key in Map");
+    }
+
+    return it->second;
+}
+
+template <class KeyType, class MappedType, class Compare, class Allocator>
+const MappedType&
+Map<KeyType, MappedType, Compare, Allocator>
+::at(
+        const KeyType& key
+) const {
+    auto it = this->find(key);
+    if (it == this->end()) {
+        throw std::out_of_range("No such key in Map");
+    }
+
+    return it->second;
+}
+
+/*
+ *
+ *      FrozenSet implementation
+ *
+ *      Descent goes to 2k + 1 while node k is less than key, so the answer
+ *      is the last node where it turned left. Right turns are the trailing
+ *      ones of the final index, shifting them out (and the left turn
+ *      after them) gives the lower bound, 0 means end.
+ *
+ */
+
+template <class ValueType, class Compare, class KeyOfValue>
+template <class ForwardIterator>
+FrozenSet<ValueType, Compare, KeyOfValue>
+::FrozenSet(
+        ForwardIterator first,
+        ForwardIterator last,
+        const Compare& comp
+):
+        comp_{comp}
+{
+    std::vector<ForwardIterator> items;
+    for (; first != last; ++first) {
+        items.push_back(first);
+    }
+
+    std::vector<ForwardIterator> order(items.size());
+    size_t next = 0;
+    FillOrder(items, &order, 1, &next);
+
+    values_.reserve(order.size());
+    for (ForwardIterator it : order) {
+        values_.push_back(*it);
+    }
+
+    while ((size_t(1) << depth_) <= values_.size()) {
+        ++depth_;
+    }
+}
+
+template <class ValueType, class Compare, class KeyOfValue>
+typename FrozenSet<ValueType, Compare, KeyOfValue>::iterator
+FrozenSet<ValueType, Compare, KeyOfValue>
+::find(
+        const KeyType& key
+) const {
+    iterator it = lower_bound(key);
+    if (it == end() || Less(key, KeyOfValue()(*it))) {
+        return end();
+    }
+
+    return it;
+}
+
+template <class ValueType, class Compare, class KeyOfValue>
+typename FrozenSet<ValueType, Compare, KeyOfValue>::iterator
+FrozenSet<ValueType, Compare, KeyOfValue>
+::lower_bound(
+        const KeyType& key
+) const {
+    size_t idx = 1;
+    while (idx <= values_.size()) {
+        Prefetch(idx);
+        idx = 2 * idx + Less(KeyOfValue()(At(idx)), key);
+    }
+
+    return iterator(ResolveDescent(idx), this);
+}
+
+template <class ValueType, class Compare, class KeyOfValue>
+template <class ForwardIterator, class OutputIterator>
+OutputIterator
+FrozenSet<ValueType, Compare, KeyOfValue>
+::find_batch(
+        ForwardIterator first,
+        ForwardIterator last,
+        OutputIterator out
+) const {
+    BatchDescent(first, last, [this, &out](const KeyType& key, size_t idx) {
+        if (idx != 0 && Less(key, KeyOfValue()(At(idx)))) {
+            idx = 0;
+        }
+
+        *out = iterator(idx, this);
+        ++out;
+    });
+
+    return out;
+}
+
+template <class ValueType, class Compare, class KeyOfValue>
+template <class ForwardIterator, class OutputIterator>
+OutputIterator
+FrozenSet<ValueType, Compare, KeyOfValue>
+::lower_bound_batch(
+        ForwardIterator first,
+        ForwardIterator last,
+        OutputIterator out
+) const {
+    BatchDescent(first, last, [this, &out](const KeyType&, size_t idx) {
+        *out = iterator(idx, this);
+        ++out;
+    });
+
+    return out;
+}
+
+template <class ValueType, class Compare, class KeyOfValue>
+size_t
+FrozenSet<ValueType, Compare, KeyOfValue>
+::size() const {
+    return values_.size();
+}
+
+template <class ValueType, class Compare, class KeyOfValue>
+bool
+FrozenSet<ValueType, Compare, KeyOfValue>
+::empty() const {
+    return values_.empty();
+}
+
+//  In-order walk of the implicit tree hands out sorted positions
+template <class ValueType, class Compare, class KeyOfValue>
+template <class Iterator>
+void
+FrozenSet<ValueType, Compare, KeyOfValue>
+::FillOrder(
+        const std::vector<Iterator>& items,
+        std::vector<Iterator>* order,
+        size_t idx,
+        size_t* next
+) {
+    if (idx > items.size()) {
+        return;
+    }
+
+    FillOrder(items, order, 2 * idx, next);
+    (*order)[idx - 1] = items[(*next)++];
+    FillOrder(items, order, 2 * idx + 1, next);
+}
+
+template <class ValueType, class Compare, class KeyOfValue>
+const ValueType&
+FrozenSet<ValueType, Compare, KeyOfValue>
+::At(
+        size_t idx
+) const {
+    return values_[idx - 1];
+}
+
+template <class ValueType, class Compare, class KeyOfValue>
+bool
+FrozenSet<ValueType, Compare, KeyOfValue>
+::Less(
+        const KeyType& lhs,
+        const KeyType& rhs
+) const {
+    return comp_(lhs, rhs);
+}
+
+//  Descendants of idx few levels below are consecutive, prefetching the
+//  first of them brings a whole cache line of the future path
+template <class ValueType, class Compare, class KeyOfValue>
+void
+FrozenSet<ValueType, Compare, KeyOfValue>
+::Prefetch(
+        size_t idx
+) const {
+#if defined(__GNUC__)
+    size_t target = idx * kPrefetchStride;
+    if (target <= values_.size()) {
+        __builtin_prefetch(&values_[target - 1]);
+    }
+#endif
+}
+
+template <class ValueType, class Compare, class KeyOfValue>
+size_t
+FrozenSet<ValueType, Compare, KeyOfValue>
+::ResolveDescent(
+        size_t idx
+) {
+    while (idx & 1) {
+        idx >>= 1;
+    }
+
+    return idx >> 1;
+}
+
+//  Every descent takes depth_ steps, some of them end one level earlier
+template <class ValueType, class Compare, class KeyOfValue>
+template <class ForwardIterator, class Visitor>
+void
+FrozenSet<ValueType, Compare, KeyOfValue>
+::BatchDescent(
+        ForwardIterator first,
+        ForwardIterator last,
+        Visitor visit
+) const {
+    ForwardIterator keys[frozen_batch_size];
+    size_t idx[frozen_batch_size];
+
+    while (first != last) {
+        size_t count = 0;
+        for (; first != last && count < frozen_batch_size; ++first, ++count) {
+            keys[count] = first;
+            idx[count] = 1;
+        }
+
+        for (size_t level = 0; level < depth_; ++level) {
+            for (size_t i = 0; i < count; ++i) {
+                if (idx[i] <= values_.size()) {
+                    Prefetch(idx[i]);
+                    idx[i] = 2 * idx[i] + Less(KeyOfValue()(At(idx[i])), *keys[i]);
+                }
+            }
+        }
+
+        for (size_t i = 0; i < count; ++i) {
+            visit(*keys[i], ResolveDescent(idx[i]));
+        }
+    }
+}
+
+template <class ValueType, class Compare, class KeyOfValue>
+typename FrozenSet<ValueType, Compare, KeyOfValue>::iterator
+FrozenSet<ValueType, Compare, KeyOfValue>
+::begin() const {
+    size_t idx = 0;
+    if (!values_.empty()) {
+        idx = 1;
+        while (2 * idx <= values_.size()) {
+            idx *= 2;
+        }
+    }
+
+    return iterator(idx, this);
+}
+
+template <class ValueType, class Compare, class KeyOfValue>
+typename FrozenSet<ValueType, Compare, KeyOfValue>::iterator
+FrozenSet<ValueType, Compare, KeyOfValue>
+::end() const {
+    return iterator(0, this);
+}
+
+template <class ValueType, class Compare, class KeyOfValue>
+FrozenSet<ValueType, Compare, KeyOfValue>::iterator
+::iterator(
+        size_t idx,
+        const FrozenSet* set
+):
+        idx_{idx},
+        set_{set}
+{}
+
+//  Leftmost node of the right subtree, or the nearest ancestor
+//  whose left subtree we leave
+template <class ValueType, class Compare, class KeyOfValue>
+typename FrozenSet<ValueType, Compare, KeyOfValue>::iterator&
+FrozenSet<ValueType, Compare, KeyOfValue>::iterator
+::operator++() {
+    size_t size = set_->values_.size();
+    if (2 * idx_ + 1 <= size) {
+        idx_ = 2 * idx_ + 1;
+        while (2 * idx_ <= size) {
+            idx_ *= 2;
+        }
+
+    } else {
+        idx_ = ResolveDescent(idx_);
+    }
+
+    return *this;
+}
+
+template <class ValueType, class Compare, class KeyOfValue>
+typename FrozenSet<ValueType, Compare, KeyOfValue>::iterator
+FrozenSet<ValueType, Compare, KeyOfValue>::iterator
+::operator++(int dummy) {
+    iterator cpy(*this);
+    this->operator++();
+    return cpy;
+}
+
+template <class ValueType, class Compare, class KeyOfValue>
+typename FrozenSet<ValueType, Compare, KeyOfValue>::iterator&
+FrozenSet<ValueType, Compare, KeyOfValue>::iterator
+::operator--() {
+    size_t size = set_->values_.size();
+    if (idx_ == 0) {
+        idx_ = 1;
+        while (2 * idx_ + 1 <= size) {
+            idx_ = 2 * idx_ + 1;
+        }
+
+    } else if (2 * idx_ <= size) {
+        idx_ = 2 * idx_;
+        while (2 * idx_ + 1 <= size) {
+            idx_ = 2 * idx_ + 1;
+        }
+
+    } else {
+        while (idx_ != 0 && !(idx_ & 1)) {
+            idx_ >>= 1;
+        }
+
+        idx_ >>= 1;
+    }
+
+    return *this;
+}
+
+template <class ValueType, class Compare, class KeyOfValue>
+typename FrozenSet<ValueType, Compare, KeyOfValue>::iterator
+FrozenSet<ValueType, Compare, KeyOfValue>::iterator
+::operator--(int dummy) {
+    iterator cpy(*this);
+    this->operator--();
+    return cpy;
+}
+
+template <class ValueType, class Compare, class KeyOfValue>
+const ValueType&
+FrozenSet<ValueType, Compare, KeyOfValue>::iterator
+::operator*() {
+    return set_->At(idx_);
+}
+
+template <class ValueType, class Compare, class KeyOfValue>
+const ValueType*
+FrozenSet<ValueType, Compare, KeyOfValue>::iterator
+::operator->() {
+    return &(set_->At(idx_));
+}
+
+template <class ValueType, class Compare, class KeyOfValue>
+bool
+FrozenSet<ValueType, Compare, KeyOfValue>::iterator
+::operator==(
+        const iterator& rhs
+) const {
+    return idx_ == rhs.idx_;
+}
+
+template <class ValueType, class Compare, class KeyOfValue>
+bool
+FrozenSet<ValueType, Compare, KeyOfValue>::iterator
+::operator!=(
+        const iterator& rhs
+) const {
+    return idx_ != rhs.idx_;
+}
+
+/*
+ *
+ *      Iterator implementation
+ *
+ */
+
+template <class ValueType, class Allocator, class Augmentation, class Compare, class KeyOfValue>
+typename Set<ValueType, Allocator, Augmentation, Compare, KeyOfValue>::iterator
+Set<ValueType, Allocator, Augmentation, Compare, KeyOfValue>
+::begin() const {
+    return iterator(leftmost_, this);
+}
+
+template <class ValueType, class Allocator, class Augmentation, class Compare, class KeyOfValue>
+typename Set<ValueType, Allocator, Augmentation, Compare, KeyOfValue>::iterator
+Set<ValueType, Allocator, Augmentation, Compare, KeyOfValue>
+::end() const {
+    return iterator(nil_, this);
+}
+
+template <class ValueType, class Allocator, class Augmentation, class Compare, class KeyOfValue>
+Set<ValueType, Allocator, Augmentation, Compare, KeyOfValue>::iterator
+::iterator(
+        Node* node,
+        const Set* set
+):
+        cur_node_{node},
+        set_{set}
+{}
+
+template <class ValueType, class Allocator, class Augmentation, class Compare, class KeyOfValue>
+typename Set<ValueType, Allocator, Augmentation, Compare, KeyOfValue>::IteratorValue&
+Set<ValueType, Allocator, Augmentation, Compare, KeyOfValue>::iterator
+::operator*() {
+    return cur_node_->value;
+}
+
+template <class ValueType, class Allocator, class Augmentation, class Compare, class KeyOfValue>
+typename Set<ValueType, Allocator, Augmentation, Compare, KeyOfValue>::IteratorValue*
+Set<ValueType, Allocator, Augmentation, Compare, KeyOfValue>::iterator
+::operator->() {
+    return &(cur_node_->value);
+}
+
+template <class ValueType, class Allocator, class Augmentation, class Compare, class KeyOfValue>
+typename Set<ValueType, Allocator, Augmentation, Compare, KeyOfValue>::iterator&
+Set<ValueType, Allocator, Augmentation, Compare, KeyOfValue>::iterator
+::operator++() {
+    cur_node_ = set_->TreeSuccessor(cur_node_);
+    return *this;
+}
+
+template <class ValueType, class Allocator, class Augmentation, class Compare, class KeyOfValue>
+typename Set<ValueType, Allocator, Augmentation, Compare, KeyOfValue>::iterator
+Set<ValueType, Allocator, Augmentation, Compare, KeyOfValue>::iterator
+::operator++(int dummy) {
+    iterator cpy(cur_node_, set_);
+    this->operator++();
+    return cpy;
+}
+
+template <class ValueType, class Allocator, class Augmentation, class Compare, class KeyOfValue>
+typename Set<ValueType, Allocator, Augmentation, Compare, KeyOfValue>::iterator&
+Set<ValueType, Allocator, Augmentation, Compare, KeyOfValue>::iterator
+::operator+=(
+        ptrdiff_t n
+) {
+    cur_node_ = set_->SelectNode(set_->NodeRank(cur_node_) + n);
+    return *this;
+}
+
+template <class ValueType, class Allocator, class Augmentation, class Compare, class KeyOfValue>
+typename Set<ValueType, Allocator, Augmentation, Compare, KeyOfValue>::iterator&
+Set<ValueType, Allocator, Augmentation, Compare, KeyOfValue>::iterator
+::operator-=(
+        ptrdiff_t n
+) {
+    return *this += -n;
+}
+
+template <class ValueType, class Allocator, class Augmentation, class Compare, class KeyOfValue>
+typename Set<ValueType, Allocator, Augmentation, Compare, KeyOfValue>::iterator&
+Set<ValueType, Allocator, Augmentation, Compare, KeyOfValue>::iterator
+::operator--() {
+    if (set_->IsNil(cur_node_)) {
+        cur_node_ = set_->rightmost_;
+
+    } else {
+        cur_node_ = set_->TreePredecessor(cur_node_);
+    }
+
+    return *this;
+}
+
+template <class ValueType, class Allocator, class Augmentation, class Compare, class KeyOfValue>
+typename Set<ValueType, Allocator, Augmentation, Compare, KeyOfValue>::iterator
+Set<ValueType, Allocator, Augmentation, Compare, KeyOfValue>::iterator
+::operator--(int dummy) {
+    iterator cpy(cur_node_, set_);
+    this->operator--();
+    return cpy;
+}
+
+template <class ValueType, class Allocator, class Augmentation, class Compare, class KeyOfValue>
+bool
+Set<ValueType, Allocator, Augmentation, Compare, KeyOfValue>::iterator
+::operator==(
+        const iterator& rhs
+) const {
+    return cur_node_ == rhs.cur_node_;
+}
+
+template <class ValueType, class Allocator, class Augmentation, class Compare, class KeyOfValue>
+bool
+Set<ValueType, Allocator, Augmentation, Compare, KeyOfValue>::iterator
+::operator!=(
+        const iterator& rhs
+) const {
+    return cur_node_ != rhs.cur_node_;
+}
+
+/*
+ *
+ *      Node implementation
+ *
+ */
+
+template <class ValueType, class Allocator, class Augmentation, class Compare, class KeyOfValue>
+Set<ValueType, Allocator, Augmentation, Compare, KeyOfValue>::NodeLinks
+::NodeLinks(
+        Color color,
+        Node* left,
+        Node* right,
+        Node* parent
+):
+        color{color},
+        left{left},
+        right{right},
+        parent{parent}
+{}
+
+template <class ValueType, class Allocator, class Augmentation, class Compare, class KeyOfValue>
+template <class... Args>
+Set<ValueType, Allocator, Augmentation, Compare, KeyOfValue>::Node
+::Node(
+        Args&&... args
+):
+        NodeLinks(Color::kRed, nullptr, nullptr, nullptr),
+        value(std::forward<Args>(args)...)
+{}
+
+template <class ValueType, class Allocator, class Augmentation, class Compare, class KeyOfValue>
+Set<ValueType, Allocator, Augmentation, Compare, KeyOfValue>::Node
+::Node(
+        NilTag
+):
+        NodeLinks(Color::kBlack, nullptr, nullptr, nullptr)
+{}
+
+template <class ValueType, class Allocator, class Augmentation, class Compare, class KeyOfValue>
+Set<ValueType, Allocator, Augmentation, Compare, KeyOfValue>::Node
+::~Node() {
+    value.~ValueType();
+}
+
+
+/*
+ *
+ *              Persistent Set
+ *
+ *      Immutable red-black nodes shared through reference counting.
+ *      insert and erase copy only the path from the root, so every
+ *      version costs O(log n) new nodes and old versions stay intact.
+ *
+ *      Insertion and deletion follow S. Kahrs,
+ *      "Red-black trees with types", JFP 2001.
+ *
+ *      PersistentSet belongs to one writer thread. snapshot() may be
+ *      called from any thread, a snapshot is immutable and may be read
+ *      concurrently with further writes.
+ *
+ */
+
+template <class ValueType>
+class PersistentSet;
+
+template <class ValueType>
+class PersistentSnapshot {
+    friend class PersistentSet<ValueType>;
+
+protected:
+    struct Node;
+    struct Version;
+    typedef std::shared_ptr<const Node> NodePtr;
+    typedef std::shared_ptr<const Version> VersionPtr;
+
+public:
+    class iterator:
+            public std::iterator<std::forward_iterator_tag, const ValueType> {
+    public:
+        iterator() = default;
+        explicit iterator(VersionPtr version);
+
+        iterator& operator++();
+        iterator operator++(int);
+
+        const ValueType& operator*();
+        const ValueType* operator->();
+
+        bool operator==(const iterator& rhs) const;
+        bool operator!=(const iterator& rhs) const;
+
+    private:
+        friend class PersistentSnapshot;
+
+        //  Path of nodes whose values are not yet visited, top is current
+        std::vector<const Node*> path_;
+        VersionPtr version_;
+
+        void PushLeftPath(const Node* node);
+    };
+
+    iterator begin() const;
+    iterator end() const;
+
+    iterator find(const ValueType& value) const;
+    iterator lower_bound(const ValueType& value) const;
+
+    size_t size() const;
+    bool empty() const;
+
+protected:
+    enum class Color {
+        kRed, kBlack
+    };
+
+    struct Node {
+        const ValueType value;
+        const Color color;
+        const NodePtr left;
+        const NodePtr right;
+
+        Node(Color color, NodePtr left, const ValueType& value, NodePtr right);
+    };
+
+    struct Version {
+        NodePtr root;
+        size_t size;
+    };
+
+    PersistentSnapshot();
+    explicit PersistentSnapshot(VersionPtr version);
+
+    VersionPtr version_;
+};
+
+
+template <class ValueType>
+class PersistentSet: public PersistentSnapshot<ValueType> {
+    typedef PersistentSnapshot<ValueType> Snapshot;
+    typedef typename Snapshot::Node Node;
+    typedef typename Snapshot::NodePtr NodePtr;
+    typedef typename Snapshot::Version Version;
+    typedef typename Snapshot::Color Color;
+
+public:
+    PersistentSet() = default;
+
+    template <class ForwardIterator>
+    PersistentSet(ForwardIterator first, ForwardIterator last);
+
+    PersistentSet(std::initializer_list<ValueType> list);
+
+    void insert(const ValueType& value);
+    void erase(const ValueType& value);
+
+    //  O(1), safe to call while the writer works
+    Snapshot snapshot() const;
+
+private:
+    void Publish(NodePtr root, size_t size);
+
+    static NodePtr Make(Color color, NodePtr left, const ValueType& value, NodePtr right);
+    static NodePtr Red(NodePtr left, const ValueType& value, NodePtr right);
+    static NodePtr Black(NodePtr left, const ValueType& value, NodePtr right);
+    static bool IsRed(const NodePtr& node);
+    static bool IsBlack(const NodePtr& node);
+
+    static NodePtr Balance(NodePtr left, const ValueType& value, NodePtr right);
+    static NodePtr Insert(const NodePtr& node, const ValueType& value);
+
+    static NodePtr Delete(const NodePtr& node, const ValueType& value);
+    static NodePtr BalanceLeft(NodePtr left, const ValueType& value, NodePtr right);
+    static NodePtr BalanceRight(NodePtr left, const ValueType& value, NodePtr right);
+    static NodePtr Redden(const NodePtr& node);
+    static NodePtr Append(const NodePtr& left, const NodePtr& right);
+};
+
+
+/*
+ *
+ *      PersistentSnapshot implementation
+ *
+ */
+
+template <class ValueType>
+PersistentSnapshot<ValueType>
+::PersistentSnapshot():
+        version_{std::make_shared<const Version>(Version{nullptr, 0})}
+{}
+
+template <class ValueType>
+PersistentSnapshot<ValueType>
+::PersistentSnapshot(
+        VersionPtr version
+):
+        version_{std::move(version)}
+{}
+
+template <class ValueType>
+typename PersistentSnapshot<ValueType>::iterator
+PersistentSnapshot<ValueType>
+::begin() const {
+    iterator it(version_);
+    it.PushLeftPath(version_->root.get());
+    return it;
+}
+
+template <class ValueType>
+typename PersistentSnapshot<ValueType>::iterator
+PersistentSnapshot<ValueType>
+::end() const {
+    return iterator(version_);
+}
+
+template <class ValueType>
+typename PersistentSnapshot<ValueType>::iterator
+PersistentSnapshot<ValueType>
+::find(
+        const ValueType& value
+) const {
+    iterator it = lower_bound(value);
+    if (it == end() || value < *it) {
+        return end();
+    }
+
+    return it;
+}
+
+template <class ValueType>
+typename PersistentSnapshot<ValueType>::iterator
+PersistentSnapshot<ValueType>
+::lower_bound(
+        const ValueType& value
+) const {
+    iterator it(version_);
+    const Node* cur = version_->root.get();
+    while (cur) {
+        if (cur->value < value) {
+            cur = cur->right.get();
+
+        } else {
+            it.path_.push_back(cur);
+            cur = cur->left.get();
+        }
+    }
+
+    return it;
+}
+
+template <class ValueType>
+size_t
+PersistentSnapshot<ValueType>
+::size() const {
+    return version_->size;
+}
+
+template <class ValueType>
+bool
+PersistentSnapshot<ValueType>
+::empty() const {
+    return version_->size == 0;
+}
+
+template <class ValueType>
+PersistentSnapshot<ValueType>::Node
+::Node(
+        Color color,
+        NodePtr left,
         const ValueType& value,
+        NodePtr right
+):
+        value{value},
+        color{color},
+        left{std::move(left)},
+        right{std::move(right)}
+{}
+
+template <class ValueType>
+PersistentSnapshot<ValueType>::iterator
+::iterator(
+        VersionPtr version
+):
+        version_{std::move(version)}
+{}
+
+template <class ValueType>
+void
+PersistentSnapshot<ValueType>::iterator
+::PushLeftPath(
+        const Node* node
+) {
+    while (node) {
+        path_.push_back(node);
+        node = node->left.get();
+    }
+}
+
+template <class ValueType>
+typename PersistentSnapshot<ValueType>::iterator&
+PersistentSnapshot<ValueType>::iterator
+::operator++() {
+    const Node* node = path_.back();
+    path_.pop_back();
+    PushLeftPath(node->right.get());
+    return *this;
+}
+
+template <class ValueType>
+typename PersistentSnapshot<ValueType>::iterator
+PersistentSnapshot<ValueType>::iterator
+::operator++(int dummy) {
+    iterator cpy(*this);
+    this->operator++();
+    return cpy;
+}
+
+template <class ValueType>
+const ValueType&
+PersistentSnapshot<ValueType>::iterator
+::operator*() {
+    return path_.back()->value;
+}
+
+template <class ValueType>
+const ValueType*
+PersistentSnapshot<ValueType>::iterator
+::operator->() {
+    return &(path_.back()->value);
+}
+
+template <class ValueType>
+bool
+PersistentSnapshot<ValueType>::iterator
+::operator==(
+        const iterator& rhs
+) const {
+    if (path_.empty() || rhs.path_.empty()) {
+        return path_.empty() && rhs.path_.empty();
+    }
+
+    return path_.back() == rhs.path_.back();
+}
+
+template <class ValueType>
+bool
+PersistentSnapshot<ValueType>::iterator
+::operator!=(
+        const iterator& rhs
+) const {
+    return !(*this == rhs);
+}
+
+/*
+ *
+ *      PersistentSet implementation
+ *
+ */
+
+template <class ValueType>
+template <class ForwardIterator>
+PersistentSet<ValueType>
+::PersistentSet(
+        ForwardIterator first,
+        ForwardIterator last
+) {
+    while (first != last) {
+        insert(*first);
+        ++first;
+    }
+}
+
+template <class ValueType>
+PersistentSet<ValueType>
+::PersistentSet(
+        std::initializer_list<ValueType> list
+):
+        PersistentSet(list.begin(), list.end())
+{}
+
+template <class ValueType>
+void
+PersistentSet<ValueType>
+::insert(
+        const ValueType& value
+) {
+    if (this->find(value) != this->end()) {
+        return;
+    }
+
+    NodePtr root = Insert(this->version_->root, value);
+    Publish(Black(root->left, root->value, root->right), this->size() + 1);
+}
+
+template <class ValueType>
+void
+PersistentSet<ValueType>
+::erase(
+        const ValueType& value
+) {
+    if (this->find(value) == this->end()) {
+        return;
+    }
+
+    NodePtr root = Delete(this->version_->root, value);
+    if (root) {
+        root = Black(root->left, root->value, root->right);
+    }
+
+    Publish(root, this->size() - 1);
+}
+
+template <class ValueType>
+PersistentSnapshot<ValueType>
+PersistentSet<ValueType>
+::snapshot() const {
+    return Snapshot(std::atomic_load(&this->version_));
+}
+
+template <class ValueType>
+void
+PersistentSet<ValueType>
+::Publish(
+        NodePtr root,
+        size_t size
+) {
+    std::atomic_store(&this->version_,
+                      std::make_shared<const Version>(Version{std::move(root), size}));
+}
+
+template <class ValueType>
+typename PersistentSet<ValueType>::NodePtr
+PersistentSet<ValueType>
+::Make(
         Color color,
-        Node *left,
-        Node *right,
-        Node *parent
+        NodePtr left,
+        const ValueType& value,
+        NodePtr right
+) {
+    return std::make_shared<const Node>(color, std::move(left), value, std::move(right));
+}
+
+template <class ValueType>
+typename PersistentSet<ValueType>::NodePtr
+PersistentSet<ValueType>
+::Red(
+        NodePtr left,
+        const ValueType& value,
+        NodePtr right
+) {
+    return Make(Color::kRed, std::move(left), value, std::move(right));
+}
+
+template <class ValueType>
+typename PersistentSet<ValueType>::NodePtr
+PersistentSet<ValueType>
+::Black(
+        NodePtr left,
+        const ValueType& value,
+        NodePtr right
+) {
+    return Make(Color::kBlack, std::move(left), value, std::move(right));
+}
+
+template <class ValueType>
+bool
+PersistentSet<ValueType>
+::IsRed(
+        const NodePtr& node
+) {
+    return node && node->color == Color::kRed;
+}
+
+//  Black non-empty node, empty leaves are not counted
+template <class ValueType>
+bool
+PersistentSet<ValueType>
+::IsBlack(
+        const NodePtr& node
+) {
+    return node && node->color == Color::kBlack;
+}
+
+//  Black node with a possible red-red violation below it
+template <class ValueType>
+typename PersistentSet<ValueType>::NodePtr
+PersistentSet<ValueType>
+::Balance(
+        NodePtr left,
+        const ValueType& value,
+        NodePtr right
+) {
+    if (IsRed(left) && IsRed(right)) {
+        return Red(Black(left->left, left->value, left->right), value,
+                   Black(right->left, right->value, right->right));
+    }
+
+    if (IsRed(left) && IsRed(left->left)) {
+        const NodePtr& ll = left->left;
+        return Red(Black(ll->left, ll->value, ll->right), left->value,
+                   Black(left->right, value, right));
+    }
+
+    if (IsRed(left) && IsRed(left->right)) {
+        const NodePtr& lr = left->right;
+        return Red(Black(left->left, left->value, lr->left), lr->value,
+                   Black(lr->right, value, right));
+    }
+
+    if (IsRed(right) && IsRed(right->right)) {
+        const NodePtr& rr = right->right;
+        return Red(Black(left, value, right->left), right->value,
+                   Black(rr->left, rr->value, rr->right));
+    }
+
+    if (IsRed(right) && IsRed(right->left)) {
+        const NodePtr& rl = right->left;
+        return Red(Black(left, value, rl->left), rl->value,
+                   Black(rl->right, right->value, right->right));
+    }
+
+    return Black(std::move(left), value, std::move(right));
+}
+
+//  value must be absent
+template <class ValueType>
+typename PersistentSet<ValueType>::NodePtr
+PersistentSet<ValueType>
+::Insert(
+        const NodePtr& node,
+        const ValueType& value
+) {
+    if (!node) {
+        return Red(nullptr, value, nullptr);
+    }
+
+    if (node->color == Color::kBlack) {
+        if (value < node->value) {
+            return Balance(Insert(node->left, value), node->value, node->right);
+        }
+
+        return Balance(node->left, node->value, Insert(node->right, value));
+    }
+
+    if (value < node->value) {
+        return Red(Insert(node->left, value), node->value, node->right);
+    }
+
+    return Red(node->left, node->value, Insert(node->right, value));
+}
+
+//  value must be present. Result of deleting from a black node has
+//  black height one less, the callers rebalance it.
+template <class ValueType>
+typename PersistentSet<ValueType>::NodePtr
+PersistentSet<ValueType>
+::Delete(
+        const NodePtr& node,
+        const ValueType& value
+) {
+    if (value < node->value) {
+        if (IsBlack(node->left)) {
+            return BalanceLeft(Delete(node->left, value), node->value, node->right);
+        }
+
+        return Red(Delete(node->left, value), node->value, node->right);
+    }
+
+    if (node->value < value) {
+        if (IsBlack(node->right)) {
+            return BalanceRight(node->left, node->value, Delete(node->right, value));
+        }
+
+        return Red(node->left, node->value, Delete(node->right, value));
+    }
+
+    return Append(node->left, node->right);
+}
+
+//  Left subtree is one black level short
+template <class ValueType>
+typename PersistentSet<ValueType>::NodePtr
+PersistentSet<ValueType>
+::BalanceLeft(
+        NodePtr left,
+        const ValueType& value,
+        NodePtr right
+) {
+    if (IsRed(left)) {
+        return Red(Black(left->left, left->value, left->right), value, std::move(right));
+    }
+
+    if (IsBlack(right)) {
+        return Balance(std::move(left), value, Red(right->left, right->value, right->right));
+    }
+
+    if (IsRed(right) && IsBlack(right->left)) {
+        const NodePtr& rl = right->left;
+        return Red(Black(std::move(left), value, rl->left), rl->value,
+                   Balance(rl->right, right->value, Redden(right->right)));
+    }
+
+    throw std::logic_error("Persistent red-black tree invariant is broken");
+}
+
+//  Right subtree is one black level short
+template <class ValueType>
+typename PersistentSet<ValueType>::NodePtr
+PersistentSet<ValueType>
+::BalanceRight(
+        NodePtr left,
+        const ValueType& value,
+        NodePtr right
+) {
+    if (IsRed(right)) {
+        return Red(std::move(left), value, Black(right->left, right->value, right->right));
+    }
+
+    if (IsBlack(left)) {
+        return Balance(Red(left->left, left->value, left->right), value, std::move(right));
+    }
+
+    if (IsRed(left) && IsBlack(left->right)) {
+        const NodePtr& lr = left->right;
+        return Red(Balance(Redden(left->left), left->value, lr->left), lr->value,
+                   Black(lr->right, value, std::move(right)));
+    }
+
+    throw std::logic_error("Persistent red-black tree invariant is broken");
+}
+
+template <class ValueType>
+typename PersistentSet<ValueType>::NodePtr
+PersistentSet<ValueType>
+::Redden(
+        const NodePtr& node
+) {
+    if (!IsBlack(node)) {
+        throw std::logic_error("Persistent red-black tree invariant is broken");
+    }
+
+    return Red(node->left, node->value, node->right);
+}
+
+//  Glues two subtrees of the deleted node
+template <class ValueType>
+typename PersistentSet<ValueType>::NodePtr
+PersistentSet<ValueType>
+::Append(
+        const NodePtr& left,
+        const NodePtr& right
+) {
+    if (!left) {
+        return right;
+    }
+
+    if (!right) {
+        return left;
+    }
+
+    if (IsRed(left) && IsRed(right)) {
+        NodePtr middle = Append(left->right, right->left);
+        if (IsRed(middle)) {
+            return Red(Red(left->left, left->value, middle->left), middle->value,
+                       Red(middle->right, right->value, right->right));
+        }
+
+        return Red(left->left, left->value, Red(middle, right->value, right->right));
+    }
+
+    if (IsBlack(left) && IsBlack(right)) {
+        NodePtr middle = Append(left->right, right->left);
+        if (IsRed(middle)) {
+            return Red(Black(left->left, left->value, middle->left), middle->value,
+                       Black(middle->right, right->value, right->right));
+        }
+
+        return BalanceLeft(left->left, left->value, Black(middle, right->value, right->right));
+    }
+
+    if (IsRed(right)) {
+        return Red(Append(left, right->left), right->value, right->right);
+    }
+
+    return Red(left->left, left->value, Append(left->right, right));
+}
+
+
+/*
+ *
+ *              Compact Set
+ *
+ *      Red-black tree with nodes in one contiguous array linked by 32-bit
+ *      indices. Color is the low bit of the parent link, so a node of
+ *      uint32_t takes 16 bytes instead of 40 and copying the set is a
+ *      single array copy. Slot 0 is the nil sentinel, erased slots are
+ *      reused through a free list linked by left.
+ *
+ *      ValueType must be default constructible, erased slots are reset
+ *      to ValueType(). Set holds at most 2^31 - 1 values.
+ *
+ */
+
+template <class ValueType, class Compare = std::less<ValueType>>
+class CompactSet {
+    typedef uint32_t Index;
+
+public:
+    class iterator:
+            public std::iterator<std::bidirectional_iterator_tag, const ValueType> {
+        friend class CompactSet;
+
+    public:
+        iterator(): idx_{0}, set_{nullptr} {};
+        iterator(Index idx, const CompactSet* set);
+
+        iterator& operator++();
+        iterator operator++(int);
+
+        iterator& operator--();
+        iterator operator--(int);
+
+        const ValueType& operator*();
+        const ValueType* operator->();
+
+        bool operator==(const iterator& rhs) const;
+        bool operator!=(const iterator& rhs) const;
+
+    private:
+        Index idx_;
+        const CompactSet* set_;
+    };
+
+    iterator begin() const;
+    iterator end() const;
+
+    CompactSet();
+
+    template <class InputIterator>
+    CompactSet(InputIterator first, InputIterator last);
+
+    CompactSet(std::initializer_list<ValueType> list);
+    CompactSet(const CompactSet& rhs) = default;
+    CompactSet(CompactSet&& rhs) noexcept;
+
+    CompactSet& operator=(const CompactSet& rhs) = default;
+    CompactSet& operator=(CompactSet&& rhs) noexcept;
+
+    std::pair<iterator, bool> insert(const ValueType& value);
+
+    template <class... Args>
+    std::pair<iterator, bool> emplace(Args&&... args);
+    void erase(const ValueType& value);
+    iterator find(const ValueType& value) const;
+    iterator lower_bound(const ValueType& value) const;
+
+    size_t size() const;
+    bool empty() const;
+    void reserve(size_t capacity);
+    void swap(CompactSet& rhs) noexcept;
+
+private:
+    static constexpr Index kNil = 0;
+    static constexpr Index kRedBit = 1;
+    static constexpr size_t kMaxSize = (size_t(1) << 31) - 1;
+
+    //  parent_color is parent index shifted left by one with the red bit
+    struct Node {
+        ValueType value;
+        Index left;
+        Index right;
+        Index parent_color;
+    };
+
+    template <class Value>
+    std::pair<iterator, bool> InsertValue(Value&& value);
+    template <class Value>
+    Index CreateNode(Value&& value, Index parent);
+    void DestroyNode(Index node);
+    void AcquireNil();
+
+    Index Parent(Index node) const;
+    void SetParent(Index node, Index parent);
+    bool IsRed(Index node) const;
+    bool IsBlack(Index node) const;
+    void SetRed(Index node);
+    void SetBlack(Index node);
+    void CopyColor(Index dst, Index src);
+
+    Index TreeMinimum(Index root) const;
+    Index TreeMaximum(Index root) const;
+    Index TreeSuccessor(Index node) const;
+    Index TreePredecessor(Index node) const;
+    Index TreeFind(const ValueType& value) const;
+
+    void LeftRotate(Index x_node);
+    void RightRotate(Index x_node);
+    void RBInsertFixup(Index z_node);
+    void RBTransplant(Index u_node, Index v_node);
+    void RBDelete(Index z_node);
+    void RBDeleteFixup(Index x_node);
+
+    //  Empty only in a moved from CompactSet, refilled on write
+    std::vector<Node> nodes_;
+    Compare comp_;
+    Index root_;
+    Index free_;
+    size_t size_;
+};
+
+
+/*
+ *
+ *      CompactSet implementation
+ *
+ */
+
+template <class ValueType, class Compare>
+CompactSet<ValueType, Compare>
+::CompactSet():
+        root_{kNil},
+        free_{kNil},
+        size_{0}
+{
+    AcquireNil();
+}
+
+template <class ValueType, class Compare>
+template <class InputIterator>
+CompactSet<ValueType, Compare>
+::CompactSet(
+        InputIterator first,
+        InputIterator last
+):
+        CompactSet()
+{
+    for (; first != last; ++first) {
+        insert(*first);
+    }
+}
+
+template <class ValueType, class Compare>
+CompactSet<ValueType, Compare>
+::CompactSet(
+        std::initializer_list<ValueType> list
+):
+        CompactSet(list.begin(), list.end())
+{}
+
+template <class ValueType, class Compare>
+CompactSet<ValueType, Compare>
+::CompactSet(
+        CompactSet&& rhs
+) noexcept:
+        nodes_{std::move(rhs.nodes_)},
+        comp_{rhs.comp_},
+        root_{rhs.root_},
+        free_{rhs.free_},
+        size_{rhs.size_}
+{
+    rhs.nodes_.clear();
+    rhs.root_ = rhs.free_ = kNil;
+    rhs.size_ = 0;
+}
+
+template <class ValueType, class Compare>
+CompactSet<ValueType, Compare>&
+CompactSet<ValueType, Compare>
+::operator=(
+        CompactSet&& rhs
+) noexcept {
+    swap(rhs);
+    return *this;
+}
+
+template <class ValueType, class Compare>
+std::pair<typename CompactSet<ValueType, Compare>::iterator, bool>
+CompactSet<ValueType, Compare>
+::insert(
+        const ValueType& value
+) {
+    return InsertValue(value);
+}
+
+template <class ValueType, class Compare>
+template <class... Args>
+std::pair<typename CompactSet<ValueType, Compare>::iterator, bool>
+CompactSet<ValueType, Compare>
+::emplace(
+        Args&&... args
+) {
+    return InsertValue(ValueType(std::forward<Args>(args)...));
+}
+
+template <class ValueType, class Compare>
+void
+CompactSet<ValueType, Compare>
+::erase(
+        const ValueType& value
+) {
+    Index node = TreeFind(value);
+    if (node == kNil) {
+        return;
+    }
+
+    RBDelete(node);
+    DestroyNode(node);
+    --size_;
+}
+
+template <class ValueType, class Compare>
+typename CompactSet<ValueType, Compare>::iterator
+CompactSet<ValueType, Compare>
+::find(
+        const ValueType& value
+) const {
+    return iterator(TreeFind(value), this);
+}
+
+template <class ValueType, class Compare>
+typename CompactSet<ValueType, Compare>::iterator
+CompactSet<ValueType, Compare>
+::lower_bound(
+        const ValueType& value
+) const {
+    Index result = kNil;
+    Index cur = root_;
+    while (cur != kNil) {
+        if (comp_(nodes_[cur].value, value)) {
+            cur = nodes_[cur].right;
+
+        } else {
+            result = cur;
+            cur = nodes_[cur].left;
+        }
+    }
+
+    return iterator(result, this);
+}
+
+template <class ValueType, class Compare>
+size_t
+CompactSet<ValueType, Compare>
+::size() const {
+    return size_;
+}
+
+template <class ValueType, class Compare>
+bool
+CompactSet<ValueType, Compare>
+::empty() const {
+    return size_ == 0;
+}
+
+//  Nil slot is counted too
+template <class ValueType, class Compare>
+void
+CompactSet<ValueType, Compare>
+::reserve(
+        size_t capacity
+) {
+    nodes_.reserve(capacity + 1);
+}
+
+template <class ValueType, class Compare>
+void
+CompactSet<ValueType, Compare>
+::swap(
+        CompactSet& rhs
+) noexcept {
+    std::swap(nodes_, rhs.nodes_);
+    std::swap(comp_, rhs.comp_);
+    std::swap(root_, rhs.root_);
+    std::swap(free_, rhs.free_);
+    std::swap(size_, rhs.size_);
+}
+
+template <class ValueType, class Compare>
+template <class Value>
+std::pair<typename CompactSet<ValueType, Compare>::iterator, bool>
+CompactSet<ValueType, Compare>
+::InsertValue(
+        Value&& value
+) {
+    AcquireNil();
+
+    Index y_node = kNil;
+    Index x_node = root_;
+    bool as_left = false;
+    while (x_node != kNil) {
+        y_node = x_node;
+        if (comp_(value, nodes_[x_node].value)) {
+            as_left = true;
+            x_node = nodes_[x_node].left;
+
+        } else if (comp_(nodes_[x_node].value, value)) {
+            as_left = false;
+            x_node = nodes_[x_node].right;
+
+        } else {
+            return {iterator(x_node, this), false};
+        }
+    }
+
+    Index z_node = CreateNode(std::forward<Value>(value), y_node);
+    if (y_node == kNil) {
+        root_ = z_node;
+
+    } else if (as_left) {
+        nodes_[y_node].left = z_node;
+
+    } else {
+        nodes_[y_node].right = z_node;
+    }
+
+    ++size_;
+    RBInsertFixup(z_node);
+    return {iterator(z_node, this), true};
+}
+
+//  New node is red and has no children
+template <class ValueType, class Compare>
+template <class Value>
+typename CompactSet<ValueType, Compare>::Index
+CompactSet<ValueType, Compare>
+::CreateNode(
+        Value&& value,
+        Index parent
+) {
+    if (size_ == kMaxSize) {
+        throw std::length_error("CompactSet can't hold more than 2^31 - 1 values");
+    }
+
+    Index node = free_;
+    if (node != kNil) {
+        free_ = nodes_[node].left;
+        nodes_[node].value = std::forward<Value>(value);
+
+    } else {
+        nodes_.push_back(Node{std::forward<Value>(value), kNil, kNil, kNil});
+        node = static_cast<Index>(nodes_.size() - 1);
+    }
+
+    nodes_[node].left = nodes_[node].right = kNil;
+    nodes_[node].parent_color = parent << 1 | kRedBit;
+    return node;
+}
+
+template <class ValueType, class Compare>
+void
+CompactSet<ValueType, Compare>
+::DestroyNode(
+        Index node
+) {
+    nodes_[node].value = ValueType();
+    nodes_[node].left = free_;
+    free_ = node;
+}
+
+template <class ValueType, class Compare>
+void
+CompactSet<ValueType, Compare>
+::AcquireNil() {
+    if (nodes_.empty()) {
+        nodes_.push_back(Node{ValueType(), kNil, kNil, kNil});
+    }
+}
+
+template <class ValueType, class Compare>
+typename CompactSet<ValueType, Compare>::Index
+CompactSet<ValueType, Compare>
+::Parent(
+        Index node
+) const {
+    return nodes_[node].parent_color >> 1;
+}
+
+template <class ValueType, class Compare>
+void
+CompactSet<ValueType, Compare>
+::SetParent(
+        Index node,
+        Index parent
+) {
+    nodes_[node].parent_color = parent << 1 | (nodes_[node].parent_color & kRedBit);
+}
+
+template <class ValueType, class Compare>
+bool
+CompactSet<ValueType, Compare>
+::IsRed(
+        Index node
+) const {
+    return nodes_[node].parent_color & kRedBit;
+}
+
+template <class ValueType, class Compare>
+bool
+CompactSet<ValueType, Compare>
+::IsBlack(
+        Index node
+) const {
+    return !IsRed(node);
+}
+
+template <class ValueType, class Compare>
+void
+CompactSet<ValueType, Compare>
+::SetRed(
+        Index node
+) {
+    nodes_[node].parent_color |= kRedBit;
+}
+
+template <class ValueType, class Compare>
+void
+CompactSet<ValueType, Compare>
+::SetBlack(
+        Index node
+) {
+    nodes_[node].parent_color &= ~kRedBit;
+}
+
+template <class ValueType, class Compare>
+void
+CompactSet<ValueType, Compare>
+::CopyColor(
+        Index dst,
+        Index src
+) {
+    nodes_[dst].parent_color = (nodes_[dst].parent_color & ~kRedBit) |
+                               (nodes_[src].parent_color & kRedBit);
+}
+
+template <class ValueType, class Compare>
+typename CompactSet<ValueType, Compare>::Index
+CompactSet<ValueType, Compare>
+::TreeMinimum(
+        Index root
+) const {
+    while (nodes_[root].left != kNil) {
+        root = nodes_[root].left;
+    }
+
+    return root;
+}
+
+template <class ValueType, class Compare>
+typename CompactSet<ValueType, Compare>::Index
+CompactSet<ValueType, Compare>
+::TreeMaximum(
+        Index root
+) const {
+    while (nodes_[root].right != kNil) {
+        root = nodes_[root].right;
+    }
+
+    return root;
+}
+
+template <class ValueType, class Compare>
+typename CompactSet<ValueType, Compare>::Index
+CompactSet<ValueType, Compare>
+::TreeSuccessor(
+        Index node
+) const {
+    if (nodes_[node].right != kNil) {
+        return TreeMinimum(nodes_[node].right);
+    }
+
+    Index y_node = Parent(node);
+    while (y_node != kNil && node == nodes_[y_node].right) {
+        node = y_node;
+        y_node = Parent(y_node);
+    }
+
+    return y_node;
+}
+
+template <class ValueType, class Compare>
+typename CompactSet<ValueType, Compare>::Index
+CompactSet<ValueType, Compare>
+::TreePredecessor(
+        Index node
+) const {
+    if (nodes_[node].left != kNil) {
+        return TreeMaximum(nodes_[node].left);
+    }
+
+    Index y_node = Parent(node);
+    while (y_node != kNil && node == nodes_[y_node].left) {
+        node = y_node;
+        y_node = Parent(y_node);
+    }
+
+    return y_node;
+}
+
+template <class ValueType, class Compare>
+typename CompactSet<ValueType, Compare>::Index
+CompactSet<ValueType, Compare>
+::TreeFind(
+        const ValueType& value
+) const {
+    Index cur = root_;
+    while (cur != kNil) {
+        if (comp_(value, nodes_[cur].value)) {
+            cur = nodes_[cur].left;
+
+        } else if (comp_(nodes_[cur].value, value)) {
+            cur = nodes_[cur].right;
+
+        } else {
+            return cur;
+        }
+    }
+
+    return kNil;
+}
+
+template <class ValueType, class Compare>
+void
+CompactSet<ValueType, Compare>
+::LeftRotate(
+        Index x_node
+) {
+    Index y_node = nodes_[x_node].right;
+    nodes_[x_node].right = nodes_[y_node].left;
+    if (nodes_[y_node].left != kNil) {
+        SetParent(nodes_[y_node].left, x_node);
+    }
+
+    Index parent = Parent(x_node);
+    SetParent(y_node, parent);
+    if (parent == kNil) {
+        root_ = y_node;
+
+    } else if (x_node == nodes_[parent].left) {
+        nodes_[parent].left = y_node;
+
+    } else {
+        nodes_[parent].right = y_node;
+    }
+
+    nodes_[y_node].left = x_node;
+    SetParent(x_node, y_node);
+}
+
+template <class ValueType, class Compare>
+void
+CompactSet<ValueType, Compare>
+::RightRotate(
+        Index x_node
+) {
+    Index y_node = nodes_[x_node].left;
+    nodes_[x_node].left = nodes_[y_node].right;
+    if (nodes_[y_node].right != kNil) {
+        SetParent(nodes_[y_node].right, x_node);
+    }
+
+    Index parent = Parent(x_node);
+    SetParent(y_node, parent);
+    if (parent == kNil) {
+        root_ = y_node;
+
+    } else if (x_node == nodes_[parent].left) {
+        nodes_[parent].left = y_node;
+
+    } else {
+        nodes_[parent].right = y_node;
+    }
+
+    nodes_[y_node].right = x_node;
+    SetParent(x_node, y_node);
+}
+
+template <class ValueType, class Compare>
+void
+CompactSet<ValueType, Compare>
+::RBInsertFixup(
+        Index z_node
+) {
+    while (IsRed(Parent(z_node))) {
+        Index parent = Parent(z_node);
+        Index grandparent = Parent(parent);
+
+        if (parent == nodes_[grandparent].left) {
+            Index y_node = nodes_[grandparent].right;
+            if (IsRed(y_node)) {
+                SetBlack(parent);
+                SetBlack(y_node);
+                SetRed(grandparent);
+                z_node = grandparent;
+
+            } else {
+                if (z_node == nodes_[parent].right) {
+                    z_node = parent;
+                    LeftRotate(z_node);
+                }
+
+                SetBlack(Parent(z_node));
+                SetRed(Parent(Parent(z_node)));
+                RightRotate(Parent(Parent(z_node)));
+            }
+
+        } else {
+            Index y_node = nodes_[grandparent].left;
+            if (IsRed(y_node)) {
+                SetBlack(parent);
+                SetBlack(y_node);
+                SetRed(grandparent);
+                z_node = grandparent;
+
+            } else {
+                if (z_node == nodes_[parent].left) {
+                    z_node = parent;
+                    RightRotate(z_node);
+                }
+
+                SetBlack(Parent(z_node));
+                SetRed(Parent(Parent(z_node)));
+                LeftRotate(Parent(Parent(z_node)));
+            }
+        }
+    }
+
+    SetBlack(root_);
+}
+
+template <class ValueType, class Compare>
+void
+CompactSet<ValueType, Compare>
+::RBTransplant(
+        Index u_node,
+        Index v_node
+) {
+    Index parent = Parent(u_node);
+    if (parent == kNil) {
+        root_ = v_node;
+
+    } else if (u_node == nodes_[parent].left) {
+        nodes_[parent].left = v_node;
+
+    } else {
+        nodes_[parent].right = v_node;
+    }
+
+    SetParent(v_node, parent);
+}
+
+template <class ValueType, class Compare>
+void
+CompactSet<ValueType, Compare>
+::RBDelete(
+        Index z_node
+) {
+    Index x_node;
+    bool y_original_red = IsRed(z_node);
+
+    if (nodes_[z_node].left == kNil) {
+        x_node = nodes_[z_node].right;
+        RBTransplant(z_node, x_node);
+
+    } else if (nodes_[z_node].right == kNil) {
+        x_node = nodes_[z_node].left;
+        RBTransplant(z_node, x_node);
+
+    } else {
+        Index y_node = TreeMinimum(nodes_[z_node].right);
+        y_original_red = IsRed(y_node);
+        x_node = nodes_[y_node].right;
+        if (Parent(y_node) == z_node) {
+            SetParent(x_node, y_node);
+
+        } else {
+            RBTransplant(y_node, x_node);
+            nodes_[y_node].right = nodes_[z_node].right;
+            SetParent(nodes_[y_node].right, y_node);
+        }
+
+        RBTransplant(z_node, y_node);
+        nodes_[y_node].left = nodes_[z_node].left;
+        SetParent(nodes_[y_node].left, y_node);
+        CopyColor(y_node, z_node);
+    }
+
+    if (!y_original_red) {
+        RBDeleteFixup(x_node);
+    }
+}
+
+template <class ValueType, class Compare>
+void
+CompactSet<ValueType, Compare>
+::RBDeleteFixup(
+        Index x_node
+) {
+    while (x_node != root_ && IsBlack(x_node)) {
+        Index parent = Parent(x_node);
+
+        if (x_node == nodes_[parent].left) {
+            Index w_node = nodes_[parent].right;
+            if (IsRed(w_node)) {
+                SetBlack(w_node);
+                SetRed(parent);
+                LeftRotate(parent);
+                w_node = nodes_[parent].right;
+            }
+
+            if (IsBlack(nodes_[w_node].left) && IsBlack(nodes_[w_node].right)) {
+                SetRed(w_node);
+                x_node = parent;
+
+            } else {
+                if (IsBlack(nodes_[w_node].right)) {
+                    SetBlack(nodes_[w_node].left);
+                    SetRed(w_node);
+                    RightRotate(w_node);
+                    w_node = nodes_[parent].right;
+                }
+
+                CopyColor(w_node, parent);
+                SetBlack(parent);
+                SetBlack(nodes_[w_node].right);
+                LeftRotate(parent);
+                x_node = root_;
+            }
+
+        } else {
+            Index w_node = nodes_[parent].left;
+            if (IsRed(w_node)) {
+                SetBlack(w_node);
+                SetRed(parent);
+                RightRotate(parent);
+                w_node = nodes_[parent].left;
+            }
+
+            if (IsBlack(nodes_[w_node].left) && IsBlack(nodes_[w_node].right)) {
+                SetRed(w_node);
+                x_node = parent;
+
+            } else {
+                if (IsBlack(nodes_[w_node].left)) {
+                    SetBlack(nodes_[w_node].right);
+                    SetRed(w_node);
+                    LeftRotate(w_node);
+                    w_node = nodes_[parent].left;
+                }
+
+                CopyColor(w_node, parent);
+                SetBlack(parent);
+                SetBlack(nodes_[w_node].left);
+                RightRotate(parent);
+                x_node = root_;
+            }
+        }
+    }
+
+    SetBlack(x_node);
+}
+
+template <class ValueType, class Compare>
+typename CompactSet<ValueType, Compare>::iterator
+CompactSet<ValueType, Compare>
+::begin() const {
+    if (root_ == kNil) {
+        return end();
+    }
+
+    return iterator(TreeMinimum(root_), this);
+}
+
+template <class ValueType, class Compare>
+typename CompactSet<ValueType, Compare>::iterator
+CompactSet<ValueType, Compare>
+::end() const {
+    return iterator(kNil, this);
+}
+
+template <class ValueType, class Compare>
+CompactSet<ValueType, Compare>::iterator
+::iterator(
+        Index idx,
+        const CompactSet* set
 ):
-        value{value},
-        color{color},
-        left{left},
-        right{right},
-        parent{parent}
+        idx_{idx},
+        set_{set}
 {}
 
+template <class ValueType, class Compare>
+typename CompactSet<ValueType, Compare>::iterator&
+CompactSet<ValueType, Compare>::iterator
+::operator++() {
+    idx_ = set_->TreeSuccessor(idx_);
+    return *this;
+}
+
+template <class ValueType, class Compare>
+typename CompactSet<ValueType, Compare>::iterator
+CompactSet<ValueType, Compare>::iterator
+::operator++(int dummy) {
+    iterator cpy(*this);
+    this->operator++();
+    return cpy;
+}
+
+template <class ValueType, class Compare>
+typename CompactSet<ValueType, Compare>::iterator&
+CompactSet<ValueType, Compare>::iterator
+::operator--() {
+    if (idx_ == kNil) {
+        idx_ = set_->TreeMaximum(set_->root_);
+
+    } else {
+        idx_ = set_->TreePredecessor(idx_);
+    }
+
+    return *this;
+}
+
+template <class ValueType, class Compare>
+typename CompactSet<ValueType, Compare>::iterator
+CompactSet<ValueType, Compare>::iterator
+::operator--(int dummy) {
+    iterator cpy(*this);
+    this->operator--();
+    return cpy;
+}
+
+template <class ValueType, class Compare>
+const ValueType&
+CompactSet<ValueType, Compare>::iterator
+::operator*() {
+    return set_->nodes_[idx_].value;
+}
+
+template <class ValueType, class Compare>
+const ValueType*
+CompactSet<ValueType, Compare>::iterator
+::operator->() {
+    return &(set_->nodes_[idx_].value);
+}
+
+template <class ValueType, class Compare>
+bool
+CompactSet<ValueType, Compare>::iterator
+::operator==(
+        const iterator& rhs
+) const {
+    return idx_ == rhs.idx_;
+}
+
+template <class ValueType, class Compare>
+bool
+CompactSet<ValueType, Compare>::iterator
+::operator!=(
+        const iterator& rhs
+) const {
+    return idx_ != rhs.idx_;
+}
+
+
+/*
+ *
+ *              Concurrent Set
+ *
+ *      Set with one writer thread and any number of lock-free readers.
+ *      The writer bumps a sequence counter to odd before it changes the
+ *      tree and to even after it, a reader descends optimistically and
+ *      retries if the counter was odd or moved meanwhile. Readers copy
+ *      the value out before validation, so ValueType must be trivially
+ *      copyable.
+ *
+ *      Readers and the writer meet only through atomics: the writer
+ *      stores left, right and root_ with release stores (see SetLink),
+ *      readers load them with acquire loads and copy values with relaxed
+ *      atomic loads. A value is written only before its node is linked.
+ *
+ *      A reader may still follow a node the writer has just erased, so
+ *      nodes are freed through EpochAllocator only after every reader
+ *      that could see them has left. Torn descents are cut at
+ *      concurrent_max_depth steps and retried.
+ *
+ */
+
+//  Red-black tree height never exceeds 2 log2(n + 1)
+constexpr size_t concurrent_max_depth = 2 * 64;
+
+template <class ValueType, class Compare = std::less<ValueType>>
+class ConcurrentSet {
+    static_assert(std::is_trivially_copyable<ValueType>::value,
+                  "ConcurrentSet readers copy values that may be concurrently written");
+
+    typedef Set<ValueType, EpochAllocator<ValueType>, NoAugmentation, Compare> Tree;
+    typedef typename Tree::Node Node;
+
+public:
+    ConcurrentSet() = default;
+
+    ConcurrentSet(const ConcurrentSet&) = delete;
+    ConcurrentSet& operator=(const ConcurrentSet&) = delete;
+
+    //  Writer thread only. Descent and allocation are done
+    //  before the counter goes odd, so readers wait only for relinking.
+    bool insert(const ValueType& value);
+    bool erase(const ValueType& value);
+
+    //  Any thread, the found value is copied to out
+    bool contains(const ValueType& value) const;
+    bool find(const ValueType& value, ValueType* out) const;
+    bool lower_bound(const ValueType& value, ValueType* out) const;
+
+    size_t size() const;
+    bool empty() const;
+
+private:
+    void BeginWrite();
+    void EndWrite();
+
+    bool OptimisticRead(const ValueType& value, bool exact, ValueType* out) const;
+    bool Descend(const ValueType& value, bool exact, ValueType* out) const;
+
+    //  Word sized values are loaded at once, others byte by byte
+    typedef std::integral_constant<
+            bool, sizeof(ValueType) <= sizeof(void*) &&
+                  (sizeof(ValueType) & (sizeof(ValueType) - 1)) == 0 &&
+                  alignof(ValueType) == sizeof(ValueType)
+    > WordValue;
+
+    static Node* LoadLink(Node* const& link);
+    static ValueType LoadValue(const ValueType& value);
+    static ValueType LoadValue(const ValueType& value, std::true_type);
+    static ValueType LoadValue(const ValueType& value, std::false_type);
+
+    Tree tree_;
+    std::atomic<size_t> seq_{0};
+    std::atomic<size_t> size_{0};
+};
+
+
+/*
+ *
+ *      ConcurrentSet implementation
+ *
+ */
+
+template <class ValueType, class Compare>
+bool
+ConcurrentSet<ValueType, Compare>
+::insert(
+        const ValueType& value
+) {
+    Node* parent;
+    bool as_left;
+    Node* found = tree_.FindInsertPosition(value, &parent, &as_left);
+    if (!tree_.IsNil(found)) {
+        return false;
+    }
+
+    Node* val_node = tree_.CreateNode(value);
+    BeginWrite();
+    tree_.RBLink(val_node, parent, as_left);
+    EndWrite();
+    return true;
+}
+
+template <class ValueType, class Compare>
+bool
+ConcurrentSet<ValueType, Compare>
+::erase(
+        const ValueType& value
+) {
+    Node* val_node = tree_.TreeFind(value);
+    if (tree_.IsNil(val_node)) {
+        return false;
+    }
+
+    BeginWrite();
+    tree_.RBDelete(val_node);
+    EndWrite();
+    return true;
+}
+
+template <class ValueType, class Compare>
+bool
+ConcurrentSet<ValueType, Compare>
+::contains(
+        const ValueType& value
+) const {
+    return OptimisticRead(value, true, nullptr);
+}
+
+template <class ValueType, class Compare>
+bool
+ConcurrentSet<ValueType, Compare>
+::find(
+        const ValueType& value,
+        ValueType* out
+) const {
+    return OptimisticRead(value, true, out);
+}
+
+template <class ValueType, class Compare>
+bool
+ConcurrentSet<ValueType, Compare>
+::lower_bound(
+        const ValueType& value,
+        ValueType* out
+) const {
+    return OptimisticRead(value, false, out);
+}
+
+template <class ValueType, class Compare>
+size_t
+ConcurrentSet<ValueType, Compare>
+::size() const {
+    return size_.load(std::memory_order_relaxed);
+}
+
+template <class ValueType, class Compare>
+bool
+ConcurrentSet<ValueType, Compare>
+::empty() const {
+    return size() == 0;
+}
+
+template <class ValueType, class Compare>
+void
+ConcurrentSet<ValueType, Compare>
+::BeginWrite() {
+    seq_.store(seq_.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+}
+
+//  Blocks erased by this write wait for the next call
+template <class ValueType, class Compare>
+void
+ConcurrentSet<ValueType, Compare>
+::EndWrite() {
+    seq_.store(seq_.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+    size_.store(tree_.size_, std::memory_order_relaxed);
+    tree_.alloc_.domain().Reclaim();
+}
+
+template <class ValueType, class Compare>
+bool
+ConcurrentSet<ValueType, Compare>
+::OptimisticRead(
+        const ValueType& value,
+        bool exact,
+        ValueType* out
+) const {
+    EpochDomain& domain = tree_.alloc_.domain();
+    size_t pin = domain.Enter();
+
+    ValueType copy{};
+    bool found;
+    for (;;) {
+        size_t seq = seq_.load(std::memory_order_acquire);
+        if (seq & 1) {
+            std::this_thread::yield();
+            continue;
+        }
+
+        found = Descend(value, exact, &copy);
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (seq_.load(std::memory_order_relaxed) == seq) {
+            break;
+        }
+    }
+
+    domain.Exit(pin);
+    if (found && out) {
+        *out = copy;
+    }
+
+    return found;
+}
+
+//  May run into a half done rotation, the caller validates the result
+template <class ValueType, class Compare>
+bool
+ConcurrentSet<ValueType, Compare>
+::Descend(
+        const ValueType& value,
+        bool exact,
+        ValueType* out
+) const {
+    Node* nil = tree_.nil_;
+    Node* cur = LoadLink(tree_.root_);
+    Node* bound = nil;
+    ValueType bound_value{};
+    for (size_t depth = 0; cur != nil && depth < concurrent_max_depth; ++depth) {
+        ValueType cur_value = LoadValue(cur->value);
+        if (tree_.Less(cur_value, value)) {
+            cur = LoadLink(cur->right);
+
+        } else {
+            bound = cur;
+            bound_value = cur_value;
+            cur = LoadLink(cur->left);
+        }
+    }
+
+    if (bound == nil || (exact && tree_.Less(value, bound_value))) {
+        return false;
+    }
+
+    *out = bound_value;
+    return true;
+}
+
+template <class ValueType, class Compare>
+typename ConcurrentSet<ValueType, Compare>::Node*
+ConcurrentSet<ValueType, Compare>
+::LoadLink(
+        Node* const& link
+) {
+    return __atomic_load_n(&link, __ATOMIC_ACQUIRE);
+}
+
+template <class ValueType, class Compare>
+ValueType
+ConcurrentSet<ValueType, Compare>
+::LoadValue(
+        const ValueType& value
+) {
+    return LoadValue(value, WordValue());
+}
+
+template <class ValueType, class Compare>
+ValueType
+ConcurrentSet<ValueType, Compare>
+::LoadValue(
+        const ValueType& value,
+        std::true_type
+) {
+    ValueType copy;
+    __atomic_load(&value, &copy, __ATOMIC_RELAXED);
+    return copy;
+}
+
+template <class ValueType, class Compare>
+ValueType
+ConcurrentSet<ValueType, Compare>
+::LoadValue(
+        const ValueType& value,
+        std::false_type
+) {
+    ValueType copy;
+    const unsigned char* src = reinterpret_cast<const unsigned char*>(&value);
+    unsigned char* dst = reinterpret_cast<unsigned char*>(&copy);
+    for (size_t i = 0; i < sizeof(ValueType); ++i) {
+        dst[i] = __atomic_load_n(src + i, __ATOMIC_RELAXED);
+    }
+
+    return copy;
+}
+
 
 #endif //DATA_STRUCTURES_RBTREE_H
@@ -0,0 +1,207 @@
+//
+// Created by alexaxnder on 19.10.26.
+//
+
+#ifndef DATA_STRUCTURES_SLAB_ALLOCATOR_H
+#define DATA_STRUCTURES_SLAB_ALLOCATOR_H
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdlib>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <vector>
+
+
+//  First slab size in blocks, every next slab is twice bigger up to the max
+constexpr size_t slab_first_blocks = 64;
+constexpr size_t slab_max_blocks = 1 << 16;
+
+
+/*
+ *      Pool of fixed size blocks
+ *
+ *      Blocks are cut from slabs in allocation order, so nodes of a bulk
+ *      loaded container lie contiguously. Freed blocks go to an intrusive
+ *      free list and are reused first. All slabs are released at once
+ *      when the pool dies.
+ */
+class SlabPool {
+public:
+    SlabPool() = default;
+    ~SlabPool();
+
+    SlabPool(const SlabPool&) = delete;
+    SlabPool& operator=(const SlabPool&) = delete;
+
+    void* Allocate(size_t bytes);
+    void Deallocate(void* block, size_t bytes);
+
+private:
+    struct FreeBlock {
+        FreeBlock* next;
+    };
+
+    std::vector<void*> slabs_;
+    FreeBlock* free_list_ = nullptr;
+    char* cur_ = nullptr;
+    char* end_ = nullptr;
+    size_t block_size_ = 0;
+    size_t next_slab_blocks_ = slab_first_blocks;
+
+    bool Serves(size_t bytes);
+    void NewSlab();
+};
+
+
+/*
+ *      Allocator of single objects from a SlabPool
+ *
+ *      Default constructed allocator owns a new pool, copies and rebinds
+ *      share it. Containers keep one allocator, so each container
+ *      gets its own pool. Arrays fall back to operator new.
+ */
+template <class T>
+class SlabAllocator {
+    template <class U>
+    friend class SlabAllocator;
+
+public:
+    typedef T value_type;
+
+    SlabAllocator();
+
+    template <class U>
+    SlabAllocator(const SlabAllocator<U>& rhs) noexcept;
+
+    T* allocate(size_t n);
+    void deallocate(T* ptr, size_t n) noexcept;
+
+    template <class U>
+    bool operator==(const SlabAllocator<U>& rhs) const noexcept;
+    template <class U>
+    bool operator!=(const SlabAllocator<U>& rhs) const noexcept;
+
+private:
+    std::shared_ptr<SlabPool> pool_;
+};
+
+
+//  Whether destroying the allocator frees all its memory,
+//  so containers may skip deallocating nodes one by one
+template <class Allocator>
+struct ReleasesInBulk: std::false_type {};
+
+template <class T>
+struct ReleasesInBulk<SlabAllocator<T>>: std::true_type {};
+
+
+/*
+ *      SlabPool implementation
+ */
+inline SlabPool::~SlabPool() {
+    for (void* slab : slabs_) {
+        ::operator delete(slab);
+    }
+}
+
+inline void* SlabPool::Allocate(size_t bytes) {
+    if (!Serves(bytes)) {
+        return ::operator new(bytes);
+    }
+
+    if (free_list_) {
+        FreeBlock* block = free_list_;
+        free_list_ = block->next;
+        return block;
+    }
+
+    if (cur_ == end_) {
+        NewSlab();
+    }
+
+    void* block = cur_;
+    cur_ += block_size_;
+    return block;
+}
+
+inline void SlabPool::Deallocate(void* block, size_t bytes) {
+    if (!Serves(bytes)) {
+        ::operator delete(block);
+        return;
+    }
+
+    FreeBlock* free_block = static_cast<FreeBlock*>(block);
+    free_block->next = free_list_;
+    free_list_ = free_block;
+}
+
+//  The first single object size fixes the block size of the pool
+inline bool SlabPool::Serves(size_t bytes) {
+    const size_t align = alignof(std::max_align_t);
+    size_t rounded = (std::max(bytes, sizeof(FreeBlock)) + align - 1) / align * align;
+    if (block_size_ == 0) {
+        block_size_ = rounded;
+    }
+
+    return rounded == block_size_;
+}
+
+inline void SlabPool::NewSlab() {
+    slabs_.reserve(slabs_.size() + 1);
+    cur_ = static_cast<char*>(::operator new(next_slab_blocks_ * block_size_));
+    end_ = cur_ + next_slab_blocks_ * block_size_;
+    slabs_.push_back(cur_);
+
+    next_slab_blocks_ = std::min(next_slab_blocks_ * 2, slab_max_blocks);
+}
+
+
+/*
+ *      SlabAllocator implementation
+ */
+template <class T>
+SlabAllocator<T>::SlabAllocator()
+        : pool_(std::make_shared<SlabPool>()) {}
+
+template <class T>
+template <class U>
+SlabAllocator<T>::SlabAllocator(const SlabAllocator<U>& rhs) noexcept
+        : pool_(rhs.pool_) {}
+
+template <class T>
+T* SlabAllocator<T>::allocate(size_t n) {
+    static_assert(alignof(T) <= alignof(std::max_align_t),
+                  "SlabAllocator does not support over-aligned types");
+
+    if (n != 1) {
+        return static_cast<T*>(::operator new(n * sizeof(T)));
+    }
+
+    return static_cast<T*>(pool_->Allocate(sizeof(T)));
+}
+
+template <class T>
+void SlabAllocator<T>::deallocate(T* ptr, size_t n) noexcept {
+    if (n != 1) {
+        ::operator delete(ptr);
+        return;
+    }
+
+    pool_->Deallocate(ptr, sizeof(T));
+}
+
+template <class T>
+template <class U>
+bool SlabAllocator<T>::operator==(const SlabAllocator<U>& rhs) const noexcept {
+    return pool_ == rhs.pool_;
+}
+
+template <class T>
+template <class U>
+bool SlabAllocator<T>::operator!=(const SlabAllocator<U>& rhs) const noexcept {
+    return pool_ != rhs.pool_;
+}
+
+#endif //DATA_STRUCTURES_SLAB_ALLOCATOR_H
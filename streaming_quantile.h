@@ -0,0 +1,252 @@
+//
+// Created by alexaxnder on 19.10.26.
+//
+
+#ifndef DATA_STRUCTURES_STREAMING_QUANTILE_H
+#define DATA_STRUCTURES_STREAMING_QUANTILE_H
+
+#include <cstdlib>
+#include <functional>
+#include <stdexcept>
+#include <vector>
+
+
+/*
+ *      Sliding window quantile tracker
+ *
+ *      Keeps the last window samples in a ring of slots. Slots are split
+ *      between a max-heap of the lower part (its head is the quantile)
+ *      and a min-heap of the upper part. Both heaps store slot numbers and
+ *      every slot remembers its heap position, so the expired sample is
+ *      removed by index in O(log n).
+ *
+ *      All memory is allocated in the constructor.
+ */
+template <class Item, class Compare = std::less<Item>>
+class StreamingQuantile {
+public:
+    StreamingQuantile(double quantile, size_t window);
+
+    void Add(const Item&);
+    void ExpireOldest();
+
+    Item Get();
+    size_t Size();
+    bool Empty();
+    bool Full();
+
+private:
+    enum HeapId {
+        kLower = 0, kUpper = 1
+    };
+
+    std::vector<Item> values_;
+    std::vector<size_t> heap_of_;
+    std::vector<size_t> pos_;
+    std::vector<size_t> heaps_[2];
+    Compare cmp_;
+
+    double quantile_;
+    size_t window_;
+    size_t oldest_;
+    size_t size_;
+
+    size_t TargetLowerSize();
+    void Rebalance();
+
+    bool Before(size_t heap, size_t lhs_slot, size_t rhs_slot);
+    void HeapInsert(size_t heap, size_t slot);
+    size_t HeapExtract(size_t heap);
+    void HeapRemove(size_t slot);
+    void HeapSwap(size_t heap, size_t lhs, size_t rhs);
+    size_t SiftUp(size_t heap, size_t idx);
+    size_t SiftDown(size_t heap, size_t idx);
+};
+
+
+template <class Item, class Compare = std::less<Item>>
+class StreamingMedian: public StreamingQuantile<Item, Compare> {
+public:
+    explicit StreamingMedian(size_t window);
+};
+
+
+/*
+ *      StreamingQuantile implementation
+ */
+template <class Item, class Compare>
+StreamingQuantile<Item, Compare>::StreamingQuantile(double quantile, size_t window)
+        : values_(window), heap_of_(window), pos_(window),
+          quantile_(quantile), window_(window), oldest_(0), size_(0) {
+    if (!(quantile >= 0.0 && quantile <= 1.0)) {
+        throw std::invalid_argument("Quantile must be in [0, 1]");
+    }
+
+    if (window == 0) {
+        throw std::invalid_argument("Quantile window must be positive");
+    }
+
+    heaps_[kLower].reserve(window);
+    heaps_[kUpper].reserve(window);
+}
+
+template <class Item, class Compare>
+void StreamingQuantile<Item, Compare>::Add(const Item& item) {
+    if (Full()) {
+        ExpireOldest();
+    }
+
+    size_t slot = (oldest_ + size_) % window_;
+    values_[slot] = item;
+    ++size_;
+
+    if (!heaps_[kLower].empty() && !cmp_(values_[heaps_[kLower].front()], item)) {
+        HeapInsert(kLower, slot);
+
+    } else {
+        HeapInsert(kUpper, slot);
+    }
+
+    Rebalance();
+}
+
+template <class Item, class Compare>
+void StreamingQuantile<Item, Compare>::ExpireOldest() {
+    if (Empty()) {
+        return;
+    }
+
+    HeapRemove(oldest_);
+    oldest_ = (oldest_ + 1) % window_;
+    --size_;
+    Rebalance();
+}
+
+template <class Item, class Compare>
+Item StreamingQuantile<Item, Compare>::Get() {
+    return values_[heaps_[kLower].front()];
+}
+
+template <class Item, class Compare>
+size_t StreamingQuantile<Item, Compare>::Size() {
+    return size_;
+}
+
+template <class Item, class Compare>
+bool StreamingQuantile<Item, Compare>::Empty() {
+    return size_ == 0;
+}
+
+template <class Item, class Compare>
+bool StreamingQuantile<Item, Compare>::Full() {
+    return size_ == window_;
+}
+
+//  Quantile is the item of rank floor(q * (n - 1))
+template <class Item, class Compare>
+size_t StreamingQuantile<Item, Compare>::TargetLowerSize() {
+    if (size_ == 0) {
+        return 0;
+    }
+
+    return static_cast<size_t>(quantile_ * (size_ - 1)) + 1;
+}
+
+template <class Item, class Compare>
+void StreamingQuantile<Item, Compare>::Rebalance() {
+    size_t target = TargetLowerSize();
+    while (heaps_[kLower].size() > target) {
+        HeapInsert(kUpper, HeapExtract(kLower));
+    }
+
+    while (heaps_[kLower].size() < target) {
+        HeapInsert(kLower, HeapExtract(kUpper));
+    }
+}
+
+//  Lower part is a max-heap, upper part is a min-heap
+template <class Item, class Compare>
+bool StreamingQuantile<Item, Compare>::Before(size_t heap, size_t lhs_slot, size_t rhs_slot) {
+    if (heap == kLower) {
+        return cmp_(values_[rhs_slot], values_[lhs_slot]);
+    }
+
+    return cmp_(values_[lhs_slot], values_[rhs_slot]);
+}
+
+template <class Item, class Compare>
+void StreamingQuantile<Item, Compare>::HeapInsert(size_t heap, size_t slot) {
+    heap_of_[slot] = heap;
+    pos_[slot] = heaps_[heap].size();
+    heaps_[heap].push_back(slot);
+    SiftUp(heap, pos_[slot]);
+}
+
+template <class Item, class Compare>
+size_t StreamingQuantile<Item, Compare>::HeapExtract(size_t heap) {
+    size_t slot = heaps_[heap].front();
+    HeapRemove(slot);
+    return slot;
+}
+
+template <class Item, class Compare>
+void StreamingQuantile<Item, Compare>::HeapRemove(size_t slot) {
+    size_t heap = heap_of_[slot];
+    size_t idx = pos_[slot];
+    std::vector<size_t>& data = heaps_[heap];
+
+    HeapSwap(heap, idx, data.size() - 1);
+    data.pop_back();
+    if (idx < data.size()) {
+        SiftDown(heap, SiftUp(heap, idx));
+    }
+}
+
+template <class Item, class Compare>
+void StreamingQuantile<Item, Compare>::HeapSwap(size_t heap, size_t lhs, size_t rhs) {
+    std::vector<size_t>& data = heaps_[heap];
+    std::swap(data[lhs], data[rhs]);
+    pos_[data[lhs]] = lhs;
+    pos_[data[rhs]] = rhs;
+}
+
+template <class Item, class Compare>
+size_t StreamingQuantile<Item, Compare>::SiftUp(size_t heap, size_t idx) {
+    std::vector<size_t>& data = heaps_[heap];
+    while (idx > 0 && Before(heap, data[idx], data[(idx - 1) / 2])) {
+        HeapSwap(heap, idx, (idx - 1) / 2);
+        idx = (idx - 1) / 2;
+    }
+
+    return idx;
+}
+
+template <class Item, class Compare>
+size_t StreamingQuantile<Item, Compare>::SiftDown(size_t heap, size_t idx) {
+    std::vector<size_t>& data = heaps_[heap];
+    while (2 * idx + 1 < data.size()) {
+        size_t child = 2 * idx + 1;
+        if (child + 1 < data.size() && Before(heap, data[child + 1], data[child])) {
+            ++child;
+        }
+
+        if (!Before(heap, data[child], data[idx])) {
+            break;
+        }
+
+        HeapSwap(heap, idx, child);
+        idx = child;
+    }
+
+    return idx;
+}
+
+
+/*
+ *      StreamingMedian implementation
+ */
+template <class Item, class Compare>
+StreamingMedian<Item, Compare>::StreamingMedian(size_t window)
+        : StreamingQuantile<Item, Compare>(0.5, window) {}
+
+#endif //DATA_STRUCTURES_STREAMING_QUANTILE_H